@@ -24,9 +24,37 @@
 #ifndef PATHCOMP_INCLUDED
 #define PATHCOMP_INCLUDED
 
+#include <stddef.h>
+
 /** Abstract data type for pathname composer object */
 typedef struct pathcomp_t pathcomp_t;
 
+/**
+ * Abstract data type for a context, which holds a configuration and a Lua
+ * interpreter, independently of other contexts
+ */
+typedef struct pathcomp_ctx_t pathcomp_ctx_t;
+
+/**
+ * Handle to an attribute of a composer object, as returned by
+ * pathcomp_lookup(); negative values are invalid
+ */
+typedef int pathcomp_handle_t;
+
+/**
+ * Function called for every pathname visited by pathcomp_foreach() or found by
+ * pathcomp_find_all_parallel(); \a index is the index of the combination of
+ * alternatives (see pathcomp_tell()). A nonzero return value stops the
+ * enumeration.
+ */
+typedef int pathcomp_callback_t(const char *path, size_t index, void *userdata);
+
+/** Flag for pathcomp_find_all_parallel(): deliver pathnames in any order */
+#define PATHCOMP_UNORDERED 0x1
+
+/** Flag for pathcomp_foreach(): visit only pathnames that exist */
+#define PATHCOMP_EXISTING 0x2
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,19 +62,137 @@ extern "C" {
 /** Read config from \a string and add to the global configuration */
 extern void pathcomp_add_config_from_string(const char *string);
 
-/** Read config from file \a filename and add to the global configuration */
+/**
+ * Read config from file \a filename and add to the global configuration
+ *
+ * If an up-to-date image of the file, made by pathcomp_compile_config(), is
+ * found next to it, the image is read instead.
+ */
 extern void pathcomp_add_config_from_file(const char *filename);
 
+/**
+ * Compile config file \a filename into a binary image named \a image
+ *
+ * The image holds the parsed sections of the file, and the compiled code of
+ * all Lua values. If \a image is null, the image is written to \a filename
+ * with suffix <tt>.pcc</tt> appended, where pathcomp_add_config_from_file()
+ * and pathcomp_ctx_add_config_from_file() look for it. They use the image only
+ * as long as the size and modification time of the file do not change.
+ *
+ * \return 1 on success, 0 if the file cannot be read or parsed, if a Lua value
+ * has a syntax error, or if the image cannot be written
+ */
+extern int pathcomp_compile_config(const char *filename, const char *image);
+
+/** Like pathcomp_ctx_set_dircache_ttl(), but for the default context */
+extern void pathcomp_set_dircache_ttl(double ttl);
+
+/** Like pathcomp_ctx_invalidate_dircache(), but for the default context */
+extern void pathcomp_invalidate_dircache(void);
+
+/** Like pathcomp_ctx_set_find_batch(), but for the default context */
+extern void pathcomp_set_find_batch(size_t window);
+
+/** Like pathcomp_ctx_set_find_uring(), but for the default context */
+extern void pathcomp_set_find_uring(int enable);
+
 /** Perform cleanup of the globals */
 extern void pathcomp_cleanup(void);
 
+/**
+ * Allocate and return a new context, with an empty configuration
+ *
+ * The functions that do not take a context, like pathcomp_new() and
+ * pathcomp_add_config_from_file(), operate on a default context.
+ */
+extern pathcomp_ctx_t *pathcomp_ctx_new(void);
+
+/**
+ * Free a context, including the Lua interpreters of all threads
+ *
+ * All composer objects created from the context must have been freed, and no
+ * other thread may be using the context.
+ */
+extern void pathcomp_ctx_free(pathcomp_ctx_t *ctx);
+
+/** Read config from \a string and add to the configuration of \a ctx */
+extern void pathcomp_ctx_add_config_from_string(pathcomp_ctx_t *ctx, const char *string);
+
+/** Read config from file \a filename and add to the configuration of \a ctx */
+extern void pathcomp_ctx_add_config_from_file(pathcomp_ctx_t *ctx, const char *filename);
+
+/**
+ * Set the time-to-live, in seconds, of the directory cache of \a ctx
+ *
+ * When the directory cache is enabled, pathcomp_find() reads every directory
+ * it looks into once, and answers whether a pathname exists from the
+ * directory listing, instead of calling <tt>stat(2)</tt> for every pathname.
+ * Listings older than \a ttl seconds are read again. A negative \a ttl
+ * keeps listings until the cache is invalidated; a \a ttl of zero disables
+ * the cache, which is the default.
+ *
+ * \see pathcomp_ctx_invalidate_dircache()
+ */
+extern void pathcomp_ctx_set_dircache_ttl(pathcomp_ctx_t *ctx, double ttl);
+
+/**
+ * Forget all directory listings cached by \a ctx, e.g., after files have been
+ * created or removed
+ */
+extern void pathcomp_ctx_invalidate_dircache(pathcomp_ctx_t *ctx);
+
+/**
+ * Make pathcomp_find() check whether the pathnames of \a window combinations
+ * of alternatives exist in one batch, for composer objects of \a ctx
+ *
+ * The checks of a batch are performed concurrently by a small pool of threads.
+ * This only pays off where _stat(2)_ has to wait, e.g., on a network file
+ * system; on a local file system, batching is slower. The pathname returned
+ * is still the first existing one in the order of pathcomp_next(). A \a window
+ * of 0 or 1 disables batching, which is the default. Batching is not used
+ * while the directory cache is enabled.
+ *
+ * \see pathcomp_ctx_set_find_uring()
+ */
+extern void pathcomp_ctx_set_find_batch(pathcomp_ctx_t *ctx, size_t window);
+
+/**
+ * Make the batches of pathcomp_find() submit their checks to an io_uring
+ * instead of a pool of threads, for composer objects of \a ctx, if \a enable
+ * is nonzero
+ *
+ * All checks of a batch are then submitted, and waited for, with a single
+ * system call. Where io_uring is not available, the pool of threads is used
+ * anyway. The default is to use the pool of threads.
+ *
+ * \see pathcomp_ctx_set_find_batch()
+ */
+extern void pathcomp_ctx_set_find_uring(pathcomp_ctx_t *ctx, int enable);
+
+/**
+ * Allocate and return a new composer object for class \a name; initialize
+ * attributes from sections in the configuration of \a ctx with same name
+ *
+ * The configuration of a class is resolved the first time a composer object of
+ * the class is created, and kept as a template for the next ones, until
+ * configuration is added to \a ctx. Clones of the composer object belong to the
+ * same context.
+ */
+extern pathcomp_t *pathcomp_ctx_new_composer(pathcomp_ctx_t *ctx, const char *name);
+
 /**
  * Allocate and return a new composer object for class \a name; initialize
  * attributes from sections in configuration with same name
  */
 extern pathcomp_t *pathcomp_new(const char *name);
 
-/** Clone an existing composer object */
+/**
+ * Clone an existing composer object
+ *
+ * The clone shares the values of the attributes of \a composer; the list of
+ * values of an attribute is copied only when the clone or the original adds a
+ * value to it.
+ */
 extern pathcomp_t *pathcomp_clone(pathcomp_t *composer);
 
 /** Free a composer object */
@@ -101,6 +247,53 @@ extern char *pathcomp_eval(pathcomp_t *composer, const char *name);
  */
 extern const char *pathcomp_eval_nocopy(pathcomp_t *composer, const char *name);
 
+/**
+ * Evaluate attribute \a name, and copy its value to \a dst, a buffer of \a cap
+ * characters, without allocating memory
+ *
+ * Like <tt>snprintf()</tt>, this function writes at most \a cap characters,
+ * including the terminating null character; a value that does not fit is
+ * truncated. If \a needed is not \null, the size of the full value, including
+ * the terminating null character, is stored in \a *needed, or 0 if there is no
+ * value.
+ *
+ * \return 0 on success; -1 if the value does not fit (\a errno is set to
+ * <tt>ERANGE</tt>), or if the attribute does not exist or cannot be evaluated
+ * (\a errno is set to <tt>ENOENT</tt>)
+ */
+extern int pathcomp_eval_into(pathcomp_t *composer, const char *name, char *dst, size_t cap,
+        size_t *needed);
+
+/**
+ * Return a handle to attribute \a name, for use with the functions ending in
+ * <tt>_h</tt>
+ *
+ * Resolving the name of an attribute once, and using the handle afterwards,
+ * avoids looking up the name on every call. If the attribute does not exist,
+ * an attribute without value is created, which evaluates to \null until it is
+ * set. A handle remains valid for the lifetime of the composer object, and is
+ * also valid for its clones.
+ *
+ * \return A handle, or a negative value if memory is exhausted
+ */
+extern pathcomp_handle_t pathcomp_lookup(pathcomp_t *composer, const char *name);
+
+/** Like pathcomp_set(), but for the attribute with handle \a handle */
+extern void pathcomp_set_h(pathcomp_t *composer, pathcomp_handle_t handle, const char *value);
+
+/** Like pathcomp_set_int(), but for the attribute with handle \a handle */
+extern void pathcomp_set_int_h(pathcomp_t *composer, pathcomp_handle_t handle, int value);
+
+/** Like pathcomp_eval(), but for the attribute with handle \a handle */
+extern char *pathcomp_eval_h(pathcomp_t *composer, pathcomp_handle_t handle);
+
+/** Like pathcomp_eval_nocopy(), but for the attribute with handle \a handle */
+extern const char *pathcomp_eval_nocopy_h(pathcomp_t *composer, pathcomp_handle_t handle);
+
+/** Like pathcomp_eval_into(), but for the attribute with handle \a handle */
+extern int pathcomp_eval_into_h(pathcomp_t *composer, pathcomp_handle_t handle, char *dst,
+        size_t cap, size_t *needed);
+
 /**
  * Return a textual representation of the state of composer object
  *
@@ -123,6 +316,34 @@ extern int pathcomp_done(pathcomp_t *composer);
 /** Rewind all alternatives */
 extern void pathcomp_rewind(pathcomp_t *composer);
 
+/**
+ * Return the number of combinations of alternatives
+ *
+ * This is the product of the number of alternatives of all attributes, or
+ * <tt>SIZE_MAX</tt> if the product does not fit in a <tt>size_t</tt>.
+ */
+extern size_t pathcomp_count(pathcomp_t *composer);
+
+/**
+ * Return the index of the current combination of alternatives
+ *
+ * Combinations are numbered from 0 to pathcomp_count() - 1, in the order in
+ * which pathcomp_next() visits them. When all combinations have been visited,
+ * pathcomp_count() is returned.
+ */
+extern size_t pathcomp_tell(pathcomp_t *composer);
+
+/**
+ * Make the combination of alternatives with index \a index current, as
+ * numbered by pathcomp_tell()
+ *
+ * A subsequent call to pathcomp_find() starts searching at this combination.
+ *
+ * \return 0 on success, or -1 if \a index is out of range, in which case the
+ * composer object is left unchanged
+ */
+extern int pathcomp_seek(pathcomp_t *composer, size_t index);
+
 /**
  * Evaluate and return the pathname represented by the composer object
  *
@@ -140,6 +361,21 @@ extern void pathcomp_rewind(pathcomp_t *composer);
  */
 extern char *pathcomp_yield(pathcomp_t *composer);
 
+/**
+ * Like pathcomp_yield(), but write the pathname to \a dst, a buffer of \a cap
+ * characters, without allocating memory
+ *
+ * The pathname is truncated if it does not fit, as with <tt>snprintf()</tt>.
+ * If \a needed is not \null, the size of the full pathname, including the
+ * terminating null character, is stored in \a *needed, or 0 if there is no
+ * pathname.
+ *
+ * \return 0 on success; -1 if the pathname does not fit (\a errno is set to
+ * <tt>ERANGE</tt>), or if pathcomp_yield() would return \null (\a errno is set
+ * to <tt>ENOENT</tt>)
+ */
+extern int pathcomp_yield_into(pathcomp_t *composer, char *dst, size_t cap, size_t *needed);
+
 /**
  * Step through combinations of alternatives until an existing pathname is
  * found, and return this pathname
@@ -154,6 +390,88 @@ extern char *pathcomp_yield(pathcomp_t *composer);
  */
 extern char *pathcomp_find(pathcomp_t *composer);
 
+/**
+ * Return whether pathname \a path exists, consulting the directory cache of
+ * the context of \a composer, if enabled
+ *
+ * \see pathcomp_ctx_set_dircache_ttl()
+ */
+extern int pathcomp_exists(pathcomp_t *composer, const char *path);
+
+/**
+ * Visit all combinations of alternatives, and call \a callback with the
+ * pathname of every one of them
+ *
+ * The composer object is rewound first. If \a flags contains
+ * #PATHCOMP_EXISTING, only the pathnames that exist are visited, as with
+ * pathcomp_find(). The pathname passed to \a callback points to internal
+ * storage, which is reused for the next pathname; it must not be modified or
+ * freed. While \a callback runs, the composer object is at the combination
+ * visited, so that \a callback may evaluate its attributes; but \a callback
+ * must not change the composer object. When all combinations have been
+ * visited, pathcomp_done() returns true; when \a callback stops the
+ * enumeration, the composer object is left at the last combination visited.
+ *
+ * \return 0 if all combinations have been visited, or the nonzero value
+ * returned by \a callback if it stopped the enumeration
+ */
+extern int pathcomp_foreach(pathcomp_t *composer, int flags, pathcomp_callback_t *callback,
+        void *userdata);
+
+/**
+ * Set of pathnames, as returned by pathcomp_yield_all()
+ *
+ * The pathnames are stored back to back in \a pool, each one terminated by a
+ * null character; \a size is the total number of bytes in \a pool, including
+ * the null characters. Pathname \e i starts at <tt>pool + offsets[i]</tt>, and
+ * was produced by combination of alternatives <tt>indices[i]</tt> (see
+ * pathcomp_tell()).
+ */
+typedef struct pathcomp_pathset_t {
+    size_t count;       /**< Number of pathnames */
+    char *pool;         /**< Pathnames, separated by null characters */
+    size_t size;        /**< Size of \a pool in bytes */
+    size_t *offsets;    /**< Offset of every pathname in \a pool */
+    size_t *indices;    /**< Index of the combination of every pathname */
+} pathcomp_pathset_t;
+
+/**
+ * Produce the pathnames of all combinations of alternatives at once
+ *
+ * The composer object is rewound first, and all combinations are visited, as
+ * with pathcomp_foreach(); combinations which do not produce a pathname are
+ * skipped. On success, \a *out points to a newly allocated set of pathnames,
+ * which is held in a single block of memory, and must be deallocated by the
+ * user with pathcomp_pathset_free(). Compared to calling pathcomp_yield() for
+ * every combination, this avoids one allocation per pathname, and keeps the
+ * pathnames close together in memory.
+ *
+ * \return 0 on success, or -1 on failure (with \c errno set to \c ENOMEM
+ * and \a *out set to \null)
+ */
+extern int pathcomp_yield_all(pathcomp_t *composer, pathcomp_pathset_t **out);
+
+/** Deallocate a set of pathnames returned by pathcomp_yield_all() */
+extern void pathcomp_pathset_free(pathcomp_pathset_t *set);
+
+/**
+ * Find all existing pathnames, using \a nthreads threads, and call \a callback
+ * for every one of them
+ *
+ * All combinations of alternatives are visited, irrespective of the current
+ * combination, which is left unchanged. Every thread works on a clone of \a
+ * composer. The callback is always called from the calling thread, one
+ * pathname at a time, and may use \a composer; the pathnames are delivered in
+ * the order of pathcomp_next(), unless \a flags contains
+ * #PATHCOMP_UNORDERED, in which case they are delivered as soon as they are
+ * found.
+ *
+ * \return 0 if all combinations have been visited, the nonzero value returned
+ * by \a callback if it stopped the enumeration, or -1 on error
+ */
+extern int pathcomp_find_all_parallel(pathcomp_t *composer, int nthreads, int flags,
+        pathcomp_callback_t *callback, void *userdata);
+
 /**
  * Recursively create directories up to the last directory separator of the
  * pathname represented by the composer object
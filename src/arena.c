@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An arena hands out memory from a few large chunks, by bumping a pointer.
+ * Individual allocations are never freed; all memory of an arena is freed at
+ * once, when the last reference to the arena is released. An arena may keep
+ * another one (its parent) alive, for objects that refer to memory in the
+ * parent. Allocating is not thread-safe, but references may be taken and
+ * released from any thread.
+ */
+
+#include <config.h>
+#include "arena.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* alignment suitable for any object allocated from an arena */
+#define ARENA_ALIGN sizeof(union { void *p; long long l; long double d; })
+#define ARENA_MIN_CHUNK 1024
+
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next;
+    char                 *free;  /* first free byte */
+    char                 *end;
+} arena_chunk_t;
+
+struct arena_t {
+    int            refs;
+    arena_t       *parent;
+    arena_chunk_t *chunks;       /* most recently allocated first */
+    size_t         next_size;    /* size of the next chunk to allocate */
+    arena_chunk_t  first;        /* followed by the memory of the first chunk */
+};
+
+static char *
+arena_align(char *p)
+{
+    return (char *) (((uintptr_t) p + ARENA_ALIGN - 1) & ~(uintptr_t) (ARENA_ALIGN - 1));
+}
+
+static void
+arena_chunk_init(arena_chunk_t *chunk, char *memory, size_t size)
+{
+    chunk->next = NULL;
+    chunk->free = memory;
+    chunk->end = memory + size;
+}
+
+static arena_chunk_t *
+arena_chunk_new(size_t size)
+{
+    arena_chunk_t *chunk;
+    chunk = malloc(sizeof *chunk + size);
+    if (!chunk) return chunk;
+    arena_chunk_init(chunk, (char *) (chunk + 1), size);
+    return chunk;
+}
+
+/*
+ * Create an arena whose first chunk holds \a size bytes; \a parent, if not
+ * null, is kept alive until the arena is released
+ */
+arena_t *
+arena_new(size_t size, arena_t *parent)
+{
+    arena_t *arena;
+    if (size < ARENA_MIN_CHUNK) size = ARENA_MIN_CHUNK;
+    /* the first chunk comes with the arena itself */
+    arena = malloc(sizeof *arena + size);
+    if (!arena) return arena;
+    arena_chunk_init(&arena->first, (char *) (arena + 1), size);
+    arena->chunks = &arena->first;
+    arena->refs = 1;
+    arena->parent = parent ? arena_ref(parent) : NULL;
+    /* chunks double in size, so that the number of chunks grows
+     * logarithmically with the memory allocated */
+    arena->next_size = 2 * size;
+    return arena;
+}
+
+void *
+arena_alloc(arena_t *arena, size_t size)
+{
+    arena_chunk_t *chunk;
+    char *p;
+    assert(arena);
+    if (!size) size = 1;
+    p = arena_align(arena->chunks->free);
+    if (p <= arena->chunks->end && size <= (size_t) (arena->chunks->end - p)) {
+        arena->chunks->free = p + size;
+        return p;
+    }
+    while (arena->next_size < size + ARENA_ALIGN) arena->next_size *= 2;
+    if (!(chunk = arena_chunk_new(arena->next_size))) return NULL;
+    arena->next_size *= 2;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    p = arena_align(chunk->free);
+    chunk->free = p + size;
+    return p;
+}
+
+char *
+arena_strndup(arena_t *arena, const char *s, size_t n)
+{
+    char *p;
+    assert(s);
+    if (!(p = arena_alloc(arena, n + 1))) return p;
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+char *
+arena_strdup(arena_t *arena, const char *s)
+{
+    assert(s);
+    return arena_strndup(arena, s, strlen(s));
+}
+
+arena_t *
+arena_ref(arena_t *arena)
+{
+    assert(arena);
+    __atomic_add_fetch(&arena->refs, 1, __ATOMIC_RELAXED);
+    return arena;
+}
+
+void
+arena_release(arena_t *arena)
+{
+    arena_chunk_t *chunk, *next;
+    arena_t *parent;
+    if (!arena) return;
+    if (__atomic_sub_fetch(&arena->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    for (chunk = arena->chunks; chunk != &arena->first; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    parent = arena->parent;
+    free(arena);
+    arena_release(parent);
+}
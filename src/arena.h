@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <stddef.h>
+
+typedef struct arena_t arena_t;
+
+extern arena_t *arena_new(size_t, arena_t *);
+extern void    *arena_alloc(arena_t *, size_t);
+extern char    *arena_strdup(arena_t *, const char *);
+extern char    *arena_strndup(arena_t *, const char *, size_t);
+extern arena_t *arena_ref(arena_t *);
+extern void     arena_release(arena_t *);
+
+#endif /* ARENA_INCLUDED */
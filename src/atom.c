@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "atom.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+/* maps the contents of an atom to the atom itself */
+static hash_t *atoms;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Return the atom with the same contents as \a str, creating it if necessary.
+ * Returns \null if memory is exhausted.
+ */
+const char *
+atom_string(const char *str)
+{
+    char *atom = NULL;
+    assert(str);
+    pthread_mutex_lock(&mutex);
+    if (!atoms && !(atoms = hash_new(0))) goto out;
+    if ((atom = hash_get(atoms, str))) goto out;
+    if ((atom = strdup(str))) hash_put(atoms, atom, atom);
+out:
+    pthread_mutex_unlock(&mutex);
+    return atom;
+}
+
+/*
+ * Return the atom with the same contents as \a str, or \null if no such atom
+ * exists
+ */
+const char *
+atom_lookup(const char *str)
+{
+    const char *atom;
+    assert(str);
+    pthread_mutex_lock(&mutex);
+    atom = atoms ? hash_get(atoms, str) : NULL;
+    pthread_mutex_unlock(&mutex);
+    return atom;
+}
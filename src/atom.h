@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Interned strings, after the Atom interface in "C Interfaces and
+ * Implementations" by David R. Hanson. There is only ever one copy of an atom
+ * with given contents, so atoms can be compared by address. Atoms are never
+ * deallocated. The functions of this interface may be called from any thread.
+ */
+
+#ifndef ATOM_INCLUDED
+#define ATOM_INCLUDED
+
+extern const char *atom_string(const char *);
+extern const char *atom_lookup(const char *);
+
+#endif /* ATOM_INCLUDED */
@@ -18,57 +18,218 @@
 
 #include <config.h>
 #include "att.h"
+#include "atom.h"
 #include "list.h"
 #include "value.h"
+#include "arena.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+/*
+ * The alternatives of an attribute, and their origin. They are shared between
+ * an attribute and its clones, and copied only when one of them changes its
+ * alternatives (copy on write). Shared alternatives are never modified.
+ *
+ * Attributes, and the alternatives they create, may be allocated from the
+ * arena of their composer object. Alternatives are grown in an arena only by
+ * an attribute of the same arena, since an arena may be used by one thread
+ * only.
+ */
+typedef struct {
+    int       refs;   /* number of attributes sharing the alternatives */
+    value_t **values;
+    int       count;  /* number of alternatives */
+    int       alloc;
+    char     *origin; /* not used by att_*() functions */
+    arena_t  *arena;  /* arena holding the alternatives, or null */
+} att_values_t;
+
 struct att_t {
-    char   *name;
-    list_t *alternatives;
-    list_t *current;
-    char   *origin; /* not used by att_*() functions */
+    const char    *name;       /* atom */
+    arena_t       *arena;      /* arena holding the attribute, or null */
+    att_values_t  *values;     /* alternatives, possibly shared with clones */
+    int            pos;        /* index of current alternative; count if none */
+    value_cache_t *caches;     /* results of the alternatives; allocated on first evaluation */
+    list_t        *dependents; /* attributes whose value depends on this one */
+    unsigned long  mark;       /* last invalidation pass that visited this attribute */
 };
 
+/* allocate \a size bytes from \a arena, or from the heap if \a arena is null */
+static void *
+att_alloc(arena_t *arena, size_t size)
+{
+    return arena ? arena_alloc(arena, size) : malloc(size);
+}
+
+static att_values_t *
+att_values_new(int alloc, const char *origin, arena_t *arena)
+{
+    att_values_t *values;
+    values = att_alloc(arena, sizeof *values);
+    if (!values) return values;
+    values->values = alloc ? att_alloc(arena, alloc * sizeof *values->values) : NULL;
+    if (alloc && !values->values) {
+        if (!arena) free(values);
+        return NULL;
+    }
+    values->refs = 1;
+    values->count = 0;
+    values->alloc = alloc;
+    values->origin = origin ? (arena ? arena_strdup(arena, origin) : strdup(origin)) : NULL;
+    values->arena = arena;
+    return values;
+}
+
+/* make room for one more alternative in unshared alternatives; returns -1 if
+ * out of memory */
+static int
+att_values_grow(att_values_t *values)
+{
+    value_t **p;
+    int alloc;
+    if (values->count < values->alloc) return 0;
+    alloc = values->alloc ? 2 * values->alloc : 1;
+    if (values->arena) {
+        if (!(p = arena_alloc(values->arena, alloc * sizeof *p))) return -1;
+        memcpy(p, values->values, values->count * sizeof *p);
+    }
+    else if (!(p = realloc(values->values, alloc * sizeof *p))) return -1;
+    values->values = p;
+    values->alloc = alloc;
+    return 0;
+}
+
+static void
+att_values_release(att_values_t *values)
+{
+    int i;
+    if (!values) return;
+    if (__atomic_sub_fetch(&values->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    for (i = 0; i < values->count; i++) value_free(values->values[i]);
+    if (values->arena) return;
+    free(values->values);
+    free(values->origin);
+    free(values);
+}
+
+static void
+att_release_caches(att_t *att)
+{
+    int i;
+    if (!att->caches) return;
+    for (i = 0; i < att->values->count; i++) value_cache_release(&att->caches[i]);
+    free(att->caches);
+    att->caches = NULL;
+}
+
+/* the value of the current alternative, or null */
+static value_t *
+att_current(att_t *att)
+{
+    return att->pos < att->values->count ? att->values->values[att->pos] : NULL;
+}
+
+/*
+ * the cache of the current alternative, allocating the caches if necessary;
+ * null if they cannot be allocated
+ */
+static value_cache_t *
+att_current_cache(att_t *att)
+{
+    int i;
+    if (!att->caches) {
+        att->caches = malloc(att->values->count * sizeof *att->caches);
+        if (!att->caches) return NULL;
+        for (i = 0; i < att->values->count; i++) value_cache_init(&att->caches[i]);
+    }
+    return &att->caches[att->pos];
+}
+
+/* mark the result of the current alternative as out of date */
+static void
+att_invalidate_current(att_t *att)
+{
+    value_t *value = att_current(att);
+    if (value && att->caches) value_invalidate_cached(value, &att->caches[att->pos]);
+}
+
 /**
  * \note att_new() assumes ownership of \a value. Callers must never free the
  * value they pass into att_new().
+ *
+ * If \a value is \null, an attribute without alternatives is created, which
+ * evaluates to \null until a value is added.
  */
 att_t *
 att_new(const char *name, value_t *value, const char *origin)
+{
+    return att_new_in(NULL, name, value, origin);
+}
+
+/*
+ * Like att_new(), but allocate the attribute, and the alternatives added to it
+ * later, from \a arena, which is used by a single thread
+ */
+att_t *
+att_new_in(arena_t *arena, const char *name, value_t *value, const char *origin)
 {
     att_t *att;
     assert(name);
-    assert(value);
-    att = malloc(sizeof *att);
+    att = att_alloc(arena, sizeof *att);
     if (!att) return att;
-    att->name = strdup(name);
-    att->alternatives = list_new(value);
-    att->current = att->alternatives;
-    att->origin = origin ? strdup(origin) : NULL;
+    att->name = atom_string(name);
+    att->arena = arena;
+    if (!att->name || !(att->values = att_values_new(1, origin, arena))) {
+        if (!arena) free(att);
+        return NULL;
+    }
+    if (value) att->values->values[att->values->count++] = value;
+    att->pos = 0;
+    att->caches = NULL;
+    att->dependents = NULL;
+    att->mark = 0;
     return att;
 }
 
+/*
+ * The clone shares the alternatives of \a att until either of them changes
+ * them, so that cloning does not depend on the number or size of the
+ * alternatives.
+ */
 att_t *
 att_clone(att_t *att)
+{
+    return att_clone_in(NULL, att);
+}
+
+/*
+ * Like att_clone(), but allocate the clone from \a arena. Since the clone may
+ * share alternatives allocated from the arena of \a att, that arena must
+ * outlive \a arena.
+ */
+att_t *
+att_clone_in(arena_t *arena, att_t *att)
 {
     att_t *clone;
-    list_t *p;
+    int i;
     assert(att);
-    clone = malloc(sizeof *clone);
+    clone = att_alloc(arena, sizeof *clone);
     if (!clone) return clone;
-    clone->name = strdup(att->name);
-    clone->alternatives = list_transform(att->alternatives, (list_transform_t *) value_clone, NULL);
-    clone->current = clone->alternatives;
-    /* att->current points to the n-th alternative; make clone->current point
-     * to the n-th alternative simply by counting */
-    for (p = att->alternatives; (p != att->current) && p; p = p->next) {
-        assert(clone->current);
-        clone->current = clone->current->next;
+    clone->name = att->name;
+    clone->arena = arena;
+    clone->values = att->values;
+    __atomic_add_fetch(&clone->values->refs, 1, __ATOMIC_RELAXED);
+    clone->pos = att->pos;
+    clone->caches = NULL;
+    /* share the compiled code rather than compiling it again for the clone */
+    if (att->caches && (clone->caches = malloc(att->values->count * sizeof *clone->caches))) {
+        for (i = 0; i < att->values->count; i++) value_cache_share(&clone->caches[i], &att->caches[i]);
     }
-    assert(p == att->current);
-    clone->origin = att->origin ? strdup(att->origin) : NULL;
+    /* the dependents are attributes of another composer object; the clone
+     * will have to discover its own */
+    clone->dependents = NULL;
+    clone->mark = 0;
     return clone;
 }
 
@@ -79,14 +240,20 @@ att_clone(att_t *att)
 void
 att_replace_value(att_t *att, value_t *value, const char *origin)
 {
+    att_values_t *values;
     assert(att);
     assert(value);
-    list_foreach(att->alternatives, (list_traversal_t *) value_free, NULL);
-    list_free(att->alternatives);
-    att->alternatives = list_new(value);
-    att->current = att->alternatives;
-    free(att->origin);
-    att->origin = origin ? strdup(origin) : NULL;
+    /* on the heap, as an attribute may be set over and over again */
+    values = att_values_new(1, origin, NULL);
+    if (!values) {
+        value_free(value);
+        return;
+    }
+    values->values[values->count++] = value;
+    att_release_caches(att);
+    att_values_release(att->values);
+    att->values = values;
+    att->pos = 0;
 }
 
 /**
@@ -96,20 +263,56 @@ att_replace_value(att_t *att, value_t *value, const char *origin)
 void
 att_add_value(att_t *att, value_t *value)
 {
+    att_values_t *values;
+    value_cache_t *caches;
+    int i;
     assert(att);
     assert(value);
-    list_push(att->alternatives, value);
+    values = att->values;
+    /* alternatives shared with a clone, or living in the arena of another
+     * composer object, must be copied before they change */
+    if (__atomic_load_n(&values->refs, __ATOMIC_ACQUIRE) > 1 || (values->arena && values->arena != att->arena)) {
+        values = att_values_new(att->values->count + 1, att->values->origin, NULL);
+        if (!values) {
+            value_free(value);
+            return;
+        }
+        for (i = 0; i < att->values->count; i++) values->values[i] = value_ref(att->values->values[i]);
+        values->count = att->values->count;
+        att_values_release(att->values);
+        att->values = values;
+    }
+    else if (att_values_grow(values) < 0) {
+        value_free(value);
+        return;
+    }
+    if (att->caches) {
+        /* without caches, they are allocated again on the next evaluation */
+        caches = realloc(att->caches, (values->count + 1) * sizeof *caches);
+        if (caches) value_cache_init(&caches[values->count]);
+        else att_release_caches(att);
+        att->caches = caches;
+    }
+    values->values[values->count++] = value;
+    /* an attribute without alternatives has no current alternative yet; one
+     * whose alternatives have all been visited, neither */
+    if (att->pos == values->count - 1 && values->count > 1) att->pos = values->count;
 }
 
 void
 att_free(att_t *att)
 {
     if (!att) return;
-    free(att->name);
-    list_foreach(att->alternatives, (list_traversal_t *) value_free, NULL);
-    list_free(att->alternatives);
-    free(att->origin);
-    free(att);
+    att_release_caches(att);
+    att_values_release(att->values);
+    list_free(att->dependents);
+    if (!att->arena) free(att);
+}
+
+static int
+att_is(att_t *att, att_t *other)
+{
+    return att == other;
 }
 
 int
@@ -117,14 +320,21 @@ att_name_equal_to(att_t *att, char *name)
 {
     assert(att);
     assert(name);
-    return !strcmp(att->name, name);
+    return att->name == name || !strcmp(att->name, name);
+}
+
+const char *
+att_get_name(att_t *att)
+{
+    assert(att);
+    return att->name;
 }
 
 const char *
 att_get_origin(att_t *att)
 {
     assert(att);
-    return att->origin;
+    return att->values->origin;
 }
 
 /*
@@ -133,44 +343,181 @@ att_get_origin(att_t *att)
  * function.
  */
 const char *
-att_eval(att_t *att, void *composer, const char *metatable)
+att_eval(att_t *att, interpreter_t *interp, void *composer, const char *metatable)
+{
+    value_t *value;
+    value_cache_t *cache;
+    assert(att);
+    if (!(value = att_current(att))) return NULL;
+    if (!(cache = att_current_cache(att))) return NULL;
+    return value_eval_cached(value, cache, interp, composer, metatable);
+}
+
+/*
+ * Replace the alternatives whose Lua code is a constant by its result; see
+ * value_fold(). Only alternatives not shared with clones are changed.
+ */
+void
+att_fold(att_t *att, interpreter_t *interp)
+{
+    int i;
+    assert(att);
+    if (__atomic_load_n(&att->values->refs, __ATOMIC_ACQUIRE) > 1) return;
+    for (i = 0; i < att->values->count; i++) {
+        value_t *value = att->values->values[i];
+        if (__atomic_load_n(&value->refs, __ATOMIC_ACQUIRE) == 1) value_fold(value, value->in_arena ? att->arena : NULL, interp);
+    }
+}
+
+/*
+ * Discard the cached results of all alternatives, forcing reevaluation
+ */
+void
+att_invalidate(att_t *att)
+{
+    int i;
+    assert(att);
+    if (!att->caches) return;
+    for (i = 0; i < att->values->count; i++) value_invalidate_cached(att->values->values[i], &att->caches[i]);
+}
+
+/*
+ * Discard the cached results of \a att and, recursively, of all attributes
+ * that depend on it. Attributes already visited in invalidation pass \a mark
+ * are skipped, which also protects against cycles.
+ */
+void
+att_invalidate_dependents(att_t *att, unsigned long mark)
+{
+    list_t *p;
+    assert(att);
+    if (att->mark == mark) return;
+    att->mark = mark;
+    /* only the result of the current alternative is ever used; the others are
+     * invalidated when they become current */
+    att_invalidate_current(att);
+    for (p = att->dependents; p; p = p->next) att_invalidate_dependents(p->el, mark);
+}
+
+/*
+ * Record that the value of \a dependent depends on the value of \a att
+ */
+void
+att_add_dependent(att_t *att, att_t *dependent)
+{
+    assert(att);
+    assert(dependent);
+    if (list_find_first(att->dependents, (list_traversal_t *) att_is, dependent)) return;
+    att->dependents = list_push(att->dependents, dependent);
+}
+
+/*
+ * Return whether \a dependent depends on \a att, directly or indirectly.
+ * Attributes already visited in pass \a mark are skipped.
+ */
+int
+att_has_dependent(att_t *att, att_t *dependent, unsigned long mark)
+{
+    list_t *p;
+    assert(att);
+    assert(dependent);
+    if (att->mark == mark) return 0;
+    att->mark = mark;
+    for (p = att->dependents; p; p = p->next) {
+        if (p->el == dependent || att_has_dependent(p->el, dependent, mark)) return 1;
+    }
+    return 0;
+}
+
+/*
+ * Return whether the current alternative must be reevaluated every time
+ */
+int
+att_is_volatile(att_t *att)
+{
+    assert(att);
+    return att_current(att) && att_current(att)->is_volatile;
+}
+
+/*
+ * Return the number of alternatives
+ */
+int
+att_count(att_t *att)
 {
     assert(att);
-    return att->current ? value_eval(att->current->el, composer, metatable) : NULL;
+    return att->values->count;
 }
 
 void
 att_rewind(att_t *att)
 {
     assert(att);
-    att->current = att->alternatives;
+    att->pos = 0;
+    /* a result computed while the alternative was not current is stale */
+    if (att->values->count > 1) att_invalidate_current(att);
 }
 
 int
 att_next(att_t *att)
 {
     assert(att);
-    if (!att->current) return 0;
-    att->current = att->current->next;
-    return att->current != NULL;
+    if (att->pos >= att->values->count) return 0;
+    if (++att->pos == att->values->count) return 0;
+    att_invalidate_current(att);
+    return 1;
+}
+
+/*
+ * Return the index of the current alternative
+ */
+int
+att_tell(att_t *att)
+{
+    assert(att);
+    return att->pos;
+}
+
+/*
+ * Make the alternative with index \a pos the current alternative
+ */
+void
+att_seek(att_t *att, int pos)
+{
+    assert(att);
+    assert(pos >= 0 && pos < att_count(att));
+    att->pos = pos;
+    att_invalidate_current(att);
 }
 
 int
-att_push(att_t *att, void *composer, const char *metatable)
+att_push(att_t *att, interpreter_t *interp, void *composer, const char *metatable)
 {
+    value_t *value;
+    value_cache_t *cache;
     assert(att);
-    return att->current ? value_push(att->current->el, composer, metatable) : 0;
+    if (!(value = att_current(att))) return 0;
+    if (!(cache = att_current_cache(att))) return 0;
+    return value_push_cached(value, cache, interp, composer, metatable);
 }
 
 void
 att_dump(att_t *att, buf_t *buf)
 {
+    list_t *p;
+    int i;
     assert(att);
     assert(buf);
     buf_addf(buf, "    attribute at 0x%x\n", att);
     buf_addf(buf, "      name: %s\n", att->name);
-    buf_addf(buf, "      origin: %s\n", att->origin ? att->origin : "(null)");
+    buf_addf(buf, "      origin: %s\n", att->values->origin ? att->values->origin : "(null)");
+    buf_addf(buf, "      dependents:");
+    for (p = att->dependents; p; p = p->next) buf_addf(buf, " %s", ((att_t *) p->el)->name);
+    buf_addch(buf, '\n');
     buf_addf(buf, "      values:\n");
-    value_dump_info_t info = { buf, att->current ? att->current->el : NULL };
-    list_foreach(att->alternatives, (list_traversal_t *) value_dump, &info);
+    value_dump_info_t info = { buf, att_current(att), NULL };
+    for (i = 0; i < att->values->count; i++) {
+        info.cache = att->caches ? &att->caches[i] : NULL;
+        value_dump(att->values->values[i], &info);
+    }
 }
@@ -21,20 +21,33 @@
 
 #include "buf.h"
 #include "value.h"
+#include "arena.h"
 
 typedef struct att_t att_t;
 
 extern att_t      *att_new(const char *, value_t *, const char *);
+extern att_t      *att_new_in(arena_t *, const char *, value_t *, const char *);
 extern att_t      *att_clone(att_t *);
+extern att_t      *att_clone_in(arena_t *, att_t *);
 extern void        att_replace_value(att_t *, value_t *, const char *);
 extern void        att_add_value(att_t *, value_t *);
 extern void        att_free(att_t *);
 extern int         att_name_equal_to(att_t *, char *);
+extern const char *att_get_name(att_t *);
 extern const char *att_get_origin(att_t *);
-extern const char *att_eval(att_t *, void *, const char *);
+extern const char *att_eval(att_t *, interpreter_t *, void *, const char *);
+extern void        att_fold(att_t *, interpreter_t *);
+extern void        att_invalidate(att_t *);
+extern void        att_invalidate_dependents(att_t *, unsigned long);
+extern void        att_add_dependent(att_t *, att_t *);
+extern int         att_has_dependent(att_t *, att_t *, unsigned long);
+extern int         att_is_volatile(att_t *);
+extern int         att_count(att_t *);
 extern void        att_rewind(att_t *);
 extern int         att_next(att_t *);
-extern int         att_push(att_t *, void *, const char *);
+extern int         att_tell(att_t *);
+extern void        att_seek(att_t *, int);
+extern int         att_push(att_t *, interpreter_t *, void *, const char *);
 extern void        att_dump(att_t *, buf_t *);
 
 #endif /* ATT_INCLUDED */
@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Helpers for the idioms that keep coming back in configuration files: taking
+ * part of a string, padding it, formatting a time stamp, and reading the
+ * environment. They are available to Lua code as the functions of table 'pc',
+ * and to templates as modifiers of references, so that neither has to go
+ * through the Lua string library.
+ */
+
+#include <config.h>
+#include "builtin.h"
+#include "buf.h"
+#include "hash.h"
+#include <lua.h>
+#include <lauxlib.h>
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* environment variables looked up so far; unset variables map to env_unset */
+static hash_t          *env_cache;
+static pthread_mutex_t  env_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char             env_unset;
+
+/*
+ * Return a pointer to the part of \a s from position \a first to \a last, and
+ * its length in \a len; as with Lua's string.sub(), positions start at 1, and
+ * negative positions count from the end
+ */
+const char *
+builtin_sub(const char *s, long first, long last, size_t *len)
+{
+    long n;
+    assert(s);
+    assert(len);
+    n = strlen(s);
+    if (first < 0) first = n + first + 1;
+    if (first < 1) first = 1;
+    if (last < 0) last = n + last + 1;
+    if (last > n) last = n;
+    *len = first <= last ? last - first + 1 : 0;
+    return *len ? s + first - 1 : s;
+}
+
+/*
+ * Append the first \a len characters of \a s to \a buf, padded with \a fill
+ * to at least \a width characters; on the left if \a width is positive, on
+ * the right if it is negative
+ */
+void
+builtin_pad(buf_t *buf, const char *s, size_t len, int width, int fill)
+{
+    size_t pad, abs_width;
+    assert(buf);
+    assert(s);
+    abs_width = width < 0 ? -(size_t) width : (size_t) width;
+    pad = abs_width > len ? abs_width - len : 0;
+    if (width > 0) while (pad-- > 0) buf_addch(buf, fill);
+    buf_add(buf, s, len);
+    if (width < 0) while (pad-- > 0) buf_addch(buf, fill);
+}
+
+static int
+builtin_digits(const char **p, int n, int *value)
+{
+    *value = 0;
+    while (n--) {
+        if (!isdigit((unsigned char) **p)) return 0;
+        *value = 10 * *value + *(*p)++ - '0';
+    }
+    return 1;
+}
+
+static int
+builtin_is_leap(int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+/*
+ * Append time stamp \a stamp, formatted with strftime() format \a format, to
+ * \a buf. The time stamp consists of digits YYYYMMDD, optionally followed by
+ * hh, hhmm or hhmmss, like the slots in file names. Returns 0 if the time
+ * stamp is malformed.
+ */
+int
+builtin_date(buf_t *buf, const char *stamp, const char *format)
+{
+    static const int days_before[] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+    static const int days_in[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    static const int weekday_offset[] = { 0, 3, 2, 5, 0, 3, 5, 1, 4, 6, 2, 4 };
+    struct tm tm;
+    const char *p = stamp;
+    int year, month, day, hour = 0, min = 0, sec = 0, y;
+    size_t n, avail;
+    assert(buf);
+    assert(stamp);
+    assert(format);
+    if (!builtin_digits(&p, 4, &year) || !builtin_digits(&p, 2, &month)
+            || !builtin_digits(&p, 2, &day)) return 0;
+    if (*p && !builtin_digits(&p, 2, &hour)) return 0;
+    if (*p && !builtin_digits(&p, 2, &min)) return 0;
+    if (*p && !builtin_digits(&p, 2, &sec)) return 0;
+    if (*p) return 0;
+    if (month < 1 || month > 12 || day < 1 || day > days_in[month - 1]) return 0;
+    if (month == 2 && day == 29 && !builtin_is_leap(year)) return 0;
+    if (hour > 23 || min > 59 || sec > 60) return 0;
+    memset(&tm, 0, sizeof tm);
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = min;
+    tm.tm_sec = sec;
+    tm.tm_yday = days_before[month - 1] + day - 1 + (month > 2 && builtin_is_leap(year));
+    /* day of the week by Sakamoto's method */
+    y = month < 3 ? year - 1 : year;
+    tm.tm_wday = (y + y/4 - y/100 + y/400 + weekday_offset[month - 1] + day) % 7;
+    if (!*format) return 1;
+    /* strftime() returns 0 both for empty results and for lack of space */
+    for (avail = 64; ; avail *= 2) {
+        buf_grow(buf, avail);
+        if ((n = strftime(buf->buf + buf->len, buf_avail(buf), format, &tm))) {
+            buf_setlen(buf, buf->len + n);
+            return 1;
+        }
+        if (avail > 64 * strlen(format)) return 1;
+    }
+}
+
+/*
+ * Return the value of environment variable \a name, or NULL if it is not set.
+ * Every variable is looked up only once, so that changes to the environment
+ * after the first lookup are not seen.
+ */
+const char *
+builtin_env(const char *name)
+{
+    char *value, *key;
+    const char *env;
+    assert(name);
+    pthread_mutex_lock(&env_mutex);
+    if (!env_cache && !(env_cache = hash_new(0))) goto out_unset;
+    if ((value = hash_get(env_cache, name))) goto out;
+    env = getenv(name);
+    key = strdup(name);
+    value = env ? strdup(env) : &env_unset;
+    if (!key || !value) {
+        free(key);
+        if (value != &env_unset) free(value);
+        goto out_unset;
+    }
+    hash_put(env_cache, key, value);
+out:
+    pthread_mutex_unlock(&env_mutex);
+    return value == &env_unset ? NULL : value;
+out_unset:
+    pthread_mutex_unlock(&env_mutex);
+    return NULL;
+}
+
+/*
+ * \name Lua interface
+ * \{
+ */
+
+/* pc.sub(s, first [, last]) */
+static int
+builtin_lua_sub(lua_State *L)
+{
+    const char *s = luaL_checkstring(L, 1);
+    long first = luaL_optinteger(L, 2, 1);
+    long last = luaL_optinteger(L, 3, -1);
+    size_t len;
+    s = builtin_sub(s, first, last, &len);
+    lua_pushlstring(L, s, len);
+    return 1;
+}
+
+/* pc.pad(value, width [, fill]) */
+static int
+builtin_lua_pad(lua_State *L)
+{
+    size_t len, fill_len;
+    const char *s = luaL_checklstring(L, 1, &len);
+    int width = luaL_checkint(L, 2);
+    const char *fill = luaL_optlstring(L, 3, " ", &fill_len);
+    buf_t buf;
+    luaL_argcheck(L, fill_len == 1, 3, "fill must be a single character");
+    buf_init(&buf, 0);
+    builtin_pad(&buf, s, len, width, *fill);
+    lua_pushlstring(L, buf.buf, buf.len);
+    buf_release(&buf);
+    return 1;
+}
+
+/* pc.date(stamp, format) */
+static int
+builtin_lua_date(lua_State *L)
+{
+    const char *stamp = luaL_checkstring(L, 1);
+    const char *format = luaL_checkstring(L, 2);
+    buf_t buf;
+    buf_init(&buf, 0);
+    if (!builtin_date(&buf, stamp, format)) {
+        buf_release(&buf);
+        return luaL_argerror(L, 1, "malformed time stamp");
+    }
+    lua_pushlstring(L, buf.buf, buf.len);
+    buf_release(&buf);
+    return 1;
+}
+
+/* pc.env(name) */
+static int
+builtin_lua_env(lua_State *L)
+{
+    const char *value = builtin_env(luaL_checkstring(L, 1));
+    if (value) lua_pushstring(L, value);
+    else lua_pushnil(L);
+    return 1;
+}
+
+static const luaL_Reg builtin_functions[] = {
+    { "sub",  builtin_lua_sub  },
+    { "pad",  builtin_lua_pad  },
+    { "date", builtin_lua_date },
+    { "env",  builtin_lua_env  },
+    { NULL,   NULL             }
+};
+
+/*
+ * Register the helpers as global table 'pc'
+ */
+void
+builtin_register(lua_State *L)
+{
+    assert(L);
+    luaL_register(L, "pc", builtin_functions);
+    lua_pop(L, 1);
+}
+
+/*
+ * \}
+ */
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BUILTIN_INCLUDED
+#define BUILTIN_INCLUDED
+
+#include "buf.h"
+#include <lua.h>
+
+extern const char *builtin_sub(const char *, long, long, size_t *);
+extern void        builtin_pad(buf_t *, const char *, size_t, int, int);
+extern int         builtin_date(buf_t *, const char *, const char *);
+extern const char *builtin_env(const char *);
+extern void        builtin_register(lua_State *);
+
+#endif /* BUILTIN_INCLUDED */
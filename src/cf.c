@@ -16,10 +16,31 @@
  * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * Configuration files are parsed in place: the text is read into memory (or
+ * copied, for strings), and section names, keys and values are terminated by
+ * overwriting the character that follows them with a null byte. The text is
+ * never mapped, so that a configuration file may be edited or truncated while
+ * the program runs, without changing or invalidating what has been parsed.
+ * Only values that are continued with a backslash over several lines must be
+ * copied. Text and parsed structures stay around until the cf_t object is
+ * freed.
+ *
+ * A configuration file may also be compiled into an image by cf_compile(). The
+ * image holds the sections and entries, ready to be used without parsing, and
+ * the precompiled code of Lua values. It is used instead of the file by
+ * cf_add_from_file() as long as the size and modification time of the file
+ * match those recorded in the image. Images are mapped read-only; they must
+ * only be replaced, never rewritten in place, which is what cf_compile() does.
+ */
+
 #include <config.h>
 #include "cf.h"
 #include "list.h"
+#include "hash.h"
+#include "arena.h"
 #include "buf.h"
+#include "value.h"
 #include "pathcomp/log.h"
 #include <stddef.h>
 #include <stdlib.h>
@@ -27,223 +48,653 @@
 #include <ctype.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <lua.h>
+#include <lauxlib.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define CF_MMAP
+#endif
+
+#define CF_ARENA_SIZE 4096
+#define CF_IMAGE_SUFFIX ".pcc"
+#define CF_IMAGE_MAGIC "PCCF"
+#define CF_IMAGE_VERSION 1
+#define CF_IMAGE_BYTE_ORDER 0x01020304
+
+/* text of a string or file that has been parsed, or an image */
+struct cf_block_t {
+    struct cf_block_t *next;
+    char              *text;
+    size_t             len;
+    size_t             maplen;   /* length of the mapping, or 0 if allocated */
+};
+
+/*
+ * Layout of an image: a header, followed by the sections, the entries, and
+ * the null-terminated strings and code they refer to. Offsets are counted from
+ * the start of the image. The entries of a section are consecutive.
+ */
+typedef struct {
+    char     magic[4];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t lua_version;
+    uint64_t size;              /* size of the image */
+    uint64_t source_size;       /* size of the configuration file */
+    int64_t  source_mtime;      /* modification time of the configuration file */
+    int64_t  source_mtime_nsec;
+    uint64_t nsections;
+    uint64_t nentries;
+} cf_image_header_t;
+
+typedef struct {
+    uint64_t name;
+    uint64_t first;             /* index of the first entry */
+    uint64_t count;
+} cf_image_section_t;
+
+typedef struct {
+    uint64_t key;
+    uint64_t value;
+    uint64_t code;              /* precompiled Lua code, or 0 */
+    uint64_t code_len;
+} cf_image_entry_t;
 
 /* forward declaration */
-static int cf_parse_text(cf_t *, buf_t *);
+static int cf_parse_text(cf_t *, char *, size_t);
+
+static list_t *
+cf_list_node(cf_t *cf, void *el)
+{
+    list_t *node;
+    node = arena_alloc(cf->arena, sizeof *node);
+    if (!node) return node;
+    node->next = NULL;
+    node->el = el;
+    return node;
+}
 
 static cf_kv_t *
-cf_kv_new(const char *key, const char *value)
+cf_kv_new(cf_t *cf, char *key, char *value)
 {
     cf_kv_t *kv;
-    kv = malloc(sizeof *kv);
+    kv = arena_alloc(cf->arena, sizeof *kv);
     if (!kv) return kv;
-    kv->key = strdup(key);
-    kv->value = strdup(value);
+    kv->key = key;
+    kv->value = value;
+    kv->code = NULL;
+    kv->code_len = 0;
     return kv;
 }
 
-static void
-cf_kv_free(cf_kv_t *kv)
-{
-    if (!kv) return;
-    free(kv->key);
-    free(kv->value);
-    free(kv);
-}
-
 static cf_section_t *
-cf_section_new(const char *name)
+cf_section_new(cf_t *cf, char *name)
 {
     cf_section_t *section;
-    section = malloc(sizeof *section);
+    section = arena_alloc(cf->arena, sizeof *section);
     if (!section) return section;
-    section->name = strdup(name);
+    section->name = name;
     section->entries = NULL;
     return section;
 }
 
-static void
-cf_section_free(cf_section_t *section)
-{
-    if (!section) return;
-    free(section->name);
-    list_foreach(section->entries, (list_traversal_t *) cf_kv_free, NULL);
-    list_free(section->entries);
-    free(section);
-}
-
 cf_t *
 cf_new(void)
 {
     cf_t *cf;
     cf = malloc(sizeof *cf);
     if (!cf) return cf;
+    if (!(cf->arena = arena_new(CF_ARENA_SIZE, NULL))) {
+        free(cf);
+        return NULL;
+    }
     cf->sections = NULL;
+    cf->last = NULL;
+    cf->index = NULL;
+    cf->blocks = NULL;
     return cf;
 }
 
+static void
+cf_release_text(char *text, size_t maplen)
+{
+#ifdef CF_MMAP
+    if (maplen) {
+        munmap(text, maplen);
+        return;
+    }
+#else
+    (void) maplen;
+#endif
+    free(text);
+}
+
 void
 cf_free(cf_t *cf)
 {
+    struct cf_block_t *block;
     if (!cf) return;
-    list_foreach(cf->sections, (list_traversal_t *) cf_section_free, NULL);
-    list_free(cf->sections);
+    hash_free(cf->index);
+    for (block = cf->blocks; block; block = block->next) {
+        cf_release_text(block->text, block->maplen);
+    }
+    arena_release(cf->arena);
     free(cf);
 }
 
+/* entry of the index: the sections with the same name */
+typedef struct {
+    list_t *first, *last;
+} cf_index_entry_t;
+
+/*
+ * Append a section to the list of sections and to the index. Both lists are
+ * extended through their tails, so that neither operation depends on the
+ * number of sections already present, with the same name or not.
+ */
+static void
+cf_push_section(cf_t *cf, cf_section_t *sec)
+{
+    list_t *node;
+    cf_index_entry_t *same;
+    assert(cf);
+    assert(sec);
+    if (!(node = cf_list_node(cf, sec))) return;
+    if (cf->last) cf->last->next = node;
+    else cf->sections = node;
+    cf->last = node;
+    if (!cf->index && !(cf->index = hash_new(0))) return;
+    if (!(node = cf_list_node(cf, sec))) return;
+    if ((same = hash_get(cf->index, sec->name))) {
+        same->last->next = node;
+        same->last = node;
+        return;
+    }
+    if (!(same = arena_alloc(cf->arena, sizeof *same))) return;
+    same->first = same->last = node;
+    hash_put(cf->index, sec->name, same);
+}
+
+/*
+ * Return the list of all sections with the given name, in the order in which
+ * they were added, or NULL if there are none. The list belongs to the cf_t
+ * object.
+ */
+list_t *
+cf_find_sections(cf_t *cf, const char *name)
+{
+    cf_index_entry_t *same;
+    assert(cf);
+    assert(name);
+    same = cf->index ? hash_get(cf->index, name) : NULL;
+    return same ? same->first : NULL;
+}
+
+static struct cf_block_t *
+cf_add_block(cf_t *cf, char *text, size_t len, size_t maplen)
+{
+    struct cf_block_t *block;
+    block = arena_alloc(cf->arena, sizeof *block);
+    if (!block) return block;
+    block->text = text;
+    block->len = len;
+    block->maplen = maplen;
+    block->next = cf->blocks;
+    cf->blocks = block;
+    return block;
+}
+
 int
 cf_add_from_string(cf_t *cf, const char *string)
 {
-    buf_t text;
-    int rc;
+    size_t len;
+    char *text;
     assert(cf);
-    buf_init(&text, 0);
-    buf_addstr(&text, string);
-    rc = cf_parse_text(cf, &text);
-    buf_release(&text);
-    return rc;
+    assert(string);
+    len = strlen(string);
+    if (!(text = malloc(len + 1))) return 0;
+    memcpy(text, string, len + 1);
+    if (!cf_add_block(cf, text, len, 0)) {
+        cf_release_text(text, 0);
+        return 0;
+    }
+    return cf_parse_text(cf, text, len);
 }
 
-int
-cf_add_from_file(cf_t *cf, const char *filename)
+static int
+cf_add_from_text_file(cf_t *cf, const char *filename)
 {
-    buf_t text;
-    int rc;
+    struct stat st;
+    buf_t buf;
+    char *text;
+    size_t len = 0;
+    int fd;
     assert(cf);
-    buf_init(&text, 0);
-    rc = buf_read_file(&text, filename, 0);
-    if (rc == -1) {
+    assert(filename);
+    if ((fd = open(filename, O_RDONLY)) == -1) goto error;
+    /* make room for the whole of a regular file at once, and a bit more in
+     * case it grows, so that it is read without copying */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) len = st.st_size;
+    buf_init(&buf, len + 8192);
+    if (buf_read(&buf, fd, 0) == -1) {
         int sv = errno;
-        pathcomp_log_error("cannot read file %s: %s", filename, strerror(sv));
+        close(fd);
+        errno = sv;
+        goto error;
+    }
+    close(fd);
+    text = buf_detach(&buf, &len);
+    if (!cf_add_block(cf, text, len, 0)) {
+        cf_release_text(text, 0);
         return 0;
     }
-    rc = cf_parse_text(cf, &text);
-    buf_release(&text);
-    return rc;
+    return cf_parse_text(cf, text, len);
+
+error:
+    {
+        int sv = errno;
+        pathcomp_log_error("cannot read file %s: %s", filename, strerror(sv));
+    }
+    return 0;
+}
+
+static void
+cf_get_mtime(struct stat *st, int64_t *sec, int64_t *nsec)
+{
+    *sec = st->st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    *nsec = st->st_mtim.tv_nsec;
+#else
+    *nsec = 0;
+#endif
+}
+
+static char *
+cf_image_name(const char *filename)
+{
+    buf_t name;
+    buf_init(&name, 0);
+    buf_addstr(&name, filename);
+    buf_addstr(&name, CF_IMAGE_SUFFIX);
+    return buf_detach(&name, NULL);
 }
 
+/*
+ * Check that an image is complete, and that every offset in it points inside
+ * the image. The image ends in a null byte, so that all strings are
+ * terminated.
+ */
 static int
-cf_parse_section_name(buf_t *text, buf_t *name)
+cf_image_is_valid(const char *image, size_t size)
 {
-    for (;;) {
-        int ch = buf_fgetc(text);
-        if (ch < 0) break;
-        if (ch == '\n') break;
-        if (ch == ']') return 1;
-        buf_addch(name, ch);
+    const cf_image_header_t *header = (const cf_image_header_t *) image;
+    const cf_image_section_t *sections;
+    const cf_image_entry_t *entries;
+    uint64_t i, tables;
+    if (size < sizeof *header || image[size - 1] != '\0') return 0;
+    if (memcmp(header->magic, CF_IMAGE_MAGIC, sizeof header->magic) != 0) return 0;
+    if (header->version != CF_IMAGE_VERSION || header->byte_order != CF_IMAGE_BYTE_ORDER
+            || header->lua_version != LUA_VERSION_NUM || header->size != size) return 0;
+    if (header->nsections > size / sizeof *sections || header->nentries > size / sizeof *entries) return 0;
+    tables = sizeof *header + header->nsections * sizeof *sections + header->nentries * sizeof *entries;
+    if (tables > size) return 0;
+    sections = (const cf_image_section_t *) (header + 1);
+    entries = (const cf_image_entry_t *) (sections + header->nsections);
+    for (i = 0; i < header->nsections; i++) {
+        if (sections[i].name < tables || sections[i].name >= size) return 0;
+        if (sections[i].first > header->nentries
+                || sections[i].count > header->nentries - sections[i].first) return 0;
     }
-    return 0;
+    for (i = 0; i < header->nentries; i++) {
+        if (entries[i].key < tables || entries[i].key >= size) return 0;
+        if (entries[i].value < tables || entries[i].value >= size) return 0;
+        if (entries[i].code && (entries[i].code < tables || entries[i].code > size
+                    || entries[i].code_len > size - entries[i].code)) return 0;
+    }
+    return 1;
 }
 
+/*
+ * Add the sections of the image of configuration file \a filename, if there is
+ * one, and it is up to date. Return -1 if there is no usable image.
+ */
 static int
-cf_parse_value(buf_t *text, buf_t *value)
-{
-    /* skip initial spaces */
-    for (;;) {
-        int ch = buf_fgetc(text);
-        if (!isspace(ch) || ch == '\n') {
-            buf_ungetc(text, ch);
-            break;
-        }
+cf_add_from_image(cf_t *cf, const char *filename)
+{
+#ifdef CF_MMAP
+    struct stat source, st;
+    const cf_image_header_t *header;
+    const cf_image_section_t *sections;
+    const cf_image_entry_t *entries;
+    char *name, *image;
+    int64_t mtime, mtime_nsec;
+    uint64_t i, j;
+    int fd;
+    if (stat(filename, &source) == -1 || !S_ISREG(source.st_mode)) return -1;
+    name = cf_image_name(filename);
+    fd = open(name, O_RDONLY);
+    free(name);
+    if (fd == -1) return -1;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof *header) {
+        close(fd);
+        return -1;
     }
-    /* parse value */
-    for (;;) {
-        int ch = buf_fgetc(text);
-        if (ch < 0) break;
-        if (ch == '\\') {
-            ch = buf_fgetc(text);
-            switch (ch) {
-                case '\n':
-                    /* escape newlines */
-                    continue;
-#if 0
-                case '\\':
-                    /* insert literal backslash */
-                    break;
-#endif
-                default  :
-                    /* let unknown escape sequences pass through */
-                    buf_addch(value, '\\');
-                    break;
+    image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) return -1;
+    header = (const cf_image_header_t *) image;
+    cf_get_mtime(&source, &mtime, &mtime_nsec);
+    if (!cf_image_is_valid(image, st.st_size) || header->source_size != (uint64_t) source.st_size
+            || header->source_mtime != mtime || header->source_mtime_nsec != mtime_nsec) {
+        munmap(image, st.st_size);
+        return -1;
+    }
+    if (!cf_add_block(cf, image, st.st_size, st.st_size)) {
+        munmap(image, st.st_size);
+        return 0;
+    }
+    sections = (const cf_image_section_t *) (header + 1);
+    entries = (const cf_image_entry_t *) (sections + header->nsections);
+    for (i = 0; i < header->nsections; i++) {
+        cf_section_t *sec;
+        list_t *last_entry = NULL;
+        /* the image is read-only, but none of its strings are ever written to */
+        if (!(sec = cf_section_new(cf, image + sections[i].name))) return 0;
+        for (j = sections[i].first; j < sections[i].first + sections[i].count; j++) {
+            cf_kv_t *kv;
+            list_t *node;
+            if (!(kv = cf_kv_new(cf, image + entries[j].key, image + entries[j].value))) return 0;
+            if (entries[j].code) {
+                kv->code = image + entries[j].code;
+                kv->code_len = entries[j].code_len;
             }
+            if (!(node = cf_list_node(cf, kv))) return 0;
+            if (last_entry) last_entry->next = node;
+            else sec->entries = node;
+            last_entry = node;
         }
-        if (ch == '\n') return 1;
-        buf_addch(value, ch);
+        cf_push_section(cf, sec);
     }
-    /* reaching end-of-file is not a syntax error! */
     return 1;
+#else
+    (void) cf;
+    (void) filename;
+    return -1;
+#endif
+}
+
+int
+cf_add_from_file(cf_t *cf, const char *filename)
+{
+    int rc;
+    assert(cf);
+    assert(filename);
+    if ((rc = cf_add_from_image(cf, filename)) >= 0) return rc;
+    return cf_add_from_text_file(cf, filename);
+}
+
+static int
+cf_count_entries(cf_section_t *sec, uint64_t *count)
+{
+    *count += list_length(sec->entries);
+    return 0;
+}
+
+static uint64_t
+cf_image_add_string(buf_t *data, uint64_t base, const char *s)
+{
+    uint64_t offset = base + data->len;
+    buf_add(data, s, strlen(s) + 1);
+    return offset;
 }
 
 static int
-cf_parse_key_value_pair(buf_t *text, buf_t *key, buf_t *value)
-{
-    for (;;) {
-        int ch = buf_fgetc(text);
-        if (ch < 0) break;
-        if (ch == '\n') break;
-        if (ch == '[' || ch == ']') break;
-        if (ch == '=') {
-            buf_rtrim(key);
-            return cf_parse_value(text, value);
+cf_write_file(const char *filename, buf_t *contents)
+{
+    buf_t tmp;
+    int fd, ok;
+    buf_init(&tmp, 0);
+    buf_addf(&tmp, "%s.XXXXXX", filename);
+    if ((fd = mkstemp(tmp.buf)) == -1) {
+        int sv = errno;
+        pathcomp_log_error("cannot create file %s: %s", tmp.buf, strerror(sv));
+        buf_release(&tmp);
+        return 0;
+    }
+    ok = write(fd, contents->buf, contents->len) == (ssize_t) contents->len;
+    ok = fchmod(fd, 0644) == 0 && ok;
+    ok = close(fd) == 0 && ok;
+    /* replace the image atomically, so that readers never see a partial image */
+    ok = ok && rename(tmp.buf, filename) == 0;
+    if (!ok) {
+        int sv = errno;
+        pathcomp_log_error("cannot write file %s: %s", filename, strerror(sv));
+        unlink(tmp.buf);
+    }
+    buf_release(&tmp);
+    return ok;
+}
+
+/*
+ * Compile configuration file \a filename into \a image; if \a image is null, into
+ * the image that cf_add_from_file() will look for. Return 1 on success, and 0
+ * if the file cannot be read or parsed, or if any of its Lua values does not
+ * compile.
+ */
+int
+cf_compile(const char *filename, const char *image)
+{
+    cf_image_header_t header;
+    cf_image_section_t *sections = NULL;
+    cf_image_entry_t *entries = NULL;
+    struct stat source;
+    lua_State *L = NULL;
+    cf_t *cf;
+    list_t *psec;
+    buf_t data, code, out;
+    char *name = NULL;
+    uint64_t nsections, nentries = 0, base, i = 0, j = 0;
+    int ok = 0;
+    assert(filename);
+    if (stat(filename, &source) == -1) {
+        int sv = errno;
+        pathcomp_log_error("cannot read file %s: %s", filename, strerror(sv));
+        return 0;
+    }
+    if (!(cf = cf_new())) return 0;
+    buf_init(&data, 0);
+    buf_init(&code, 0);
+    buf_init(&out, 0);
+    if (!cf_add_from_text_file(cf, filename)) {
+        pathcomp_log_error("cannot parse file %s", filename);
+        goto out;
+    }
+    nsections = list_length(cf->sections);
+    list_foreach(cf->sections, (list_traversal_t *) cf_count_entries, &nentries);
+    sections = calloc(nsections + 1, sizeof *sections);
+    entries = calloc(nentries + 1, sizeof *entries);
+    if (!sections || !entries || !(L = luaL_newstate())) goto out;
+    base = sizeof header + nsections * sizeof *sections + nentries * sizeof *entries;
+    for (psec = cf->sections; psec; psec = psec->next, i++) {
+        cf_section_t *sec = psec->el;
+        list_t *pkv;
+        sections[i].name = cf_image_add_string(&data, base, sec->name);
+        sections[i].first = j;
+        sections[i].count = list_length(sec->entries);
+        for (pkv = sec->entries; pkv; pkv = pkv->next, j++) {
+            cf_kv_t *kv = pkv->el;
+            value_t *val;
+            entries[j].key = cf_image_add_string(&data, base, kv->key);
+            entries[j].value = cf_image_add_string(&data, base, kv->value);
+            if (!(val = value_new_auto(kv->value))) goto out;
+            if (val->type == VALUE_LUA) {
+                buf_setlen(&code, 0);
+                if (value_compile(val, L, &code) != LUA_OK) {
+                    pathcomp_log_error("%s: [%s] %s: %s", filename, sec->name, kv->key,
+                            lua_tostring(L, -1));
+                    value_free(val);
+                    goto out;
+                }
+                entries[j].code = base + data.len;
+                entries[j].code_len = code.len;
+                buf_add(&data, code.buf, code.len);
+            }
+            value_free(val);
         }
-        buf_addch(key, ch);
     }
-    return 0;
+    /* terminate the image, so that every string is terminated */
+    buf_addch(&data, '\0');
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, CF_IMAGE_MAGIC, sizeof header.magic);
+    header.version = CF_IMAGE_VERSION;
+    header.byte_order = CF_IMAGE_BYTE_ORDER;
+    header.lua_version = LUA_VERSION_NUM;
+    header.size = base + data.len;
+    header.source_size = source.st_size;
+    cf_get_mtime(&source, &header.source_mtime, &header.source_mtime_nsec);
+    header.nsections = nsections;
+    header.nentries = nentries;
+    buf_add(&out, &header, sizeof header);
+    buf_add(&out, sections, nsections * sizeof *sections);
+    buf_add(&out, entries, nentries * sizeof *entries);
+    buf_add(&out, data.buf, data.len);
+    if (!image) image = name = cf_image_name(filename);
+    ok = cf_write_file(image, &out);
+
+out:
+    if (L) lua_close(L);
+    free(sections);
+    free(entries);
+    free(name);
+    buf_release(&data);
+    buf_release(&code);
+    buf_release(&out);
+    cf_free(cf);
+    return ok;
+}
+
+static char *
+cf_rtrim(char *begin, char *end)
+{
+    while (end > begin && isspace((unsigned char) end[-1])) --end;
+    return end;
 }
 
+static char *
+cf_line_end(char *p, char *end)
+{
+    char *eol = memchr(p, '\n', end - p);
+    return eol ? eol : end;
+}
+
+/*
+ * A line is continued on the next one if it ends in an odd number of
+ * backslashes; other backslashes are taken literally
+ */
 static int
-cf_parse_text(cf_t *cf, buf_t *text)
+cf_is_continued(char *begin, char *eol, char *end)
+{
+    size_t n = 0;
+    if (eol == end) return 0;
+    while (eol > begin && eol[-1] == '\\') --eol, ++n;
+    return n % 2;
+}
+
+/*
+ * Parse the value starting at *p, and advance *p to the next line. Values on a
+ * single line are terminated in place; continued values are joined into a new
+ * string.
+ */
+static char *
+cf_parse_value(cf_t *cf, char **p, char *end)
+{
+    char *begin = *p, *eol;
+    buf_t joined;
+    eol = cf_line_end(begin, end);
+    if (!cf_is_continued(begin, eol, end)) {
+        *cf_rtrim(begin, eol) = '\0';
+        *p = eol < end ? eol + 1 : end;
+        return begin;
+    }
+    buf_init(&joined, 0);
+    do {
+        buf_add(&joined, begin, eol - 1 - begin);
+        begin = eol + 1;
+        eol = cf_line_end(begin, end);
+    } while (cf_is_continued(begin, eol, end));
+    buf_add(&joined, begin, eol - begin);
+    buf_rtrim(&joined);
+    *p = eol < end ? eol + 1 : end;
+    begin = arena_strndup(cf->arena, joined.buf, joined.len);
+    buf_release(&joined);
+    return begin;
+}
+
+static int
+cf_parse_text(cf_t *cf, char *text, size_t len)
 {
     cf_section_t *sec = NULL;
-    int comment = 0;
-    for (;;) {
-        int ch = buf_fgetc(text);
-        if (ch < 0) break;
-        if (ch == '\n') {
-            comment = 0;
+    list_t *last_entry = NULL;
+    char *p = text, *end = text + len;
+    while (p < end) {
+        char *eol, *q;
+        int ch = (unsigned char) *p;
+        if (isspace(ch)) {
+            ++p;
             continue;
         }
-        if (comment || isspace(ch)) continue;
+        eol = cf_line_end(p, end);
         if (ch == ';' || ch == '#' ) {
-            comment = 1;
+            p = eol;
             continue;
         }
         if (ch == '[') {
-            buf_t name;
-
-            buf_init(&name, 0);
             /* any existing section must be pushed onto the list now */
             if (sec) {
-                cf->sections = list_push(cf->sections, sec);
+                cf_push_section(cf, sec);
+                sec = NULL;
             }
-            if (!cf_parse_section_name(text, &name)) return 0;
-            sec = cf_section_new(name.buf);
-            buf_release(&name);
+            if (!(q = memchr(p + 1, ']', eol - p - 1))) return 0;
+            *q = '\0';
+            if (!(sec = cf_section_new(cf, p + 1))) return 0;
+            last_entry = NULL;
+            p = q + 1;
             continue;
         }
         if (ch == '=') return 0;
         else {
-            buf_t key, value;
+            char *key = p, *value;
             cf_kv_t *kv;
+            list_t *node;
 
-            buf_ungetc(text, ch);
-            buf_init(&key, 0);
-            buf_init(&value, 0);
-            if (!cf_parse_key_value_pair(text, &key, &value)) return 0;
-            buf_rtrim(&value);
-            kv = cf_kv_new(key.buf, value.buf);
-            buf_release(&key);
-            buf_release(&value);
+            for (q = p; q < eol && *q != '='; ++q) {
+                if (*q == '[' || *q == ']') return 0;
+            }
+            if (q == eol) return 0;
+            *cf_rtrim(key, q) = '\0';
+            /* skip initial spaces */
+            p = q + 1;
+            while (p < eol && isspace((unsigned char) *p)) ++p;
+            if (!(value = cf_parse_value(cf, &p, end))) return 0;
             if (!sec) {
                 /* there is no section to attach this entry to */
-                cf_kv_free(kv);
                 continue;
             }
-            sec->entries = list_push(sec->entries, kv);
+            if (!(kv = cf_kv_new(cf, key, value))) return 0;
+            if (!(node = cf_list_node(cf, kv))) return 0;
+            if (last_entry) last_entry->next = node;
+            else sec->entries = node;
+            last_entry = node;
         }
     }
     if (sec) {
-        cf->sections = list_push(cf->sections, sec);
+        cf_push_section(cf, sec);
     }
     return 1;
 }
@@ -20,10 +20,14 @@
 #define CF_INCLUDED
 
 #include "list.h"
+#include "hash.h"
+#include "arena.h"
 
 typedef struct cf_kv_t {
-    char *key;
-    char *value;
+    char       *key;
+    char       *value;
+    const char *code;       /* precompiled Lua code from an image, or NULL */
+    size_t      code_len;
 } cf_kv_t;
 
 typedef struct cf_section_t {
@@ -32,12 +36,18 @@ typedef struct cf_section_t {
 } cf_section_t;
 
 typedef struct cf_t {
-    list_t *sections;
+    list_t            *sections;
+    list_t            *last;       /* last element of sections */
+    hash_t            *index;      /* section name -> list of sections with that name */
+    arena_t           *arena;      /* sections, entries and list nodes */
+    struct cf_block_t *blocks;     /* parsed text, referred to by sections and entries */
 } cf_t;
 
 extern cf_t *cf_new(void);
 extern void  cf_free(cf_t *);
 extern int   cf_add_from_string(cf_t *, const char *);
 extern int   cf_add_from_file(cf_t *, const char *);
+extern list_t *cf_find_sections(cf_t *, const char *);
+extern int   cf_compile(const char *, const char *);
 
 #endif /* CF_INCLUDED */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * pathcomp-compile: compile a configuration file into an image, which is read
+ * instead of the file as long as the file does not change
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <assert.h>
+#include "pathcomp/log.h"
+
+static void
+print_usage(void)
+{
+    puts("Usage\n"
+         "    pathcomp-compile [ -h -o image ] config\n"
+         "\n"
+         "Compile config file 'config' into a binary image, which is used instead\n"
+         "of the config file until the config file is modified.\n"
+         "\n"
+         "Options\n"
+         "    -h: display this information\n"
+         "    -o image: write the image to file 'image' (default: config.pcc)\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *image = NULL;
+    int opt;
+    opterr = 0; /* prevent getopt() from printing error messages */
+    while ((opt = getopt(argc, argv, ":ho:")) != -1) {
+        switch (opt) {
+            case 'h':
+                print_usage();
+                exit(EXIT_SUCCESS);
+                break;
+
+            case 'o':
+                image = optarg;
+                break;
+
+            case '?':
+                pathcomp_log_error("invalid option '%c'", optopt);
+                print_usage();
+                exit(EXIT_FAILURE);
+
+            case ':':
+                pathcomp_log_error("missing argument for option '%c'", optopt);
+                print_usage();
+                exit(EXIT_FAILURE);
+
+            default:
+                assert(0);
+        }
+    }
+    if (optind != argc - 1) {
+        pathcomp_log_error("exactly one config file must be given");
+        print_usage();
+        exit(EXIT_FAILURE);
+    }
+    return pathcomp_compile_config(argv[optind], image) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cache of directory listings, to answer the question whether a pathname
+ * exists without calling stat() for every pathname. Every directory is read
+ * once, and its entries are kept in a hash table, until the listing is older
+ * than the time-to-live (TTL) of the cache, or until the cache is invalidated.
+ * A TTL of zero disables the cache; a negative TTL makes listings valid until
+ * the cache is invalidated.
+ *
+ * Symbolic links, entries of unknown type, and directories that cannot be
+ * listed, are still checked with stat().
+ */
+
+#include <config.h>
+#include "dircache.h"
+#include "hash.h"
+#include "buf.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char   *path;    /* the directory */
+    char   *names;   /* names of the entries, separated by null characters */
+    hash_t *entries; /* names of the entries, or null if directory is missing */
+    int     listed;  /* the directory could be read, or is known not to exist */
+    double  expires;
+} dircache_dir_t;
+
+struct dircache_t {
+    double          ttl;
+    int             enabled; /* ttl is nonzero; read without the mutex */
+    hash_t         *dirs;  /* maps directory to dircache_dir_t */
+    unsigned long   epoch; /* number of times the cache was invalidated */
+    pthread_mutex_t mutex;
+};
+
+/* values in dircache_dir_t.entries */
+static int entry_present, entry_link;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+dircache_t *
+dircache_new(double ttl)
+{
+    dircache_t *cache;
+    cache = malloc(sizeof *cache);
+    if (!cache) return cache;
+    cache->ttl = ttl;
+    cache->enabled = ttl != 0;
+    cache->dirs = NULL;
+    cache->epoch = 0;
+    pthread_mutex_init(&cache->mutex, NULL);
+    return cache;
+}
+
+static void
+dircache_dir_clear(dircache_dir_t *dir)
+{
+    hash_free(dir->entries);
+    dir->entries = NULL;
+    free(dir->names);
+    dir->names = NULL;
+    dir->listed = 0;
+}
+
+static int
+dircache_dir_free(const char *key, dircache_dir_t *dir, void *userdata)
+{
+    (void) key;
+    (void) userdata;
+    dircache_dir_clear(dir);
+    free(dir->path);
+    free(dir);
+    return 0;
+}
+
+static void
+dircache_clear(dircache_t *cache)
+{
+    if (!cache->dirs) return;
+    hash_foreach(cache->dirs, (hash_traversal_t *) dircache_dir_free, NULL);
+    hash_free(cache->dirs);
+    cache->dirs = NULL;
+}
+
+void
+dircache_free(dircache_t *cache)
+{
+    if (!cache) return;
+    dircache_clear(cache);
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache);
+}
+
+void
+dircache_set_ttl(dircache_t *cache, double ttl)
+{
+    assert(cache);
+    pthread_mutex_lock(&cache->mutex);
+    cache->ttl = ttl;
+    __atomic_store_n(&cache->enabled, ttl != 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+double
+dircache_get_ttl(dircache_t *cache)
+{
+    double ttl;
+    assert(cache);
+    pthread_mutex_lock(&cache->mutex);
+    ttl = cache->ttl;
+    pthread_mutex_unlock(&cache->mutex);
+    return ttl;
+}
+
+/*
+ * Return whether the TTL is nonzero, without taking the mutex, so that
+ * existence checks cost no more than stat() while the cache is disabled
+ */
+int
+dircache_enabled(dircache_t *cache)
+{
+    assert(cache);
+    return __atomic_load_n(&cache->enabled, __ATOMIC_RELAXED);
+}
+
+/*
+ * Forget all directory listings
+ */
+void
+dircache_invalidate(dircache_t *cache)
+{
+    assert(cache);
+    pthread_mutex_lock(&cache->mutex);
+    dircache_clear(cache);
+    ++cache->epoch;
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * Read the entries of directory \a dir->path; to be called without holding
+ * the mutex of the cache, as reading a directory may be slow
+ */
+static void
+dircache_dir_list(dircache_dir_t *dir)
+{
+    DIR *dp;
+    struct dirent *de;
+    buf_t names;
+    size_t len, count = 0;
+    char *p;
+    dircache_dir_clear(dir);
+    if (!(dp = opendir(*dir->path ? dir->path : "."))) {
+        /* a missing directory has no entries; in other cases, e.g., when the
+         * directory cannot be read, stat() is needed */
+        if (errno == ENOENT || errno == ENOTDIR) dir->listed = 1;
+        return;
+    }
+    buf_init(&names, 0);
+    while ((de = readdir(dp))) {
+        /* mark symbolic links, and entries of unknown type, by a leading
+         * character that cannot appear in a name */
+        if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN) buf_addch(&names, '/');
+        buf_add(&names, de->d_name, strlen(de->d_name) + 1);
+        ++count;
+    }
+    closedir(dp);
+    dir->names = buf_detach(&names, &len);
+    if (!(dir->entries = hash_new(count))) {
+        /* stat() will be used instead */
+        free(dir->names);
+        dir->names = NULL;
+        return;
+    }
+    for (p = dir->names; p < dir->names + len; p += strlen(p) + 1) {
+        if (*p == '/') hash_put(dir->entries, p + 1, &entry_link);
+        else hash_put(dir->entries, p, &entry_present);
+    }
+    dir->listed = 1;
+}
+
+/*
+ * Return the entry of directory \a path, creating it if necessary
+ */
+static dircache_dir_t *
+dircache_get_dir(dircache_t *cache, const char *path)
+{
+    dircache_dir_t *dir;
+    if (!cache->dirs && !(cache->dirs = hash_new(0))) return NULL;
+    if ((dir = hash_get(cache->dirs, path))) return dir;
+    dir = malloc(sizeof *dir);
+    if (!dir) return NULL;
+    if (!(dir->path = strdup(path))) {
+        free(dir);
+        return NULL;
+    }
+    dir->names = NULL;
+    dir->entries = NULL;
+    dir->listed = 0;
+    dir->expires = 0;
+    hash_put(cache->dirs, dir->path, dir);
+    return dir;
+}
+
+/*
+ * Answer whether \a name is in the listing \a dir: 1 or 0, or -1 if stat() is
+ * needed
+ */
+static int
+dircache_dir_lookup(dircache_dir_t *dir, const char *name)
+{
+    void *entry;
+    if (!dir->listed) return -1;
+    entry = dir->entries ? hash_get(dir->entries, name) : NULL;
+    if (entry == &entry_link) return -1;
+    return entry != NULL;
+}
+
+/*
+ * Return whether \a path exists, consulting the listing of its parent
+ * directory
+ *
+ * Returns -1 if the answer cannot be given from the listing, in which case the
+ * caller should use stat().
+ *
+ * The parent directory is listed without holding the mutex, so that threads
+ * looking up other directories are not held up. The listing is installed
+ * afterwards, unless the cache was invalidated in the meantime; two threads
+ * that need the same listing at the same time may both read the directory.
+ */
+static int
+dircache_lookup(dircache_t *cache, const char *path)
+{
+    dircache_dir_t *dir, listing;
+    const char *slash, *name;
+    char *parent;
+    unsigned long epoch;
+    double t, ttl;
+    int fresh, rc = -1;
+    slash = strrchr(path, '/');
+    name = slash ? slash + 1 : path;
+    /* '.', '..' and names ending in a slash are not looked up */
+    if (!*name || !strcmp(name, ".") || !strcmp(name, "..")) return -1;
+    if (slash == path) parent = strdup("/");
+    else parent = slash ? strndup(path, slash - path) : strdup("");
+    if (!parent) return -1;
+    t = now();
+    pthread_mutex_lock(&cache->mutex);
+    ttl = cache->ttl;
+    epoch = cache->epoch;
+    dir = ttl != 0 && cache->dirs ? hash_get(cache->dirs, parent) : NULL;
+    fresh = dir && (ttl < 0 || t < dir->expires);
+    if (fresh) rc = dircache_dir_lookup(dir, name);
+    pthread_mutex_unlock(&cache->mutex);
+    if (ttl == 0 || fresh) {
+        free(parent);
+        return rc;
+    }
+    listing.path = parent;
+    listing.names = NULL;
+    listing.entries = NULL;
+    listing.listed = 0;
+    dircache_dir_list(&listing);
+    rc = dircache_dir_lookup(&listing, name);
+    pthread_mutex_lock(&cache->mutex);
+    if (cache->epoch == epoch && (dir = dircache_get_dir(cache, parent))) {
+        dircache_dir_clear(dir);
+        dir->names = listing.names;
+        dir->entries = listing.entries;
+        dir->listed = listing.listed;
+        dir->expires = t + ttl;
+        listing.names = NULL;
+        listing.entries = NULL;
+    }
+    pthread_mutex_unlock(&cache->mutex);
+    dircache_dir_clear(&listing);
+    free(parent);
+    return rc;
+}
+
+int
+dircache_exists(dircache_t *cache, const char *path)
+{
+    struct stat statbuf;
+    int rc;
+    assert(cache);
+    assert(path);
+    rc = dircache_enabled(cache) ? dircache_lookup(cache, path) : -1;
+    if (rc == -1) rc = stat(path, &statbuf) == 0;
+    return rc;
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DIRCACHE_INCLUDED
+#define DIRCACHE_INCLUDED
+
+typedef struct dircache_t dircache_t;
+
+extern dircache_t *dircache_new(double);
+extern void        dircache_free(dircache_t *);
+extern void        dircache_set_ttl(dircache_t *, double);
+extern double      dircache_get_ttl(dircache_t *);
+extern int         dircache_enabled(dircache_t *);
+extern void        dircache_invalidate(dircache_t *);
+extern int         dircache_exists(dircache_t *, const char *);
+
+#endif /* DIRCACHE_INCLUDED */
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Hash table mapping strings to pointers, using open addressing with linear
+ * probing. Keys are not copied: the caller must make sure they outlive the
+ * table. Entries cannot be removed.
+ *
+ * Tables created with hash_new_identity() compare keys by address only, and
+ * never look at the characters of the key. They are meant to be used with
+ * interned strings (see atom.h).
+ */
+
+#include <config.h>
+#include "hash.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+typedef struct {
+    const char   *key;
+    unsigned long hash;
+    void         *value;
+} hash_entry_t;
+
+struct hash_t {
+    hash_entry_t *entries;
+    size_t        alloc;  /* number of slots; always a power of two */
+    size_t        count;  /* number of slots in use */
+    int           identity; /* keys are compared by address */
+};
+
+#define HASH_MIN_ALLOC 16
+
+/* grow when more than half of the slots are in use */
+#define HASH_FULL(h) (2 * (h)->count >= (h)->alloc)
+
+/*
+ * FNV-1a
+ */
+unsigned long
+hash_string(const char *s)
+{
+    unsigned long h = 2166136261UL;
+    assert(s);
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+/*
+ * Fibonacci hashing of the address; the low bits of an address carry little
+ * information because of alignment
+ */
+static unsigned long
+hash_address(const char *s)
+{
+    unsigned long h = (unsigned long) (size_t) s * 2654435761UL;
+    return h ^ (h >> 15);
+}
+
+static hash_t *
+hash_alloc(size_t hint, int identity)
+{
+    hash_t *hash;
+    hash = malloc(sizeof *hash);
+    if (!hash) return hash;
+    hash->alloc = HASH_MIN_ALLOC;
+    while (hash->alloc < 2 * hint) hash->alloc *= 2;
+    hash->entries = calloc(hash->alloc, sizeof *hash->entries);
+    if (!hash->entries) {
+        free(hash);
+        return NULL;
+    }
+    hash->count = 0;
+    hash->identity = identity;
+    return hash;
+}
+
+hash_t *
+hash_new(size_t hint)
+{
+    return hash_alloc(hint, 0);
+}
+
+hash_t *
+hash_new_identity(size_t hint)
+{
+    return hash_alloc(hint, 1);
+}
+
+static unsigned long
+hash_key(hash_t *hash, const char *key)
+{
+    return hash->identity ? hash_address(key) : hash_string(key);
+}
+
+void
+hash_free(hash_t *hash)
+{
+    if (!hash) return;
+    free(hash->entries);
+    free(hash);
+}
+
+size_t
+hash_count(hash_t *hash)
+{
+    assert(hash);
+    return hash->count;
+}
+
+/*
+ * Return the slot where \a key is stored, or the empty slot where it should be
+ * stored
+ */
+static hash_entry_t *
+hash_lookup(hash_entry_t *entries, size_t alloc, const char *key, unsigned long h,
+        int identity)
+{
+    size_t i, mask = alloc - 1;
+    for (i = h & mask; ; i = (i + 1) & mask) {
+        hash_entry_t *e = &entries[i];
+        if (!e->key) return e;
+        /* keys are often the same pointer, in which case strcmp() is skipped */
+        if (e->key == key) return e;
+        if (!identity && e->hash == h && !strcmp(e->key, key)) return e;
+    }
+}
+
+/* double the size of the table; returns -1, leaving it unchanged, if out of
+ * memory */
+static int
+hash_grow(hash_t *hash)
+{
+    hash_entry_t *old = hash->entries, *entries;
+    size_t i, old_alloc = hash->alloc;
+    if (!(entries = calloc(2 * old_alloc, sizeof *entries))) return -1;
+    hash->alloc *= 2;
+    hash->entries = entries;
+    for (i = 0; i < old_alloc; i++) {
+        if (!old[i].key) continue;
+        *hash_lookup(hash->entries, hash->alloc, old[i].key, old[i].hash, hash->identity) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+void *
+hash_get(hash_t *hash, const char *key)
+{
+    assert(hash);
+    assert(key);
+    return hash_lookup(hash->entries, hash->alloc, key, hash_key(hash, key), hash->identity)->value;
+}
+
+/*
+ * Store \a value under \a key, and return the value previously stored under
+ * \a key, if any
+ *
+ * If the table cannot grow, it is filled up further; when it is completely
+ * full, \a value is not stored, which callers that care can detect with
+ * hash_get().
+ */
+void *
+hash_put(hash_t *hash, const char *key, void *value)
+{
+    hash_entry_t *e;
+    unsigned long h;
+    void *old;
+    assert(hash);
+    assert(key);
+    h = hash_key(hash, key);
+    e = hash_lookup(hash->entries, hash->alloc, key, h, hash->identity);
+    if (e->key) {
+        old = e->value;
+        e->value = value;
+        return old;
+    }
+    if (HASH_FULL(hash)) {
+        /* keep at least one free entry, at which lookups stop */
+        if (hash_grow(hash) < 0 && hash->count + 1 >= hash->alloc) return NULL;
+        e = hash_lookup(hash->entries, hash->alloc, key, h, hash->identity);
+    }
+    e->key = key;
+    e->hash = h;
+    e->value = value;
+    ++hash->count;
+    return NULL;
+}
+
+/*
+ * Call \a f for every entry, in unspecified order, until \a f returns a true
+ * value
+ */
+void
+hash_foreach(hash_t *hash, hash_traversal_t *f, void *userdata)
+{
+    size_t i;
+    assert(hash);
+    assert(f);
+    for (i = 0; i < hash->alloc; i++) {
+        if (!hash->entries[i].key) continue;
+        if (f(hash->entries[i].key, hash->entries[i].value, userdata)) break;
+    }
+}
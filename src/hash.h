@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HASH_INCLUDED
+#define HASH_INCLUDED
+
+#include <stddef.h>
+
+typedef struct hash_t hash_t;
+
+typedef int hash_traversal_t(const char *, void *, void *);
+
+extern hash_t       *hash_new(size_t);
+extern hash_t       *hash_new_identity(size_t);
+extern void          hash_free(hash_t *);
+extern size_t        hash_count(hash_t *);
+extern void         *hash_get(hash_t *, const char *);
+extern void         *hash_put(hash_t *, const char *, void *);
+extern void          hash_foreach(hash_t *, hash_traversal_t *, void *);
+extern unsigned long hash_string(const char *);
+
+#endif /* HASH_INCLUDED */
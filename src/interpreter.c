@@ -16,36 +16,212 @@
  * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/*
+ * An interpreter gives every thread its own Lua interpreter state, which is
+ * created the first time the thread asks for it, and closed when the thread
+ * exits (or when it calls interpreter_cleanup()). Independent interpreters
+ * have independent states.
+ */
+
 #include <config.h>
 #include "interpreter.h"
+#include "list.h"
+#include "builtin.h"
 #include <lua.h>
 #include <lauxlib.h>
 #include <lualib.h>
 #include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct {
+    lua_State     *L;
+    unsigned long  generation;
+    interpreter_t *interp;
+} interpreter_state_t;
+
+struct interpreter_t {
+    pthread_key_t           key;      /* state of the calling thread */
+    pthread_mutex_t         mutex;    /* protects states */
+    list_t                 *states;   /* states of all threads */
+    interpreter_resolver_t *resolver; /* attribute lookup for native values */
+    interpreter_pusher_t   *pusher;   /* pushes 'self' for Lua values */
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long   generation = 0; /* generation of the last state created */
+
+static int
+interpreter_state_is(interpreter_state_t *state, interpreter_state_t *other)
+{
+    return state == other;
+}
+
+static void
+interpreter_state_free(interpreter_state_t *state)
+{
+    assert(state);
+    lua_close(state->L);
+    free(state);
+}
 
-static lua_State *state = NULL;
+/*
+ * Unlink the state of the calling thread from its interpreter, and close it;
+ * called when the thread exits, or from interpreter_cleanup()
+ */
+static void
+interpreter_state_release(interpreter_state_t *state)
+{
+    interpreter_t *interp;
+    list_t *p;
+    assert(state);
+    interp = state->interp;
+    pthread_mutex_lock(&interp->mutex);
+    p = list_find_first(interp->states, (list_traversal_t *) interpreter_state_is, state);
+    assert(p);
+    interp->states = list_remove(interp->states, p);
+    list_free(p);
+    pthread_mutex_unlock(&interp->mutex);
+    interpreter_state_free(state);
+}
+
+interpreter_t *
+interpreter_new(void)
+{
+    interpreter_t *interp;
+    interp = malloc(sizeof *interp);
+    if (!interp) return interp;
+    if (pthread_key_create(&interp->key, (void (*)(void *)) interpreter_state_release) != 0) {
+        free(interp);
+        return NULL;
+    }
+    pthread_mutex_init(&interp->mutex, NULL);
+    interp->states = NULL;
+    interp->resolver = NULL;
+    interp->pusher = NULL;
+    return interp;
+}
+
+/*
+ * Close the states of all threads. No thread may be using the interpreter
+ * anymore.
+ */
+void
+interpreter_free(interpreter_t *interp)
+{
+    if (!interp) return;
+    pthread_key_delete(interp->key);
+    list_foreach(interp->states, (list_traversal_t *) interpreter_state_free, NULL);
+    list_free(interp->states);
+    pthread_mutex_destroy(&interp->mutex);
+    free(interp);
+}
 
 static void
 interpreter_initialize(lua_State *L)
 {
     assert(L);
     luaL_openlibs(L);
+    builtin_register(L);
 }
 
 lua_State *
-interpreter_get_state(void)
+interpreter_get_state(interpreter_t *interp)
+{
+    interpreter_state_t *state;
+    list_t *states;
+    assert(interp);
+    if ((state = pthread_getspecific(interp->key))) return state->L;
+    state = malloc(sizeof *state);
+    if (!state) return NULL;
+    state->L = luaL_newstate();
+    if (!state->L) {
+        free(state);
+        return NULL;
+    }
+    state->interp = interp;
+    pthread_mutex_lock(&mutex);
+    state->generation = ++generation;
+    pthread_mutex_unlock(&mutex);
+    interpreter_initialize(state->L);
+    pthread_mutex_lock(&interp->mutex);
+    states = list_push(interp->states, state);
+    if (states) interp->states = states;
+    pthread_mutex_unlock(&interp->mutex);
+    if (!states) {
+        interpreter_state_free(state);
+        return NULL;
+    }
+    pthread_setspecific(interp->key, state);
+    return state->L;
+}
+
+/*
+ * Return a number that identifies the interpreter state of the calling thread,
+ * or 0 if no state has been created yet. Every state created by
+ * interpreter_get_state() receives a new generation number, unique across
+ * threads and interpreters, so that references into the registry of another
+ * state, or of a state that has since been closed, can be recognized as stale.
+ */
+unsigned long
+interpreter_get_generation(interpreter_t *interp)
+{
+    interpreter_state_t *state;
+    assert(interp);
+    state = pthread_getspecific(interp->key);
+    return state ? state->generation : 0;
+}
+
+/*
+ * Set the function through which values that are evaluated without Lua, like
+ * templates, look up the attributes of a composer object. It plays the role
+ * of the __index metamethod for Lua code. Must be called before the
+ * interpreter is shared between threads.
+ */
+void
+interpreter_set_resolver(interpreter_t *interp, interpreter_resolver_t *resolver)
+{
+    assert(interp);
+    interp->resolver = resolver;
+}
+
+interpreter_resolver_t *
+interpreter_get_resolver(interpreter_t *interp)
 {
-    if (state) return state;
-    state = luaL_newstate();
-    interpreter_initialize(state);
-    return state;
+    assert(interp);
+    return interp->resolver;
 }
 
+/*
+ * Set the function that pushes the value of 'self' for the Lua code of a
+ * composer object. Without one, a new userdata is made for every call, with
+ * the metatable named by the caller. Must be called before the interpreter is
+ * shared between threads.
+ */
+void
+interpreter_set_pusher(interpreter_t *interp, interpreter_pusher_t *pusher)
+{
+    assert(interp);
+    interp->pusher = pusher;
+}
+
+interpreter_pusher_t *
+interpreter_get_pusher(interpreter_t *interp)
+{
+    assert(interp);
+    return interp->pusher;
+}
+
+/*
+ * Close the interpreter state of the calling thread
+ */
 void
-interpreter_cleanup(void)
+interpreter_cleanup(interpreter_t *interp)
 {
-    if (!state) return;
-    assert(!lua_gettop(state));
-    lua_close(state);
-    state = NULL;
+    interpreter_state_t *state;
+    assert(interp);
+    if (!(state = pthread_getspecific(interp->key))) return;
+    assert(!lua_gettop(state->L));
+    pthread_setspecific(interp->key, NULL);
+    interpreter_state_release(state);
 }
@@ -21,7 +21,22 @@
 
 #include <lua.h>
 
-extern lua_State *interpreter_get_state(void);
-extern void       interpreter_cleanup(void);
+typedef struct interpreter_t interpreter_t;
+
+/* returns the value of the attribute named by an atom, or NULL */
+typedef const char *interpreter_resolver_t(void *composer, const char *atom);
+
+/* pushes the Lua value standing for a composer object ('self') */
+typedef void interpreter_pusher_t(lua_State *, void *composer);
+
+extern interpreter_t *interpreter_new(void);
+extern void           interpreter_free(interpreter_t *);
+extern lua_State     *interpreter_get_state(interpreter_t *);
+extern unsigned long  interpreter_get_generation(interpreter_t *);
+extern void           interpreter_cleanup(interpreter_t *);
+extern void           interpreter_set_resolver(interpreter_t *, interpreter_resolver_t *);
+extern interpreter_resolver_t *interpreter_get_resolver(interpreter_t *);
+extern void           interpreter_set_pusher(interpreter_t *, interpreter_pusher_t *);
+extern interpreter_pusher_t *interpreter_get_pusher(interpreter_t *);
 
 #endif /* INTERPRETER_INCLUDED */
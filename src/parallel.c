@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parallel enumeration of the combinations of alternatives of a composer
+ * object. The combination space is cut into chunks of consecutive indices
+ * (see pathcomp_seek()), which are processed by a pool of worker threads, each
+ * with a clone of its own. The matches found in a chunk are handed back to the
+ * calling thread, which delivers them to the callback, so that the callback
+ * need not be thread-safe.
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+
+/* number of chunks per thread; more chunks balance the load better, at the
+ * expense of more synchronization */
+#define PARALLEL_CHUNKS_PER_THREAD 16
+
+typedef struct {
+    size_t index;
+    char  *path;
+} parallel_match_t;
+
+typedef struct {
+    size_t            first, last;  /* indices [first, last) */
+    parallel_match_t *matches;
+    size_t            count, alloc;
+    int               done;         /* processed by a worker */
+    int               delivered;    /* matches passed to the callback */
+} parallel_chunk_t;
+
+typedef struct {
+    pathcomp_t       *composer;
+    parallel_chunk_t *chunks;
+    size_t            nchunks;
+    size_t            next;         /* next chunk to be processed */
+    int               started;      /* workers that have finished cloning */
+    int               stop;
+    int               error;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+} parallel_t;
+
+static int
+parallel_add_match(parallel_chunk_t *chunk, size_t index, char *path)
+{
+    if (chunk->count == chunk->alloc) {
+        size_t alloc = chunk->alloc ? 2 * chunk->alloc : 16;
+        parallel_match_t *p = realloc(chunk->matches, alloc * sizeof *p);
+        if (!p) return -1;
+        chunk->matches = p;
+        chunk->alloc = alloc;
+    }
+    chunk->matches[chunk->count].index = index;
+    chunk->matches[chunk->count].path = path;
+    ++chunk->count;
+    return 0;
+}
+
+static void
+parallel_free_matches(parallel_chunk_t *chunk)
+{
+    size_t i;
+    for (i = 0; i < chunk->count; i++) free(chunk->matches[i].path);
+    free(chunk->matches);
+    chunk->matches = NULL;
+    chunk->count = chunk->alloc = 0;
+}
+
+static int
+parallel_process_chunk(pathcomp_t *clone, parallel_chunk_t *chunk)
+{
+    size_t i;
+    if (pathcomp_seek(clone, chunk->first) != 0) return -1;
+    for (i = chunk->first; i < chunk->last; i++) {
+        char *path = pathcomp_yield(clone);
+        if (path && pathcomp_exists(clone, path)) {
+            if (parallel_add_match(chunk, i, path) != 0) {
+                free(path);
+                return -1;
+            }
+        }
+        else free(path);
+        pathcomp_next(clone);
+    }
+    return 0;
+}
+
+static void *
+parallel_work(void *arg)
+{
+    parallel_t *par = arg;
+    pathcomp_t *clone;
+    /* clone in this thread, so that the clone compiles its Lua code in the Lua
+     * state of this thread */
+    clone = pathcomp_clone(par->composer);
+    pthread_mutex_lock(&par->mutex);
+    if (!clone) par->error = 1;
+    ++par->started;
+    pthread_cond_broadcast(&par->cond);
+    while (clone && !par->stop && !par->error && par->next < par->nchunks) {
+        parallel_chunk_t *chunk = &par->chunks[par->next++];
+        int rc;
+        pthread_mutex_unlock(&par->mutex);
+        rc = parallel_process_chunk(clone, chunk);
+        pthread_mutex_lock(&par->mutex);
+        if (rc != 0) par->error = 1;
+        chunk->done = 1;
+        pthread_cond_broadcast(&par->cond);
+    }
+    pthread_mutex_unlock(&par->mutex);
+    pathcomp_free(clone);
+    return NULL;
+}
+
+/*
+ * Return the chunk to be delivered next, waiting for it if necessary, or
+ * \null if there are none left; called with the mutex locked. \a delivered is
+ * the number of chunks delivered so far.
+ */
+static parallel_chunk_t *
+parallel_wait_for_chunk(parallel_t *par, size_t *delivered, int ordered)
+{
+    for (;;) {
+        size_t k;
+        if (par->error || *delivered == par->nchunks) return NULL;
+        /* in order, the chunks are delivered one after the other; otherwise,
+         * any chunk that is done can be delivered */
+        for (k = ordered ? *delivered : 0; k < par->nchunks; k++) {
+            parallel_chunk_t *chunk = &par->chunks[k];
+            if (chunk->delivered) continue;
+            if (chunk->done) {
+                chunk->delivered = 1;
+                ++*delivered;
+                return chunk;
+            }
+            if (ordered) break;
+        }
+        pthread_cond_wait(&par->cond, &par->mutex);
+    }
+}
+
+int
+pathcomp_find_all_parallel(pathcomp_t *composer, int nthreads, int flags,
+        pathcomp_callback_t *callback, void *userdata)
+{
+    parallel_t par;
+    pthread_t *threads;
+    size_t count, chunk_size, k, delivered = 0;
+    int i, nstarted = 0, rc = 0;
+    assert(composer);
+    assert(callback);
+    if (nthreads < 1) nthreads = 1;
+    count = pathcomp_count(composer);
+    if (count == SIZE_MAX) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+    par.composer = composer;
+    par.nchunks = (size_t) nthreads * PARALLEL_CHUNKS_PER_THREAD;
+    if (par.nchunks > count) par.nchunks = count;
+    chunk_size = (count + par.nchunks - 1) / par.nchunks;
+    par.nchunks = (count + chunk_size - 1) / chunk_size;
+    par.chunks = calloc(par.nchunks, sizeof *par.chunks);
+    threads = malloc(nthreads * sizeof *threads);
+    if (!par.chunks || !threads) {
+        free(par.chunks);
+        free(threads);
+        return -1;
+    }
+    for (k = 0; k < par.nchunks; k++) {
+        par.chunks[k].first = k * chunk_size;
+        par.chunks[k].last = k == par.nchunks - 1 ? count : (k + 1) * chunk_size;
+    }
+    par.next = 0;
+    par.started = 0;
+    par.stop = 0;
+    par.error = 0;
+    pthread_mutex_init(&par.mutex, NULL);
+    pthread_cond_init(&par.cond, NULL);
+    for (i = 0; i < nthreads; i++) {
+        if (pthread_create(&threads[i], NULL, parallel_work, &par) != 0) break;
+        ++nstarted;
+    }
+    pthread_mutex_lock(&par.mutex);
+    if (!nstarted) par.error = 1;
+    /* the caller may use the composer object from the callback, but not before
+     * all workers have cloned it */
+    while (par.started < nstarted) pthread_cond_wait(&par.cond, &par.mutex);
+    while (!rc) {
+        parallel_chunk_t *chunk = parallel_wait_for_chunk(&par, &delivered, !(flags & PATHCOMP_UNORDERED));
+        if (!chunk) break;
+        pthread_mutex_unlock(&par.mutex);
+        for (k = 0; k < chunk->count && !rc; k++)
+            rc = callback(chunk->matches[k].path, chunk->matches[k].index, userdata);
+        parallel_free_matches(chunk);
+        pthread_mutex_lock(&par.mutex);
+    }
+    par.stop = 1;
+    if (par.error && !rc) rc = -1;
+    pthread_mutex_unlock(&par.mutex);
+    for (i = 0; i < nstarted; i++) pthread_join(threads[i], NULL);
+    for (k = 0; k < par.nchunks; k++) parallel_free_matches(&par.chunks[k]);
+    pthread_cond_destroy(&par.cond);
+    pthread_mutex_destroy(&par.mutex);
+    free(par.chunks);
+    free(threads);
+    return rc;
+}
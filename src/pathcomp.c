@@ -25,7 +25,13 @@
 #include "pathcomp/log.h"
 #include "interpreter.h"
 #include "buf.h"
+#include "hash.h"
+#include "atom.h"
+#include "dircache.h"
+#include "statbatch.h"
+#include "arena.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
@@ -33,17 +39,69 @@
 #include <lauxlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <pthread.h>
 #include <errno.h>
 
+struct pathcomp_ctx_t {
+    cf_t            *config;      /* Shared by all threads; only read after set-up */
+    pthread_rwlock_t config_lock;
+    interpreter_t   *interp;
+    dircache_t      *dircache;    /* Directory listings for pathcomp_find() */
+    size_t           find_batch;  /* Combinations checked at once by pathcomp_find() */
+    int              find_flags;  /* Flags for statbatch_new(), for those checks */
+    hash_t          *classes;     /* Template composer object of every class, by name */
+    pthread_rwlock_t classes_lock;
+};
+
+/* Window of combinations whose pathnames have been checked in one batch */
+typedef struct {
+    size_t start, count, alloc; /* index of first combination, number, size */
+    char **paths;
+    int   *exists;
+} pathcomp_window_t;
+
 struct pathcomp_t {
-    char   *name;
-    list_t *attributes;
-    char   *metatable;  /* Name of the Lua metatable */
-    int     done;       /* Iterator state */
-    int     started;    /* pathcomp_find() has been called at least once */
+    pathcomp_ctx_t *ctx;
+    arena_t      *arena;       /* Holds the object, its attributes and their configured values */
+    char         *name;
+    att_t       **attributes;  /* In order of creation; the index is the handle */
+    int           count;       /* Number of attributes */
+    int           alloc;       /* Allocated size of attributes */
+    hash_t       *index;       /* Attributes indexed by name (an atom) */
+    char         *metatable;   /* Name of the Lua metatable */
+    unsigned long generation;  /* Interpreter state the metatable was registered in */
+    int           self;        /* Registry reference to 'self' in that state, if any */
+    unsigned long self_generation; /* Interpreter state holding self */
+    int           done;        /* Iterator state */
+    int           started;     /* pathcomp_find() has been called at least once */
+    att_t        *evaluating;  /* Attribute being evaluated, if any */
+    int           is_volatile; /* Evaluation depends on volatile attributes */
+    unsigned long mark;        /* Last invalidation pass */
+    statbatch_t  *statbatch;   /* Batched existence checks; created on first use */
+    int           statbatch_flags; /* Flags statbatch was created with */
+    pathcomp_window_t window;  /* Combinations checked by the last batch */
+    hash_t       *roots;       /* Whether root directories exist, by name */
+    char         *scratch;     /* Pathname being checked by pathcomp_find() */
+    size_t        scratch_size;
 };
 
-static cf_t *config;
+/* Evaluation state to be restored when evaluation of an attribute finishes */
+typedef struct {
+    att_t *evaluating;
+    int    is_volatile;
+} pathcomp_frame_t;
+
+/* context used by the functions that do not take a context */
+static pathcomp_ctx_t *default_ctx;
+static pthread_once_t  default_ctx_once = PTHREAD_ONCE_INIT;
+
+/* atoms of the special attributes, so that pathcomp_yield() need not look up
+ * the names */
+static const char     *atom_root, *atom_compose;
+static pthread_once_t  atoms_once = PTHREAD_ONCE_INIT;
+
+static const char *pathcomp_resolve(pathcomp_t *composer, const char *atom);
+static void        pathcomp_push_self(lua_State *L, pathcomp_t *composer);
 
 typedef enum { PATHCOMP_ACTION_ADD, PATHCOMP_ACTION_REPLACE,
     PATHCOMP_ACTION_ADD_IF, PATHCOMP_ACTION_NONE } pathcomp_action_t;
@@ -51,64 +109,364 @@ typedef enum { PATHCOMP_ACTION_ADD, PATHCOMP_ACTION_REPLACE,
 #define PATHCOMP_ORIGIN_RUNTIME NULL
 #define PATHCOMP_ATT_ROOT "root"
 #define PATHCOMP_ATT_COMPOSE "compose"
+
+/* initial size of the arena of a composer object; a clone needs room for the
+ * object and one attribute (without values) per attribute of the original */
+#define PATHCOMP_ARENA_SIZE 4096
+#define PATHCOMP_ARENA_SIZE_PER_ATT 80
 #define PATHCOMP_ATT_COPY "copy-from"
 
+pathcomp_ctx_t *
+pathcomp_ctx_new(void)
+{
+    pathcomp_ctx_t *ctx;
+    ctx = malloc(sizeof *ctx);
+    if (!ctx) return ctx;
+    ctx->interp = interpreter_new();
+    if (!ctx->interp) {
+        free(ctx);
+        return NULL;
+    }
+    interpreter_set_resolver(ctx->interp, (interpreter_resolver_t *) pathcomp_resolve);
+    interpreter_set_pusher(ctx->interp, (interpreter_pusher_t *) pathcomp_push_self);
+    ctx->dircache = dircache_new(0);
+    if (!ctx->dircache) {
+        interpreter_free(ctx->interp);
+        free(ctx);
+        return NULL;
+    }
+    ctx->config = NULL;
+    ctx->find_batch = 0;
+    ctx->find_flags = 0;
+    ctx->classes = NULL;
+    pthread_rwlock_init(&ctx->config_lock, NULL);
+    pthread_rwlock_init(&ctx->classes_lock, NULL);
+    return ctx;
+}
+
+static int
+pathcomp_free_class(const char *name, void *template, void *userdata)
+{
+    (void) name;
+    (void) userdata;
+    pathcomp_free(template);
+    return 0;
+}
+
+/*
+ * Discard the templates of all classes; to be called whenever the
+ * configuration changes, but not while holding config_lock
+ */
+static void
+pathcomp_ctx_forget_classes(pathcomp_ctx_t *ctx)
+{
+    assert(ctx);
+    pthread_rwlock_wrlock(&ctx->classes_lock);
+    if (ctx->classes) {
+        hash_foreach(ctx->classes, pathcomp_free_class, NULL);
+        hash_free(ctx->classes);
+        ctx->classes = NULL;
+    }
+    pthread_rwlock_unlock(&ctx->classes_lock);
+}
+
 void
-pathcomp_add_config_from_string(const char *string)
+pathcomp_ctx_free(pathcomp_ctx_t *ctx)
 {
+    if (!ctx) return;
+    pathcomp_ctx_forget_classes(ctx);
+    pthread_rwlock_destroy(&ctx->classes_lock);
+    cf_free(ctx->config);
+    pthread_rwlock_destroy(&ctx->config_lock);
+    interpreter_free(ctx->interp);
+    dircache_free(ctx->dircache);
+    free(ctx);
+}
+
+static void
+pathcomp_init_default_ctx(void)
+{
+    default_ctx = pathcomp_ctx_new();
+}
+
+static pathcomp_ctx_t *
+pathcomp_get_default_ctx(void)
+{
+    pthread_once(&default_ctx_once, pathcomp_init_default_ctx);
+    assert(default_ctx);
+    return default_ctx;
+}
+
+void
+pathcomp_ctx_add_config_from_string(pathcomp_ctx_t *ctx, const char *string)
+{
+    assert(ctx);
     assert(string);
-    if (!config) config = cf_new();
-    cf_add_from_string(config, string);
+    pthread_rwlock_wrlock(&ctx->config_lock);
+    if (!ctx->config) ctx->config = cf_new();
+    cf_add_from_string(ctx->config, string);
+    pthread_rwlock_unlock(&ctx->config_lock);
+    pathcomp_ctx_forget_classes(ctx);
+}
+
+void
+pathcomp_ctx_add_config_from_file(pathcomp_ctx_t *ctx, const char *filename)
+{
+    assert(ctx);
+    assert(filename);
+    pthread_rwlock_wrlock(&ctx->config_lock);
+    if (!ctx->config) ctx->config = cf_new();
+    cf_add_from_file(ctx->config, filename);
+    pthread_rwlock_unlock(&ctx->config_lock);
+    pathcomp_ctx_forget_classes(ctx);
+}
+
+void
+pathcomp_ctx_set_dircache_ttl(pathcomp_ctx_t *ctx, double ttl)
+{
+    assert(ctx);
+    dircache_set_ttl(ctx->dircache, ttl);
+    if (ttl == 0) dircache_invalidate(ctx->dircache);
+}
+
+void
+pathcomp_ctx_invalidate_dircache(pathcomp_ctx_t *ctx)
+{
+    assert(ctx);
+    dircache_invalidate(ctx->dircache);
+}
+
+void
+pathcomp_ctx_set_find_batch(pathcomp_ctx_t *ctx, size_t window)
+{
+    assert(ctx);
+    pthread_rwlock_wrlock(&ctx->config_lock);
+    ctx->find_batch = window;
+    pthread_rwlock_unlock(&ctx->config_lock);
+}
+
+void
+pathcomp_ctx_set_find_uring(pathcomp_ctx_t *ctx, int enable)
+{
+    assert(ctx);
+    pthread_rwlock_wrlock(&ctx->config_lock);
+    ctx->find_flags = enable ? STATBATCH_USE_URING : 0;
+    pthread_rwlock_unlock(&ctx->config_lock);
+}
+
+/* also store the flags for statbatch_new() in \a flags */
+static size_t
+pathcomp_ctx_get_find_batch(pathcomp_ctx_t *ctx, int *flags)
+{
+    size_t window;
+    pthread_rwlock_rdlock(&ctx->config_lock);
+    window = ctx->find_batch;
+    *flags = ctx->find_flags;
+    pthread_rwlock_unlock(&ctx->config_lock);
+    return window;
+}
+
+void
+pathcomp_add_config_from_string(const char *string)
+{
+    pathcomp_ctx_add_config_from_string(pathcomp_get_default_ctx(), string);
 }
 
 void
 pathcomp_add_config_from_file(const char *filename)
+{
+    pathcomp_ctx_add_config_from_file(pathcomp_get_default_ctx(), filename);
+}
+
+int
+pathcomp_compile_config(const char *filename, const char *image)
 {
     assert(filename);
-    if (!config) config = cf_new();
-    cf_add_from_file(config, filename);
+    return cf_compile(filename, image);
 }
 
 void
-pathcomp_cleanup(void)
+pathcomp_set_dircache_ttl(double ttl)
 {
-    cf_free(config);
-    config = NULL;
-    interpreter_cleanup();
+    pathcomp_ctx_set_dircache_ttl(pathcomp_get_default_ctx(), ttl);
 }
 
-static int
-find_section_with_name(cf_section_t *sec, char *name)
+void
+pathcomp_invalidate_dircache(void)
 {
-    return !strcmp(sec->name, name);
+    pathcomp_ctx_invalidate_dircache(pathcomp_get_default_ctx());
+}
+
+void
+pathcomp_set_find_batch(size_t window)
+{
+    pathcomp_ctx_set_find_batch(pathcomp_get_default_ctx(), window);
+}
+
+void
+pathcomp_set_find_uring(int enable)
+{
+    pathcomp_ctx_set_find_uring(pathcomp_get_default_ctx(), enable);
+}
+
+void
+pathcomp_cleanup(void)
+{
+    pathcomp_ctx_t *ctx = pathcomp_get_default_ctx();
+    pthread_rwlock_wrlock(&ctx->config_lock);
+    cf_free(ctx->config);
+    ctx->config = NULL;
+    pthread_rwlock_unlock(&ctx->config_lock);
+    pathcomp_ctx_forget_classes(ctx);
+    dircache_invalidate(ctx->dircache);
+    interpreter_cleanup(ctx->interp);
 }
 
 static att_t *
 pathcomp_retrieve_att(pathcomp_t *composer, const char *name)
 {
-    list_t *patt;
+    const char *atom;
     assert(composer);
     assert(name);
-    patt = list_find_first(composer->attributes, (list_traversal_t *) att_name_equal_to, (void *) name);
-    return patt ? patt->el : NULL;
+    /* if the name has never been interned, there is no such attribute */
+    atom = atom_lookup(name);
+    return atom ? hash_get(composer->index, atom) : NULL;
+}
+
+/*
+ * Append \a att to the attributes of \a composer, and return its handle, or
+ * -1 if memory is exhausted
+ */
+static pathcomp_handle_t
+pathcomp_append_att(pathcomp_t *composer, att_t *att)
+{
+    assert(composer);
+    if (!att) return -1;
+    if (composer->count == composer->alloc) {
+        int alloc = composer->alloc ? 2 * composer->alloc : 16;
+        att_t **p = realloc(composer->attributes, alloc * sizeof *p);
+        if (!p) return -1;
+        composer->attributes = p;
+        composer->alloc = alloc;
+    }
+    composer->attributes[composer->count] = att;
+    hash_put(composer->index, att_get_name(att), att);
+    return composer->count++;
 }
 
+static att_t *
+pathcomp_get_att(pathcomp_t *composer, pathcomp_handle_t handle)
+{
+    assert(composer);
+    assert(handle >= 0 && handle < composer->count);
+    if (handle < 0 || handle >= composer->count) return NULL;
+    return composer->attributes[handle];
+}
+
+/*
+ * Discard the pathnames of the window of combinations checked by
+ * pathcomp_find_batch()
+ */
 static void
-pathcomp_add_or_replace(pathcomp_t *composer, const char *name, value_t *value,
+pathcomp_clear_window(pathcomp_t *composer)
+{
+    pathcomp_window_t *win = &composer->window;
+    while (win->count > 0) free(win->paths[--win->count]);
+}
+
+static int
+pathcomp_free_root(const char *name, void *value, void *userdata)
+{
+    (void) value;
+    (void) userdata;
+    free((char *) name);
+    return 0;
+}
+
+/*
+ * Forget which pathnames pathcomp_find() has checked already
+ */
+static void
+pathcomp_forget_checks(pathcomp_t *composer)
+{
+    pathcomp_clear_window(composer);
+    if (!composer->roots) return;
+    hash_foreach(composer->roots, pathcomp_free_root, NULL);
+    hash_free(composer->roots);
+    composer->roots = NULL;
+}
+
+/*
+ * Discard all memoized results; to be called whenever the state of the composer
+ * changes in a way that may affect any attribute
+ */
+static void
+pathcomp_invalidate(pathcomp_t *composer)
+{
+    int i;
+    assert(composer);
+    for (i = 0; i < composer->count; i++) att_invalidate(composer->attributes[i]);
+    pathcomp_forget_checks(composer);
+}
+
+/*
+ * Discard the memoized results of \a att and of all attributes depending on
+ * it; to be called whenever the value of \a att changes
+ *
+ * If \a mark is zero, a new invalidation pass is started. Multiple calls can be
+ * made to belong to the same pass by passing in the return value of the first
+ * call.
+ */
+static unsigned long
+pathcomp_invalidate_att(pathcomp_t *composer, att_t *att, unsigned long mark)
+{
+    assert(composer);
+    assert(att);
+    if (!mark) mark = ++composer->mark;
+    att_invalidate_dependents(att, mark);
+    return mark;
+}
+
+/*
+ * Bracket the evaluation of \a att, recording which attributes are referenced
+ * during the evaluation of another attribute
+ */
+static void
+pathcomp_begin_eval(pathcomp_t *composer, att_t *att, pathcomp_frame_t *frame)
+{
+    assert(composer);
+    assert(att);
+    assert(frame);
+    if (composer->evaluating) att_add_dependent(att, composer->evaluating);
+    frame->evaluating = composer->evaluating;
+    frame->is_volatile = composer->is_volatile;
+    composer->evaluating = att;
+    composer->is_volatile = att_is_volatile(att);
+}
+
+static void
+pathcomp_end_eval(pathcomp_t *composer, pathcomp_frame_t *frame)
+{
+    assert(composer);
+    assert(composer->evaluating);
+    assert(frame);
+    /* a result depending on a volatile attribute cannot be reused either */
+    if (composer->is_volatile) att_invalidate(composer->evaluating);
+    composer->evaluating = frame->evaluating;
+    composer->is_volatile = frame->is_volatile || composer->is_volatile;
+}
+
+static void
+pathcomp_apply(pathcomp_t *composer, att_t *att, value_t *value,
         const char *origin, pathcomp_action_t action)
 {
-    att_t *att = NULL;
-    assert(name);
+    int was_empty;
+    assert(composer);
+    assert(att);
     assert(value);
-    att = pathcomp_retrieve_att(composer, name);
-    if (!att) {
-        att_t *new;
-        new = att_new(name, value, origin);
-        composer->attributes = list_push(composer->attributes, new);
-        return;
-    }
-    /* there happens to be an attribute with this name already */
-    if (action == PATHCOMP_ACTION_ADD_IF) {
+    was_empty = att_count(att) == 0;
+    if (was_empty) action = PATHCOMP_ACTION_REPLACE;
+    else if (action == PATHCOMP_ACTION_ADD_IF) {
         const char *old_origin;
         int old_inherited, new_inherited;
         old_origin = att_get_origin(att);
@@ -120,8 +478,43 @@ pathcomp_add_or_replace(pathcomp_t *composer, const char *name, value_t *value,
     }
     if (action == PATHCOMP_ACTION_REPLACE) att_replace_value(att, value, origin);
     else if (action == PATHCOMP_ACTION_ADD) att_add_value(att, value);
-    else if (action == PATHCOMP_ACTION_NONE) value_free(value);
+    else if (action == PATHCOMP_ACTION_NONE) {
+        value_free(value);
+        return;
+    }
     else assert(0);
+    /* attributes that referred to the attribute while it was empty have not
+     * been registered as its dependents */
+    if (was_empty) pathcomp_invalidate(composer);
+    else {
+        pathcomp_invalidate_att(composer, att, 0);
+        pathcomp_forget_checks(composer);
+    }
+}
+
+static void
+pathcomp_add_or_replace(pathcomp_t *composer, const char *name, value_t *value,
+        const char *origin, pathcomp_action_t action)
+{
+    att_t *att = NULL;
+    assert(name);
+    assert(value);
+    att = pathcomp_retrieve_att(composer, name);
+    if (!att) {
+        att_t *new;
+        new = att_new_in(composer->arena, name, value, origin);
+        if (pathcomp_append_att(composer, new) < 0) {
+            if (new) att_free(new);
+            else value_free(value);
+            return;
+        }
+        /* attributes that referred to the missing attribute before have not
+         * been registered as its dependents */
+        pathcomp_invalidate(composer);
+        return;
+    }
+    /* there happens to be an attribute with this name already */
+    pathcomp_apply(composer, att, value, origin, action);
 }
 
 static void pathcomp_add_atts_from_sections(pathcomp_t *composer, char *section_name);
@@ -134,7 +527,9 @@ pathcomp_add_atts_from_entries(pathcomp_t *composer, char *section_name, list_t
     while (entry) {
         cf_kv_t *kv = entry->el;
         assert(kv);
-        pathcomp_add_or_replace(composer, kv->key, value_new_auto(kv->value), section_name, PATHCOMP_ACTION_ADD_IF);
+        pathcomp_add_or_replace(composer, kv->key,
+                value_new_compiled_in(composer->arena, kv->value, kv->code, kv->code_len),
+                section_name, PATHCOMP_ACTION_ADD_IF);
         if (strcmp(kv->key, PATHCOMP_ATT_COPY) == 0) {
             char *parent_section_name = kv->value;
             pathcomp_add_atts_from_sections(composer, parent_section_name);
@@ -149,9 +544,9 @@ pathcomp_add_atts_from_sections(pathcomp_t *composer, char *section_name)
     list_t *psec;
     assert(composer);
     assert(section_name);
-    if (!config) return;
-    psec = config->sections;
-    while ((psec = list_find_first(psec, (list_traversal_t *) find_section_with_name, section_name))) {
+    if (!composer->ctx->config) return;
+    psec = cf_find_sections(composer->ctx->config, section_name);
+    while (psec) {
         cf_section_t *section = psec->el;
         pathcomp_add_atts_from_entries(composer, section->name, section->entries);
         psec = psec->next;
@@ -162,95 +557,346 @@ static void
 pathcomp_make_from_config(pathcomp_t *composer)
 {
     assert(composer);
+    pthread_rwlock_rdlock(&composer->ctx->config_lock);
     pathcomp_add_atts_from_sections(composer, composer->name);
+    pthread_rwlock_unlock(&composer->ctx->config_lock);
 }
 
 /* returns the number of elements pushed on the Lua stack */
 static int
-pathcomp_push_value(pathcomp_t *composer, const char *name)
+pathcomp_push_value(pathcomp_t *composer, const char *atom)
 {
     att_t *att;
+    pathcomp_frame_t frame;
+    int n;
     assert(composer);
-    assert(name);
-    att = pathcomp_retrieve_att(composer, name);
+    assert(atom);
+    att = hash_get(composer->index, atom);
     /* TODO here is an opportunity to emit an error when unknown attributes are
      * referenced */
     if (!att) return 0;
-    return att_push(att, composer, composer->metatable);
+    pathcomp_begin_eval(composer, att, &frame);
+    n = att_push(att, composer->ctx->interp, composer, composer->metatable);
+    pathcomp_end_eval(composer, &frame);
+    return n;
 }
 
+/*
+ * The __index metamethod of the composer objects seen from Lua; its upvalue is
+ * a table mapping attribute names to atoms, so that every name is interned
+ * only once per Lua state
+ */
 static int
 pathcomp_eval_callback(lua_State *L)
 {
     pathcomp_t *composer;
-    const char *name;
-    assert(lua_isuserdata(L, -2));
-    composer = *((pathcomp_t **) lua_touserdata(L, -2));
-    assert(lua_isstring(L, -1));
-    name = lua_tostring(L, -1);
-    return pathcomp_push_value(composer, name);
+    const char *atom;
+    assert(lua_isuserdata(L, 1));
+    composer = *((pathcomp_t **) lua_touserdata(L, 1));
+    assert(lua_isstring(L, 2));
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(1));
+    atom = lua_touserdata(L, -1);
+    lua_pop(L, 1);
+    if (!atom) {
+        atom = atom_string(lua_tostring(L, 2));
+        if (!atom) return luaL_error(L, "cannot intern attribute name");
+        lua_pushvalue(L, 2);
+        lua_pushlightuserdata(L, (void *) atom);
+        lua_rawset(L, lua_upvalueindex(1));
+    }
+    return pathcomp_push_value(composer, atom);
 }
 
-pathcomp_t *
-pathcomp_new(const char *name)
+/*
+ * Push the table used by pathcomp_eval_callback() to map attribute names to
+ * atoms; there is one such table per Lua state
+ */
+static void
+pathcomp_push_atoms(lua_State *L)
+{
+    const char *key = "libpathcomp::atoms";
+    lua_getfield(L, LUA_REGISTRYINDEX, key);
+    if (!lua_isnil(L, -1)) return;
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, key);
+}
+
+/*
+ * Make sure the metatable of \a composer exists in the interpreter state of the
+ * calling thread; the composer may have been created in another thread, or
+ * before the interpreter was cleaned up
+ */
+static void
+pathcomp_register_metatable(pathcomp_t *composer)
+{
+    lua_State     *L;
+    interpreter_t *interp;
+    assert(composer);
+    interp = composer->ctx->interp;
+    if (composer->generation && composer->generation == interpreter_get_generation(interp)) return;
+    L = interpreter_get_state(interp);
+    /* the metatable is the same for all composer objects of the class */
+    if (luaL_newmetatable(L, composer->metatable)) {
+        pathcomp_push_atoms(L);
+        lua_pushcclosure(L, pathcomp_eval_callback, 1);
+        lua_setfield(L, -2, "__index");
+    }
+    lua_pop(L, 1);
+    composer->generation = interpreter_get_generation(interp);
+}
+
+/*
+ * Push the userdata standing for \a composer in Lua code ('self'). It is made
+ * the first time Lua code of \a composer is called in an interpreter state,
+ * and kept in the registry until \a composer is freed, so that evaluation does
+ * not allocate. Only the state of the calling thread, in which the metatable
+ * has been registered, is remembered; a composer object that moves to another
+ * thread leaves its userdata behind until the old state is closed.
+ */
+static void
+pathcomp_push_self(lua_State *L, pathcomp_t *composer)
+{
+    pathcomp_t **p;
+    assert(composer);
+    assert(composer->generation);
+    if (composer->self != LUA_NOREF && composer->self_generation == composer->generation) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, composer->self);
+        return;
+    }
+    p = lua_newuserdata(L, sizeof *p);
+    *p = composer;
+    luaL_getmetatable(L, composer->metatable);
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    composer->self = luaL_ref(L, LUA_REGISTRYINDEX);
+    composer->self_generation = composer->generation;
+}
+
+/*
+ * Drop the reference to 'self' made by pathcomp_push_self(), if it was made in
+ * the state of the calling thread
+ */
+static void
+pathcomp_release_self(pathcomp_t *composer)
+{
+    interpreter_t *interp;
+    assert(composer);
+    if (composer->self == LUA_NOREF) return;
+    interp = composer->ctx->interp;
+    if (composer->self_generation == interpreter_get_generation(interp))
+        luaL_unref(interpreter_get_state(interp), LUA_REGISTRYINDEX, composer->self);
+    composer->self = LUA_NOREF;
+}
+
+static void
+pathcomp_init_atoms(void)
+{
+    atom_root = atom_string(PATHCOMP_ATT_ROOT);
+    atom_compose = atom_string(PATHCOMP_ATT_COMPOSE);
+}
+
+/*
+ * Allocate a composer object from a new arena, in which its attributes, and
+ * the values read from the configuration, will be allocated as well; \a
+ * parent is the arena of the original of a clone, if any
+ */
+static pathcomp_t *
+pathcomp_alloc(const char *name, size_t size, arena_t *parent)
 {
-    buf_t       buf;
-    lua_State  *L = interpreter_get_state();
     const char *metatable_prefix = "libpathcomp::";
+    arena_t    *arena;
+    pathcomp_t *composer;
+    if (!(arena = arena_new(size, parent))) return NULL;
+    composer = arena_alloc(arena, sizeof *composer);
+    if (!composer
+            || !(composer->name = arena_strdup(arena, name))
+            || !(composer->metatable = arena_alloc(arena, strlen(metatable_prefix) + strlen(name) + 1))) {
+        arena_release(arena);
+        return NULL;
+    }
+    composer->arena = arena;
+    strcpy(composer->metatable, metatable_prefix);
+    strcat(composer->metatable, name);
+    return composer;
+}
+
+/*
+ * Build a composer object of class \a name from the configuration, resolving
+ * the sections it copies from; Lua values that are constants are evaluated
+ * right away
+ */
+static pathcomp_t *
+pathcomp_build(pathcomp_ctx_t *ctx, const char *name)
+{
     pathcomp_t *composer = NULL;
+    int i;
+    assert(ctx);
     assert(name);
-    composer = malloc(sizeof *composer);
+    composer = pathcomp_alloc(name, PATHCOMP_ARENA_SIZE, NULL);
     if (!composer) return composer;
-    composer->name = strdup(name);
+    composer->ctx = ctx;
     composer->attributes = NULL;
+    composer->count = 0;
+    composer->alloc = 0;
+    composer->index = hash_new_identity(0);
+    composer->evaluating = NULL;
+    composer->is_volatile = 0;
+    composer->mark = 0;
+    composer->statbatch = NULL;
+    composer->statbatch_flags = 0;
+    memset(&composer->window, 0, sizeof composer->window);
+    composer->roots = NULL;
+    composer->scratch = NULL;
+    composer->scratch_size = 0;
     pathcomp_make_from_config(composer);
-    buf_init(&buf, 0);
-    buf_addstr(&buf, metatable_prefix);
-    buf_addstr(&buf, name);
-    composer->metatable = buf_detach(&buf, NULL);
-    luaL_newmetatable(L, composer->metatable);
-    lua_pushcfunction(L, pathcomp_eval_callback);
-    lua_setfield(L, -2, "__index");
-    lua_pop(L, 1);
+    for (i = 0; i < composer->count; i++) att_fold(composer->attributes[i], ctx->interp);
+    composer->generation = 0;
+    composer->self = LUA_NOREF;
+    composer->self_generation = 0;
     composer->done = 0;
     composer->started = 0;
     return composer;
 }
 
+/*
+ * Return the template of class \a name, building it the first time; to be
+ * called with classes_lock held for writing
+ */
+static pathcomp_t *
+pathcomp_ctx_build_class(pathcomp_ctx_t *ctx, const char *name)
+{
+    pathcomp_t *template;
+    if (ctx->classes && (template = hash_get(ctx->classes, name))) return template;
+    if (!ctx->classes && !(ctx->classes = hash_new(0))) return NULL;
+    if (!(template = pathcomp_build(ctx, name))) return NULL;
+    hash_put(ctx->classes, template->name, template);
+    if (hash_get(ctx->classes, template->name) != template) {
+        pathcomp_free(template);
+        return NULL;
+    }
+    return template;
+}
+
+/*
+ * The configuration of a class is resolved only once: the first composer
+ * object of the class is built from a template, which is kept until the
+ * configuration changes, and every composer object is a clone of the
+ * template. The template is never evaluated, and can be cloned by several
+ * threads at once.
+ */
+pathcomp_t *
+pathcomp_ctx_new_composer(pathcomp_ctx_t *ctx, const char *name)
+{
+    pathcomp_t *template, *composer = NULL;
+    assert(ctx);
+    assert(name);
+    pthread_rwlock_rdlock(&ctx->classes_lock);
+    if (ctx->classes && (template = hash_get(ctx->classes, name))) composer = pathcomp_clone(template);
+    pthread_rwlock_unlock(&ctx->classes_lock);
+    if (!composer) {
+        pthread_rwlock_wrlock(&ctx->classes_lock);
+        if ((template = pathcomp_ctx_build_class(ctx, name))) composer = pathcomp_clone(template);
+        pthread_rwlock_unlock(&ctx->classes_lock);
+    }
+    if (composer) pathcomp_register_metatable(composer);
+    return composer;
+}
+
+pathcomp_t *
+pathcomp_new(const char *name)
+{
+    return pathcomp_ctx_new_composer(pathcomp_get_default_ctx(), name);
+}
+
 pathcomp_t *
 pathcomp_clone(pathcomp_t *composer)
 {
     pathcomp_t *clone;
+    int i;
     assert(composer);
-    clone = malloc(sizeof *clone);
+    /* the clone shares values with the original, which may live in its arena */
+    clone = pathcomp_alloc(composer->name, sizeof *clone + 512 + PATHCOMP_ARENA_SIZE_PER_ATT * composer->count,
+            composer->arena);
     if (!clone) return clone;
-    clone->name = strdup(composer->name);
-    clone->attributes = list_transform(composer->attributes, (list_transform_t *) att_clone, NULL);
-    clone->metatable = strdup(composer->metatable);
+    clone->ctx = composer->ctx;
+    clone->attributes = NULL;
+    clone->count = 0;
+    clone->alloc = 0;
+    clone->index = hash_new_identity(composer->count);
+    /* handles remain valid for the clone, as the attributes keep their order */
+    for (i = 0; i < composer->count; i++)
+        pathcomp_append_att(clone, att_clone_in(clone->arena, composer->attributes[i]));
+    clone->generation = 0;
+    clone->self = LUA_NOREF;
+    clone->self_generation = 0;
     clone->done = composer->done;
     clone->started = composer->started;
+    clone->evaluating = NULL;
+    clone->is_volatile = 0;
+    clone->mark = 0;
+    clone->statbatch = NULL;
+    clone->statbatch_flags = 0;
+    memset(&clone->window, 0, sizeof clone->window);
+    clone->roots = NULL;
+    clone->scratch = NULL;
+    clone->scratch_size = 0;
+    /* the clone does not know the dependencies between its attributes yet */
+    pathcomp_invalidate(clone);
     return clone;
 }
 
 void
 pathcomp_free(pathcomp_t *composer)
 {
+    int i;
     if (!composer) return;
-    free(composer->name);
-    list_foreach(composer->attributes, (list_traversal_t *) att_free, NULL);
-    list_free(composer->attributes);
-    free(composer->metatable);
-    free(composer);
+    pathcomp_release_self(composer);
+    for (i = 0; i < composer->count; i++) att_free(composer->attributes[i]);
+    free(composer->attributes);
+    hash_free(composer->index);
+    statbatch_free(composer->statbatch);
+    pathcomp_forget_checks(composer);
+    free(composer->window.paths);
+    free(composer->window.exists);
+    free(composer->scratch);
+    /* the composer object itself lives in its arena */
+    arena_release(composer->arena);
+}
+
+static const char *
+pathcomp_eval_att(pathcomp_t *composer, att_t *att)
+{
+    pathcomp_frame_t frame;
+    const char *s;
+    assert(composer);
+    if (!att) return NULL;
+    pathcomp_register_metatable(composer);
+    pathcomp_begin_eval(composer, att, &frame);
+    s = att_eval(att, composer->ctx->interp, composer, composer->metatable);
+    pathcomp_end_eval(composer, &frame);
+    return s;
+}
+
+/*
+ * Look up an attribute referenced by a template; the counterpart of
+ * pathcomp_eval_callback() for values evaluated without Lua
+ */
+static const char *
+pathcomp_resolve(pathcomp_t *composer, const char *atom)
+{
+    assert(composer);
+    assert(atom);
+    return pathcomp_eval_att(composer, hash_get(composer->index, atom));
 }
 
 const char *
 pathcomp_eval_nocopy(pathcomp_t *composer, const char *name)
 {
-    att_t *att;
     assert(composer);
-    att = pathcomp_retrieve_att(composer, name);
-    if (!att) return NULL;
-    return att_eval(att, composer, composer->metatable);
+    return pathcomp_eval_att(composer, pathcomp_retrieve_att(composer, name));
 }
 
 char *
@@ -261,25 +907,134 @@ pathcomp_eval(pathcomp_t *composer, const char *name)
     return s ? strdup(s) : NULL;
 }
 
+/*
+ * Copy the \a n characters at \a src to \a dst at offset \a *pos, as far as
+ * they fit in \a cap characters, leaving room for a null character
+ */
+static void
+pathcomp_copy_part(char *dst, size_t cap, size_t *pos, const char *src, size_t n)
+{
+    if (*pos + 1 < cap) memcpy(dst + *pos, src, *pos + n + 1 <= cap ? n : cap - *pos - 1);
+    *pos += n;
+}
+
+/*
+ * Join \a root and \a compose into the pathname, writing at most \a cap
+ * characters, including the terminating null character, to \a dst; returns the
+ * size of the full pathname, including the null character, or 0 if the
+ * pathname is empty
+ */
+static size_t
+pathcomp_join(const char *root, const char *compose, char *dst, size_t cap)
+{
+    size_t pos = 0;
+    if (root && *root) {
+        pathcomp_copy_part(dst, cap, &pos, root, strlen(root));
+        pathcomp_copy_part(dst, cap, &pos, "/", 1);
+    }
+    if (compose && *compose) pathcomp_copy_part(dst, cap, &pos, compose, strlen(compose));
+    if (cap) dst[pos < cap ? pos : cap - 1] = '\0';
+    return pos ? pos + 1 : 0;
+}
+
+/*
+ * Evaluate the attributes making up the pathname; the results point to
+ * internal storage
+ */
+static void
+pathcomp_eval_path(pathcomp_t *composer, const char **root, const char **compose)
+{
+    pthread_once(&atoms_once, pathcomp_init_atoms);
+    *root = pathcomp_eval_att(composer, hash_get(composer->index, atom_root));
+    *compose = pathcomp_eval_att(composer, hash_get(composer->index, atom_compose));
+}
+
 char *
 pathcomp_yield(pathcomp_t *composer)
 {
-    buf_t path;
     const char *root, *compose;
+    char *path;
+    size_t size;
     assert(composer);
-    buf_init(&path, 0);
-    root = pathcomp_eval_nocopy(composer, PATHCOMP_ATT_ROOT);
-    compose = pathcomp_eval_nocopy(composer, PATHCOMP_ATT_COMPOSE);
-    if (root && strlen(root)) {
-        buf_addstr(&path, root);
-        buf_addch(&path, '/');
+    pathcomp_eval_path(composer, &root, &compose);
+    size = pathcomp_join(root, compose, NULL, 0);
+    if (!size || !(path = malloc(size))) return NULL;
+    pathcomp_join(root, compose, path, size);
+    return path;
+}
+
+/*
+ * Copy \a s to \a dst, snprintf()-style, for the functions ending in
+ * <tt>_into</tt>; \a size is the size of \a s including the null character,
+ * or 0 if there is no value
+ */
+static int
+pathcomp_into(size_t size, char *dst, size_t cap, size_t *needed)
+{
+    if (needed) *needed = size;
+    if (!size) {
+        if (cap) *dst = '\0';
+        errno = ENOENT;
+        return -1;
     }
-    if (compose && strlen(compose)) {
-        buf_addstr(&path, compose);
+    if (size > cap) {
+        errno = ERANGE;
+        return -1;
     }
-    if (path.len) return buf_detach(&path, NULL);
-    buf_release(&path);
-    return NULL;
+    return 0;
+}
+
+/*
+ * Compose the pathname in a buffer owned by the composer object, avoiding an
+ * allocation for every combination; returns null if there is no pathname
+ */
+static const char *
+pathcomp_yield_scratch(pathcomp_t *composer)
+{
+    const char *root, *compose;
+    size_t size;
+    pathcomp_eval_path(composer, &root, &compose);
+    size = pathcomp_join(root, compose, composer->scratch, composer->scratch_size);
+    if (!size) return NULL;
+    if (size > composer->scratch_size) {
+        char *scratch = realloc(composer->scratch, size);
+        if (!scratch) return NULL;
+        composer->scratch = scratch;
+        composer->scratch_size = size;
+        pathcomp_join(root, compose, composer->scratch, composer->scratch_size);
+    }
+    return composer->scratch;
+}
+
+int
+pathcomp_yield_into(pathcomp_t *composer, char *dst, size_t cap, size_t *needed)
+{
+    const char *root, *compose;
+    assert(composer);
+    assert(dst || !cap);
+    pathcomp_eval_path(composer, &root, &compose);
+    return pathcomp_into(pathcomp_join(root, compose, dst, cap), dst, cap, needed);
+}
+
+/* Copy the value of \a att, as far as it fits */
+static int
+pathcomp_eval_att_into(pathcomp_t *composer, att_t *att, char *dst, size_t cap, size_t *needed)
+{
+    const char *s;
+    size_t pos = 0;
+    assert(dst || !cap);
+    s = pathcomp_eval_att(composer, att);
+    if (!s) return pathcomp_into(0, dst, cap, needed);
+    pathcomp_copy_part(dst, cap, &pos, s, strlen(s));
+    if (cap) dst[pos < cap ? pos : cap - 1] = '\0';
+    return pathcomp_into(pos + 1, dst, cap, needed);
+}
+
+int
+pathcomp_eval_into(pathcomp_t *composer, const char *name, char *dst, size_t cap, size_t *needed)
+{
+    assert(composer);
+    return pathcomp_eval_att_into(composer, pathcomp_retrieve_att(composer, name), dst, cap, needed);
 }
 
 void
@@ -316,12 +1071,75 @@ pathcomp_add_int(pathcomp_t *composer, const char *name, int value)
     pathcomp_add_or_replace(composer, name, value_new_int(value), PATHCOMP_ORIGIN_RUNTIME, PATHCOMP_ACTION_ADD);
 }
 
+pathcomp_handle_t
+pathcomp_lookup(pathcomp_t *composer, const char *name)
+{
+    att_t *att;
+    pathcomp_handle_t handle;
+    assert(composer);
+    assert(name);
+    att = pathcomp_retrieve_att(composer, name);
+    if (!att) {
+        /* create an attribute without value, to be set through the handle */
+        att = att_new_in(composer->arena, name, NULL, PATHCOMP_ORIGIN_RUNTIME);
+        handle = pathcomp_append_att(composer, att);
+        if (handle < 0) att_free(att);
+        return handle;
+    }
+    /* not on the hot path: handles are meant to be looked up only once */
+    for (handle = 0; composer->attributes[handle] != att; handle++)
+        assert(handle < composer->count);
+    return handle;
+}
+
+const char *
+pathcomp_eval_nocopy_h(pathcomp_t *composer, pathcomp_handle_t handle)
+{
+    assert(composer);
+    return pathcomp_eval_att(composer, pathcomp_get_att(composer, handle));
+}
+
+char *
+pathcomp_eval_h(pathcomp_t *composer, pathcomp_handle_t handle)
+{
+    const char *s;
+    s = pathcomp_eval_nocopy_h(composer, handle);
+    return s ? strdup(s) : NULL;
+}
+
+int
+pathcomp_eval_into_h(pathcomp_t *composer, pathcomp_handle_t handle, char *dst, size_t cap, size_t *needed)
+{
+    assert(composer);
+    return pathcomp_eval_att_into(composer, pathcomp_get_att(composer, handle), dst, cap, needed);
+}
+
+void
+pathcomp_set_h(pathcomp_t *composer, pathcomp_handle_t handle, const char *value)
+{
+    att_t *att;
+    assert(composer);
+    assert(value);
+    if (!(att = pathcomp_get_att(composer, handle))) return;
+    pathcomp_apply(composer, att, value_new_auto(value), PATHCOMP_ORIGIN_RUNTIME, PATHCOMP_ACTION_REPLACE);
+}
+
+void
+pathcomp_set_int_h(pathcomp_t *composer, pathcomp_handle_t handle, int value)
+{
+    att_t *att;
+    assert(composer);
+    if (!(att = pathcomp_get_att(composer, handle))) return;
+    pathcomp_apply(composer, att, value_new_int(value), PATHCOMP_ORIGIN_RUNTIME, PATHCOMP_ACTION_REPLACE);
+}
+
 void
 pathcomp_rewind(pathcomp_t *composer)
 {
-    list_t *p;
+    int i;
     assert(composer);
-    for (p = composer->attributes; p; p = p->next) att_rewind(p->el);
+    for (i = 0; i < composer->count; i++) att_rewind(composer->attributes[i]);
+    pathcomp_invalidate(composer);
     composer->done = 0;
     composer->started = 0;
 }
@@ -336,47 +1154,400 @@ pathcomp_done(pathcomp_t *composer)
 int
 pathcomp_next(pathcomp_t *composer)
 {
-    list_t *p;
+    int i;
+    unsigned long mark = 0;
     assert(composer);
     if (composer->done) return 0;
-    for (p = composer->attributes; p; p = p->next) {
-        if (att_next(p->el)) return 1;
+    for (i = 0; i < composer->count; i++) {
+        att_t *att = composer->attributes[i];
+        int advanced = att_next(att);
         /* alternative has wrapped around: rewind and cycle next attribute */
-        att_rewind(p->el);
+        if (!advanced) att_rewind(att);
+        /* only the attributes whose value changed, and their dependents, need
+         * to be reevaluated */
+        if (advanced || att_count(att) > 1) mark = pathcomp_invalidate_att(composer, att, mark);
+        if (advanced) return 1;
     }
     composer->done = 1;
     return 0;
 }
 
-static int
-path_exists(const char *path)
+/*
+ * Combinations are numbered in the order in which pathcomp_next() visits them:
+ * the index is a mixed-radix number, of which the attributes are the digits,
+ * the first attribute being the least significant digit. Attributes with fewer
+ * than two alternatives do not contribute a digit.
+ */
+size_t
+pathcomp_count(pathcomp_t *composer)
 {
-    struct stat statbuf;
-    assert(path);
-    return stat(path, &statbuf) == 0;
+    size_t n = 1;
+    int i;
+    assert(composer);
+    for (i = 0; i < composer->count; i++) {
+        size_t k = att_count(composer->attributes[i]);
+        if (k < 2) continue;
+        if (n > SIZE_MAX / k) return SIZE_MAX;
+        n *= k;
+    }
+    return n;
 }
 
-char *
-pathcomp_find(pathcomp_t *composer)
+size_t
+pathcomp_tell(pathcomp_t *composer)
 {
-    char *path;
+    size_t index = 0, radix = 1;
+    int i;
     assert(composer);
+    if (composer->done) return pathcomp_count(composer);
+    for (i = 0; i < composer->count; i++) {
+        att_t *att = composer->attributes[i];
+        size_t k = att_count(att);
+        if (k < 2) continue;
+        index += att_tell(att) * radix;
+        radix *= k;
+    }
+    return index;
+}
+
+int
+pathcomp_seek(pathcomp_t *composer, size_t index)
+{
+    unsigned long mark = 0;
+    int i;
+    assert(composer);
+    if (index >= pathcomp_count(composer)) return -1;
+    for (i = 0; i < composer->count; i++) {
+        att_t *att = composer->attributes[i];
+        size_t k = att_count(att);
+        int pos;
+        if (k < 2) continue;
+        pos = index % k;
+        index /= k;
+        if (att_tell(att) == pos) continue;
+        att_seek(att, pos);
+        mark = pathcomp_invalidate_att(composer, att, mark);
+    }
+    composer->done = 0;
+    composer->started = 0;
+    return 0;
+}
+
+int
+pathcomp_exists(pathcomp_t *composer, const char *path)
+{
+    assert(composer);
+    assert(path);
+    return dircache_exists(composer->ctx->dircache, path);
+}
+
+/*
+ * Make the combination with index \a index current, or finish the iteration if
+ * \a index equals pathcomp_count(), as if pathcomp_find() had visited all
+ * combinations before it
+ */
+static void
+pathcomp_advance_to(pathcomp_t *composer, size_t index)
+{
+    if (pathcomp_seek(composer, index) != 0) {
+        assert(index > 0);
+        pathcomp_seek(composer, index - 1);
+        pathcomp_next(composer);
+    }
+    composer->started = 1;
+}
+
+/* values in pathcomp_t.roots */
+static int root_present, root_absent;
+
+/*
+ * Return whether the root directory of the current combination is known not
+ * to exist, checking it on first sight
+ */
+static int
+pathcomp_root_missing(pathcomp_t *composer, att_t *att)
+{
+    const char *root;
+    char *key;
+    int *known, was_volatile, is_volatile;
+    /* a root that may change on every evaluation cannot be checked in advance */
+    was_volatile = composer->is_volatile;
+    composer->is_volatile = 0;
+    root = pathcomp_eval_att(composer, att);
+    is_volatile = composer->is_volatile;
+    composer->is_volatile = was_volatile || is_volatile;
+    if (!root || !*root || is_volatile) return 0;
+    if (composer->roots && (known = hash_get(composer->roots, root))) return known == &root_absent;
+    known = pathcomp_exists(composer, root) ? &root_present : &root_absent;
+    if (!composer->roots && !(composer->roots = hash_new(0))) return known == &root_absent;
+    if ((key = strdup(root))) hash_put(composer->roots, key, known);
+    return known == &root_absent;
+}
+
+/*
+ * Return the number of consecutive combinations, in the order of
+ * pathcomp_next(), that share the value of \a att: the product of the number
+ * of alternatives of the attributes that vary faster than any attribute that
+ * \a att depends on (or \a att itself)
+ */
+static size_t
+pathcomp_block_size(pathcomp_t *composer, att_t *att)
+{
+    size_t block = 1;
+    int i;
+    for (i = 0; i < composer->count; i++) {
+        att_t *digit = composer->attributes[i];
+        size_t k = att_count(digit);
+        if (k < 2) continue;
+        if (digit == att || att_has_dependent(digit, att, ++composer->mark)) break;
+        block *= k;
+    }
+    return block;
+}
+
+/*
+ * If the root directory of the current combination does not exist, skip all
+ * following combinations sharing the same root directory, and return true;
+ * the composer object is then left at a combination that has not been checked
+ * yet, or done
+ */
+static int
+pathcomp_prune(pathcomp_t *composer)
+{
+    att_t *att;
+    size_t block;
+    pthread_once(&atoms_once, pathcomp_init_atoms);
+    att = hash_get(composer->index, atom_root);
+    if (!att || !pathcomp_root_missing(composer, att)) return 0;
+    block = pathcomp_block_size(composer, att);
+    pathcomp_advance_to(composer, (pathcomp_tell(composer) / block + 1) * block);
+    return 1;
+}
+
+/*
+ * Check whether the pathnames of the next \a size combinations, starting at
+ * the current one, exist in one batch, with \a flags for statbatch_new(); this
+ * leaves the composer object past the last combination checked
+ */
+static int
+pathcomp_fill_window(pathcomp_t *composer, size_t size, int flags)
+{
+    pathcomp_window_t *win = &composer->window;
+    pathcomp_clear_window(composer);
+    if (win->alloc < size) {
+        char **paths = realloc(win->paths, size * sizeof *paths);
+        int *exists;
+        if (!paths) return -1;
+        win->paths = paths;
+        exists = realloc(win->exists, size * sizeof *exists);
+        if (!exists) return -1;
+        win->exists = exists;
+        win->alloc = size;
+    }
+    /* the backend is chosen when the batch is created */
+    if (composer->statbatch && composer->statbatch_flags != flags) {
+        statbatch_free(composer->statbatch);
+        composer->statbatch = NULL;
+    }
+    if (!composer->statbatch) {
+        if (!(composer->statbatch = statbatch_new(size, flags))) return -1;
+        composer->statbatch_flags = flags;
+    }
+    win->start = pathcomp_tell(composer);
+    while (win->count < size && !pathcomp_done(composer)) {
+        /* end the window at a missing root directory, to be pruned */
+        if (win->count > 0 && composer->roots) {
+            att_t *att = hash_get(composer->index, atom_root);
+            if (att && pathcomp_root_missing(composer, att)) break;
+        }
+        win->paths[win->count++] = pathcomp_yield(composer);
+        pathcomp_next(composer);
+    }
+    statbatch_exists(composer->statbatch, (const char **) win->paths, win->count, win->exists);
+    return 0;
+}
+
+/*
+ * Like pathcomp_find(), but check whether the pathnames of \a size
+ * combinations exist in one batch, and store the first existing pathname in
+ * \a found
+ *
+ * The results of a batch are reused by subsequent calls, until the window of
+ * combinations has been exhausted, or the composer object is modified. Returns
+ * -1 if batching cannot be used.
+ */
+static int
+pathcomp_find_batch(pathcomp_t *composer, size_t size, int flags, const char **found)
+{
+    pathcomp_window_t *win = &composer->window;
+    size_t index;
+    if (pathcomp_count(composer) == SIZE_MAX) return -1;
+    *found = NULL;
+    if (composer->started) pathcomp_next(composer);
+    composer->started = 1;
+    while (!pathcomp_done(composer)) {
+        index = pathcomp_tell(composer);
+        if (index < win->start || index >= win->start + win->count) {
+            if (pathcomp_prune(composer)) continue;
+            if (pathcomp_fill_window(composer, size, flags) != 0) {
+                /* the current combination has not been checked yet */
+                pathcomp_clear_window(composer);
+                composer->started = 0;
+                return -1;
+            }
+        }
+        /* the earliest combination wins, as in the serial search */
+        for (; index < win->start + win->count; index++) {
+            if (!win->exists[index - win->start]) continue;
+            pathcomp_advance_to(composer, index);
+            *found = win->paths[index - win->start];
+            return 0;
+        }
+        /* no match in the rest of the window: continue after it */
+        if (pathcomp_tell(composer) != index) pathcomp_advance_to(composer, index);
+    }
+    return 0;
+}
+
+/*
+ * Like pathcomp_find(), but return a pointer to internal storage, which remains
+ * valid until the next call
+ */
+static const char *
+pathcomp_find_nocopy(pathcomp_t *composer)
+{
+    const char *path;
+    size_t window;
+    int prune, flags;
+    /* batching is pointless when existence is answered from memory */
+    window = pathcomp_ctx_get_find_batch(composer->ctx, &flags);
+    if (window > 1 && !dircache_enabled(composer->ctx->dircache)
+            && pathcomp_find_batch(composer, window, flags, &path) == 0)
+        return path;
+    /* pruning needs the index of the combination */
+    prune = pathcomp_count(composer) != SIZE_MAX;
     for (;;) {
         if (composer->started) pathcomp_next(composer);
         composer->started = 1;
         if (pathcomp_done(composer)) break;
-        path = pathcomp_yield(composer);
-        if (path && path_exists(path)) return path;
-        free(path);
+        if (prune && pathcomp_prune(composer)) {
+            /* the current combination has not been checked yet */
+            composer->started = 0;
+            continue;
+        }
+        path = pathcomp_yield_scratch(composer);
+        if (path && pathcomp_exists(composer, path)) return path;
     }
     return NULL;
 }
 
+char *
+pathcomp_find(pathcomp_t *composer)
+{
+    const char *path;
+    assert(composer);
+    path = pathcomp_find_nocopy(composer);
+    return path ? strdup(path) : NULL;
+}
+
+int
+pathcomp_foreach(pathcomp_t *composer, int flags, pathcomp_callback_t *callback, void *userdata)
+{
+    const char *path;
+    size_t index = 0;
+    int rc;
+    assert(composer);
+    assert(callback);
+    pathcomp_rewind(composer);
+    if (flags & PATHCOMP_EXISTING) {
+        while ((path = pathcomp_find_nocopy(composer))) {
+            if ((rc = callback(path, pathcomp_tell(composer), userdata))) return rc;
+        }
+        return 0;
+    }
+    for (; !pathcomp_done(composer); pathcomp_next(composer), index++) {
+        if (!(path = pathcomp_yield_scratch(composer))) continue;
+        if ((rc = callback(path, index, userdata))) return rc;
+    }
+    return 0;
+}
+
+/* state of pathcomp_yield_all() while collecting pathnames */
+typedef struct {
+    buf_t pool;
+    size_t count, alloc;
+    size_t *entries; /* pairs of offset and index */
+} pathcomp_collect_t;
+
+static int
+pathcomp_collect(const char *path, size_t index, pathcomp_collect_t *collect)
+{
+    if (collect->count == collect->alloc) {
+        size_t alloc = collect->alloc ? 2 * collect->alloc : 64;
+        size_t *entries = realloc(collect->entries, 2 * alloc * sizeof *entries);
+        if (!entries) return -1;
+        collect->entries = entries;
+        collect->alloc = alloc;
+    }
+    collect->entries[2 * collect->count] = collect->pool.len;
+    collect->entries[2 * collect->count + 1] = index;
+    collect->count++;
+    /* include the terminating null character */
+    buf_add(&collect->pool, path, strlen(path) + 1);
+    return 0;
+}
+
+int
+pathcomp_yield_all(pathcomp_t *composer, pathcomp_pathset_t **out)
+{
+    pathcomp_collect_t collect = { .count = 0, .alloc = 0, .entries = NULL };
+    pathcomp_pathset_t *set;
+    size_t i;
+    char *block;
+    assert(composer);
+    assert(out);
+    *out = NULL;
+    buf_init(&collect.pool, 0);
+    if (pathcomp_foreach(composer, 0, (pathcomp_callback_t *) pathcomp_collect, &collect)) {
+        set = NULL;
+        goto out;
+    }
+    /* struct, offsets, indices and pool in a single block, so that the
+     * pathname set can be freed in one go */
+    block = malloc(sizeof *set + 2 * collect.count * sizeof(size_t) + collect.pool.len);
+    if (!(set = (pathcomp_pathset_t *) block)) goto out;
+    set->count = collect.count;
+    set->offsets = (size_t *) (block + sizeof *set);
+    set->indices = set->offsets + collect.count;
+    set->pool = (char *) (set->indices + collect.count);
+    set->size = collect.pool.len;
+    for (i = 0; i < collect.count; i++) {
+        set->offsets[i] = collect.entries[2 * i];
+        set->indices[i] = collect.entries[2 * i + 1];
+    }
+    if (collect.pool.len) memcpy(set->pool, collect.pool.buf, collect.pool.len);
+out:
+    buf_release(&collect.pool);
+    free(collect.entries);
+    if (!set) {
+        errno = ENOMEM;
+        return -1;
+    }
+    *out = set;
+    return 0;
+}
+
+void
+pathcomp_pathset_free(pathcomp_pathset_t *set)
+{
+    free(set);
+}
+
 int
 pathcomp_mkdir(pathcomp_t *composer)
 {
     char *path, *p;
-    int rc = 0;
+    int rc = 0, made = 0;
     assert(composer);
     path = pathcomp_yield(composer);
     p = path;
@@ -393,9 +1564,12 @@ pathcomp_mkdir(pathcomp_t *composer)
                 break;
             }
         }
+        else made = 1;
         *p++ = '/';
     }
     free(path);
+    /* the cached directory listings are out of date */
+    if (made) dircache_invalidate(composer->ctx->dircache);
     return rc;
 }
 
@@ -403,6 +1577,7 @@ char *
 pathcomp_dump(pathcomp_t *composer)
 {
     buf_t buf;
+    int i;
     buf_init(&buf, 0);
     buf_addf(&buf, "composer object at 0x%x\n", composer);
     buf_addf(&buf, "  class: %s\n", composer->name);
@@ -410,6 +1585,6 @@ pathcomp_dump(pathcomp_t *composer)
     buf_addf(&buf, "  done: %d\n", composer->done);
     buf_addf(&buf, "  started: %d\n", composer->started);
     buf_addf(&buf, "  attributes:\n");
-    list_foreach(composer->attributes, (list_traversal_t *) att_dump, &buf);
+    for (i = 0; i < composer->count; i++) att_dump(composer->attributes[i], &buf);
     return buf_detach(&buf, NULL);
 }
@@ -32,16 +32,18 @@ static void
 print_usage(void)
 {
     puts("Usage\n"
-         "    pathcomp -c class [ -f config -aehm -x att ] key=value key=value key+=value ...\n"
+         "    pathcomp -c class [ -f config -j threads -0aehm -x att ] key=value key=value key+=value ...\n"
          "\n"
          "Mandatory command-line arguments\n"
          "    -c class: use this locator class\n"
          "\n"
          "Options\n"
+         "    -0: terminate output with null characters instead of newlines\n"
          "    -a: print all pathnames (default: print first)\n"
          "    -e: print only existing pathnames (default: print any pathname)\n"
          "    -f config: use config file 'config' (default: .pathcomprc)\n"
          "    -h: display this information\n"
+         "    -j threads: with -a and -e, search using this many threads (default: 1)\n"
          "    -m: create parent directory recursively\n"
          "    -x att: evaluate and print attribute 'att' instead of pathname\n"
          "\n"
@@ -64,6 +66,8 @@ typedef struct {
     char *config_file;
     int do_mkdir;
     char *eval_att;
+    int jobs;
+    int null_terminate;
 } opt_t;
 
 static kv_t *
@@ -75,8 +79,17 @@ kv_new(const char *text)
     assert(text);
     kv = malloc(sizeof *kv);
     if (!kv) return kv;
-    assert(key = strdup(text));
-    assert(val = strchr(key, '='));
+    key = strdup(text);
+    if (!key) {
+        free(kv);
+        return NULL;
+    }
+    if (!(val = strchr(key, '='))) {
+        pathcomp_log_error("attribute must be specified as key=value: %s", text);
+        free(key);
+        free(kv);
+        return NULL;
+    }
     *val++ = '\0';
     if (strlen(key) < 1) {
         pathcomp_log_error("empty key specified on command line");
@@ -129,9 +142,15 @@ opt_new(int argc, char **argv)
     options->config_file = strdup(".pathcomprc");
     options->do_mkdir = 0;
     options->eval_att = NULL;
+    options->jobs = 1;
+    options->null_terminate = 0;
     opterr = 0; /* prevent getopt() from printing error messages */
-    while ((opt = getopt(argc, argv, ":ac:ef:hmx:")) != -1) {
+    while ((opt = getopt(argc, argv, ":0ac:ef:hj:mx:")) != -1) {
         switch (opt) {
+            case '0':
+                options->null_terminate = 1;
+                break;
+
             case 'a':
                 options->print_all = 1;
                 break;
@@ -154,6 +173,14 @@ opt_new(int argc, char **argv)
                 exit(EXIT_SUCCESS);
                 break;
 
+            case 'j':
+                options->jobs = atoi(optarg);
+                if (options->jobs < 1) {
+                    pathcomp_log_error("invalid number of threads '%s'", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'm':
                 options->do_mkdir = 1;
                 break;
@@ -183,7 +210,7 @@ opt_new(int argc, char **argv)
     }
     while (optind < argc) {
         kv_t *kv;
-        assert(kv = kv_new(argv[optind++]));
+        if (!(kv = kv_new(argv[optind++]))) exit(EXIT_FAILURE);
         options->attributes = list_push(options->attributes, kv);
     }
     return options;
@@ -201,41 +228,129 @@ opt_free(opt_t *options)
     free(options);
 }
 
+typedef struct {
+    pathcomp_t *composer;
+    opt_t *options;
+} found_t;
+
+static void
+print_line(opt_t *options, const char *line)
+{
+    if (options->null_terminate) {
+        fputs(line, stdout);
+        putchar('\0');
+    }
+    else puts(line);
+}
+
+/* process a pathname produced by the current combination of alternatives */
+static void
+process(pathcomp_t *composer, opt_t *options, const char *path)
+{
+    char *att;
+    if (options->do_mkdir) {
+        if (pathcomp_mkdir(composer) == -1) {
+            pathcomp_log_error("cannot create directory: %s", strerror(errno));
+        }
+    }
+    if (options->eval_att) {
+        if ((att = pathcomp_eval(composer, options->eval_att))) {
+            print_line(options, att);
+            free(att);
+        }
+    }
+    else print_line(options, path);
+}
+
+static int
+process_found(const char *path, size_t index, found_t *found)
+{
+    /* only need the composer object to be at the combination that was found
+     * if it is going to be examined */
+    if (found->options->do_mkdir || found->options->eval_att) pathcomp_seek(found->composer, index);
+    process(found->composer, found->options, path);
+    return 0;
+}
+
+static void
+print_parallel(pathcomp_t *composer, opt_t *options)
+{
+    found_t found = { composer, options };
+    if (pathcomp_find_all_parallel(composer, options->jobs, 0,
+                (pathcomp_callback_t *) process_found, &found) == -1) {
+        pathcomp_log_error("cannot search in parallel: %s", strerror(errno));
+    }
+}
+
+/* the composer object is at the combination visited already */
+static int
+process_visited(const char *path, size_t index, found_t *found)
+{
+    (void) index;
+    process(found->composer, found->options, path);
+    return 0;
+}
+
+static void
+print_all(pathcomp_t *composer, opt_t *options)
+{
+    found_t found = { composer, options };
+    pathcomp_foreach(composer, options->only_existing ? PATHCOMP_EXISTING : 0,
+            (pathcomp_callback_t *) process_visited, &found);
+}
+
+/* with -0, the pool of pathnames can be written out as is */
+static void
+print_pool(pathcomp_t *composer)
+{
+    pathcomp_pathset_t *set;
+    size_t done = 0;
+    ssize_t n;
+    if (pathcomp_yield_all(composer, &set) == -1) {
+        pathcomp_log_error("cannot produce pathnames: %s", strerror(errno));
+        return;
+    }
+    while (done < set->size) {
+        if ((n = write(STDOUT_FILENO, set->pool + done, set->size - done)) == -1) {
+            if (errno == EINTR) continue;
+            pathcomp_log_error("cannot write pathnames: %s", strerror(errno));
+            break;
+        }
+        done += n;
+    }
+    pathcomp_pathset_free(set);
+}
+
+static void
+print_first(pathcomp_t *composer, opt_t *options)
+{
+    char *path;
+    if (options->only_existing) path = pathcomp_find(composer);
+    else path = pathcomp_yield(composer);
+    if (path) {
+        process(composer, options, path);
+        free(path);
+    }
+}
+
 int
 main(int argc, char **argv)
 {
     opt_t *options;
-    char *path, *att;
     pathcomp_t *composer;
 
     options = opt_new(argc, argv);
     pathcomp_add_config_from_file(options->config_file);
-    assert(composer = pathcomp_new(options->class));
-    list_foreach(options->attributes, (list_traversal_t *) kv_add_to_composer, composer);
-    for (;;) {
-        if (pathcomp_done(composer)) break;
-        if (options->only_existing) path = pathcomp_find(composer);
-        else path = pathcomp_yield(composer);
-        if (path) {
-            if (options->do_mkdir) {
-                if (pathcomp_mkdir(composer) == -1) {
-                    pathcomp_log_error("cannot create directory: %s", strerror(errno));
-                }
-            }
-            if (options->eval_att) {
-                if ((att = pathcomp_eval(composer, options->eval_att))) {
-                    puts(att);
-                    free(att);
-                }
-            }
-            else puts(path);
-            free(path);
-        }
-        if (!options->print_all) break;
-        /* pathcomp_find() automatically advances to the next alternative when
-         * called repeatedly */
-        if (!options->only_existing) pathcomp_next(composer);
+    if (!(composer = pathcomp_new(options->class))) {
+        pathcomp_log_error("cannot create composer object of class %s", options->class);
+        return EXIT_FAILURE;
     }
+    list_foreach(options->attributes, (list_traversal_t *) kv_add_to_composer, composer);
+    if (options->print_all && options->only_existing && options->jobs > 1) print_parallel(composer, options);
+    else if (options->print_all && options->null_terminate && !options->only_existing
+            && !options->do_mkdir && !options->eval_att) print_pool(composer);
+    else if (options->print_all) print_all(composer, options);
+    else print_first(composer, options);
     pathcomp_free(composer);
     pathcomp_cleanup();
     opt_free(options);
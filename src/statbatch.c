@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Existence checks for a batch of pathnames. A pool of threads calls stat()
+ * concurrently. On Linux, the statx() calls may instead be submitted together
+ * to an io_uring (flag STATBATCH_USE_URING), so that the kernel can overlap
+ * them, with a single system call to submit and wait for the whole batch;
+ * where io_uring is not available, or not allowed, the thread pool is used.
+ * The io_uring is not the default, as it has not been found to be faster than
+ * the thread pool, or than plain stat(), on a local file system.
+ *
+ * liburing is not required: the ring is set up with the raw system calls.
+ */
+
+/* for struct statx */
+#define _GNU_SOURCE
+#include <config.h>
+#include "statbatch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup) && defined(STATX_TYPE)
+#define STATBATCH_URING
+#endif
+
+/* maximum number of threads in the pool */
+#define STATBATCH_THREADS 8
+
+#ifdef STATBATCH_URING
+typedef struct {
+    int                  fd;
+    unsigned             entries;
+    void                *sq_ptr, *cq_ptr;
+    size_t               sq_size, cq_size;
+    struct io_uring_sqe *sqes;
+    size_t               sqes_size;
+    unsigned            *sq_tail, *sq_mask, *sq_array;
+    unsigned            *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    struct statx        *bufs;     /* one per request in flight */
+    size_t              *owner;    /* index of the pathname using a buffer */
+    unsigned            *free;     /* stack of unused buffers */
+    unsigned             nfree;
+    int                  busy;     /* requests may still be in flight */
+} statbatch_uring_t;
+#endif
+
+struct statbatch_t {
+    unsigned           depth;
+#ifdef STATBATCH_URING
+    statbatch_uring_t *ring;       /* null if io_uring is not used */
+#endif
+    /* thread pool; started on first use */
+    pthread_t          threads[STATBATCH_THREADS];
+    int                nthreads;
+    pthread_mutex_t    mutex;
+    pthread_cond_t     work, done;
+    const char       **paths;
+    int               *exists;
+    size_t             n, next, pending;
+    int                quit;
+};
+
+#ifdef STATBATCH_URING
+static void
+statbatch_uring_free(statbatch_uring_t *ring)
+{
+    if (!ring) return;
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+    if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_size);
+    if (ring->fd >= 0) close(ring->fd);
+    /* the kernel may still write to the buffers of requests in flight */
+    if (!ring->busy) free(ring->bufs);
+    free(ring->owner);
+    free(ring->free);
+    free(ring);
+}
+
+static statbatch_uring_t *
+statbatch_uring_new(unsigned entries)
+{
+    statbatch_uring_t *ring;
+    struct io_uring_params p;
+    char *sq, *cq;
+    unsigned i;
+    ring = calloc(1, sizeof *ring);
+    if (!ring) return ring;
+    memset(&p, 0, sizeof p);
+    ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) goto fail;
+    ring->entries = p.sq_entries;
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) ring->sq_size = ring->cq_size;
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) ring->cq_ptr = ring->sq_ptr;
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring->cq_ptr = NULL;
+            goto fail;
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+    sq = ring->sq_ptr;
+    cq = ring->cq_ptr;
+    ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+    ring->bufs = malloc(ring->entries * sizeof *ring->bufs);
+    ring->owner = malloc(ring->entries * sizeof *ring->owner);
+    ring->free = malloc(ring->entries * sizeof *ring->free);
+    if (!ring->bufs || !ring->owner || !ring->free) goto fail;
+    for (i = 0; i < ring->entries; i++) ring->free[i] = i;
+    ring->nfree = ring->entries;
+    return ring;
+fail:
+    statbatch_uring_free(ring);
+    return NULL;
+}
+
+/*
+ * Reap completions until none of the \a inflight requests are left, of which
+ * \a unconsumed have not been submitted yet. If the ring fails before that,
+ * the ring is marked busy, so that its buffers are never freed.
+ */
+static void
+statbatch_uring_drain(statbatch_uring_t *ring, size_t inflight, unsigned unconsumed)
+{
+    int rc;
+    while (inflight > 0) {
+        unsigned head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            ++head;
+            --inflight;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        if (!inflight) break;
+        do {
+            rc = syscall(__NR_io_uring_enter, ring->fd, unconsumed, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (rc < 0 && (errno == EINTR || errno == EAGAIN || errno == EBUSY));
+        if (rc < 0) {
+            ring->busy = 1;
+            return;
+        }
+        unconsumed -= rc;
+    }
+}
+
+/*
+ * Returns -1 if the io_uring cannot be used, e.g., because the kernel does not
+ * support statx() requests. No requests are in flight on return, unless the
+ * ring has been marked busy.
+ */
+static int
+statbatch_uring_exists(statbatch_uring_t *ring, const char **paths, size_t n, int *exists)
+{
+    size_t submitted = 0, completed = 0;
+    unsigned unconsumed = 0;
+    int rc = 0;
+    while (completed < n) {
+        unsigned tail = *ring->sq_tail, head;
+        /* queue requests while there are free buffers */
+        while (submitted < n && ring->nfree > 0) {
+            unsigned idx = tail & *ring->sq_mask, slot = ring->free[--ring->nfree];
+            struct io_uring_sqe *sqe = &ring->sqes[idx];
+            memset(sqe, 0, sizeof *sqe);
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long) (paths[submitted] ? paths[submitted] : "");
+            sqe->len = STATX_TYPE;
+            sqe->off = (unsigned long) &ring->bufs[slot];
+            sqe->user_data = slot;
+            ring->owner[slot] = submitted++;
+            ring->sq_array[idx] = idx;
+            ++tail;
+            ++unconsumed;
+        }
+        __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+        /* submit, and wait for at least one completion */
+        do {
+            rc = syscall(__NR_io_uring_enter, ring->fd, unconsumed, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (rc < 0 && errno == EINTR);
+        if (rc < 0) {
+            statbatch_uring_drain(ring, submitted - completed, unconsumed);
+            return -1;
+        }
+        unconsumed -= rc;
+        rc = 0;
+        head = *ring->cq_head;
+        while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            unsigned slot = cqe->user_data;
+            if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) rc = -1;
+            exists[ring->owner[slot]] = cqe->res == 0;
+            ring->free[ring->nfree++] = slot;
+            ++head;
+            ++completed;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return rc;
+}
+#endif
+
+static void *
+statbatch_worker(void *arg)
+{
+    statbatch_t *batch = arg;
+    struct stat statbuf;
+    pthread_mutex_lock(&batch->mutex);
+    for (;;) {
+        const char *path;
+        size_t i;
+        while (!batch->quit && batch->next >= batch->n)
+            pthread_cond_wait(&batch->work, &batch->mutex);
+        if (batch->quit) break;
+        i = batch->next++;
+        path = batch->paths[i];
+        pthread_mutex_unlock(&batch->mutex);
+        batch->exists[i] = path && stat(path, &statbuf) == 0;
+        pthread_mutex_lock(&batch->mutex);
+        if (--batch->pending == 0) pthread_cond_signal(&batch->done);
+    }
+    pthread_mutex_unlock(&batch->mutex);
+    return NULL;
+}
+
+static void
+statbatch_start_threads(statbatch_t *batch)
+{
+    int wanted = batch->depth < STATBATCH_THREADS ? batch->depth : STATBATCH_THREADS;
+    while (batch->nthreads < wanted) {
+        if (pthread_create(&batch->threads[batch->nthreads], NULL, statbatch_worker, batch) != 0)
+            break;
+        ++batch->nthreads;
+    }
+}
+
+static void
+statbatch_threads_exists(statbatch_t *batch, const char **paths, size_t n, int *exists)
+{
+    struct stat statbuf;
+    size_t i;
+    if (!batch->nthreads) statbatch_start_threads(batch);
+    if (!batch->nthreads) {
+        for (i = 0; i < n; i++) exists[i] = paths[i] && stat(paths[i], &statbuf) == 0;
+        return;
+    }
+    pthread_mutex_lock(&batch->mutex);
+    batch->paths = paths;
+    batch->exists = exists;
+    batch->n = n;
+    batch->next = 0;
+    batch->pending = n;
+    pthread_cond_broadcast(&batch->work);
+    while (batch->pending > 0) pthread_cond_wait(&batch->done, &batch->mutex);
+    batch->paths = NULL;
+    batch->exists = NULL;
+    batch->n = batch->next = 0;
+    pthread_mutex_unlock(&batch->mutex);
+}
+
+/*
+ * Create a batch of at most \a depth requests in flight
+ */
+statbatch_t *
+statbatch_new(unsigned depth, int flags)
+{
+    statbatch_t *batch;
+    assert(depth > 0);
+    batch = calloc(1, sizeof *batch);
+    if (!batch) return batch;
+    batch->depth = depth;
+#ifdef STATBATCH_URING
+    if (flags & STATBATCH_USE_URING) batch->ring = statbatch_uring_new(depth);
+#else
+    (void) flags;
+#endif
+    pthread_mutex_init(&batch->mutex, NULL);
+    pthread_cond_init(&batch->work, NULL);
+    pthread_cond_init(&batch->done, NULL);
+    return batch;
+}
+
+void
+statbatch_free(statbatch_t *batch)
+{
+    int i;
+    if (!batch) return;
+    pthread_mutex_lock(&batch->mutex);
+    batch->quit = 1;
+    pthread_cond_broadcast(&batch->work);
+    pthread_mutex_unlock(&batch->mutex);
+    for (i = 0; i < batch->nthreads; i++) pthread_join(batch->threads[i], NULL);
+#ifdef STATBATCH_URING
+    statbatch_uring_free(batch->ring);
+#endif
+    pthread_mutex_destroy(&batch->mutex);
+    pthread_cond_destroy(&batch->work);
+    pthread_cond_destroy(&batch->done);
+    free(batch);
+}
+
+/*
+ * Set \a exists[i] to whether \a paths[i] exists, for every i < \a n; null
+ * pathnames do not exist
+ */
+void
+statbatch_exists(statbatch_t *batch, const char **paths, size_t n, int *exists)
+{
+    assert(batch);
+    assert(paths || !n);
+    assert(exists || !n);
+#ifdef STATBATCH_URING
+    if (batch->ring) {
+        if (statbatch_uring_exists(batch->ring, paths, n, exists) == 0) return;
+        /* fall back to the thread pool for good */
+        statbatch_uring_free(batch->ring);
+        batch->ring = NULL;
+    }
+#endif
+    statbatch_threads_exists(batch, paths, n, exists);
+}
+
+/* Return the name of the mechanism in use, for diagnostics */
+const char *
+statbatch_backend(statbatch_t *batch)
+{
+    assert(batch);
+#ifdef STATBATCH_URING
+    if (batch->ring) return "io_uring";
+#endif
+    return "threads";
+}
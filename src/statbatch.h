@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATBATCH_INCLUDED
+#define STATBATCH_INCLUDED
+
+#include <stddef.h>
+
+/* flags for statbatch_new() */
+#define STATBATCH_USE_URING 0x1 /* use io_uring where available */
+
+typedef struct statbatch_t statbatch_t;
+
+extern statbatch_t *statbatch_new(unsigned, int);
+extern void         statbatch_free(statbatch_t *);
+extern void         statbatch_exists(statbatch_t *, const char **, size_t, int *);
+extern const char  *statbatch_backend(statbatch_t *);
+
+#endif /* STATBATCH_INCLUDED */
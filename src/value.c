@@ -21,6 +21,9 @@
 #include "interpreter.h"
 #include "pathcomp/log.h"
 #include "buf.h"
+#include "arena.h"
+#include "atom.h"
+#include "builtin.h"
 #include <stddef.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -35,31 +38,73 @@
  */
 
 /**
- * Match and extract a brace-delimited block preceded by \a keyword, returning
- * the text inside the braces
+ * Match a brace-delimited block preceded by \a keyword, returning a pointer to
+ * the text inside the braces, and its length in \a len
  */
-static char *
-value_match_and_extract_block(const char *text, const char *keyword)
+static const char *
+value_match_block(const char *text, const char *keyword, size_t *len)
 {
-    buf_t buf;
-    char *p;
+    const char *end;
     assert(text);
     assert(keyword);
+    assert(len);
     if (strlen(text) <= strlen(keyword)) return NULL;
-    buf_init(&buf, strlen(text) - strlen(keyword));
-    if (strncmp(text, keyword, strlen(keyword)) != 0) goto fail;
+    if (strncmp(text, keyword, strlen(keyword)) != 0) return NULL;
     text += strlen(keyword);
     while (*text && isspace(*text)) ++text;
-    if (*text == '\0' || *text != '{') goto fail;
+    if (*text == '\0' || *text != '{') return NULL;
     ++text;
-    buf_addstr(&buf, text);
-    p = strrchr(buf.buf, '}');
-    if (!p) goto fail;
-    buf_setlen(&buf, p - buf.buf);
-    return buf_detach(&buf, NULL);
-fail:
-    buf_release(&buf);
-    return NULL;
+    if (!(end = strrchr(text, '}'))) return NULL;
+    *len = end - text;
+    return text;
+}
+
+/**
+ * Like value_match_block(), but for blocks introduced by the word \c volatile
+ * followed by \a keyword
+ */
+static const char *
+value_match_volatile_block(const char *text, const char *keyword, size_t *len)
+{
+    const char *modifier = "volatile";
+    assert(text);
+    assert(keyword);
+    if (strncmp(text, modifier, strlen(modifier)) != 0) return NULL;
+    text += strlen(modifier);
+    if (!isspace(*text)) return NULL;
+    while (*text && isspace(*text)) ++text;
+    return value_match_block(text, keyword, len);
+}
+
+/**
+ * Allocate \a size bytes from \a arena, or from the heap if \a arena is \null
+ */
+static void *
+value_alloc(arena_t *arena, size_t size)
+{
+    return arena ? arena_alloc(arena, size) : malloc(size);
+}
+
+/**
+ * Allocate a value of type \a type, with the members common to all types
+ * initialized
+ */
+static value_t *
+value_make(arena_t *arena, int type)
+{
+    value_t *val;
+    val = value_alloc(arena, sizeof *val);
+    if (!val) return val;
+    val->type = type;
+    val->text = NULL;
+    val->code = NULL;
+    val->code_len = 0;
+    val->is_volatile = 0;
+    val->is_folded = 0;
+    val->refs = 1;
+    val->in_arena = arena != NULL;
+    value_cache_init(&val->cache);
+    return val;
 }
 
 /*
@@ -68,27 +113,35 @@ fail:
  * \{
  */
 
-value_t *
-value_new_string(const char *text)
+static value_t *
+value_new_string_n(arena_t *arena, const char *text, size_t len)
 {
     value_t *val;
     assert(text);
-    val = malloc(sizeof *val);
+    val = value_make(arena, VALUE_STRING);
     if (!val) return val;
-    val->type = VALUE_STRING;
-    val->result = strdup(text);
+    if ((val->text = value_alloc(arena, len + 1))) {
+        memcpy(val->text, text, len);
+        val->text[len] = '\0';
+    }
     return val;
 }
 
+value_t *
+value_new_string(const char *text)
+{
+    assert(text);
+    return value_new_string_n(NULL, text, strlen(text));
+}
+
 static value_t *
 value_clone_string(value_t *val)
 {
     value_t *clone;
     assert(val);
-    clone = malloc(sizeof *clone);
-    if (!clone) return clone;
-    clone->type = VALUE_STRING;
-    clone->result = strdup(val->result);
+    clone = value_new_string(val->text);
+    if (!clone || !val->is_folded) return clone;
+    if ((clone->source.lua = strdup(val->source.lua))) clone->is_folded = 1;
     return clone;
 }
 
@@ -98,21 +151,42 @@ value_clone_string(value_t *val)
  * \{
  */
 
-value_t *
-value_new_lua(const char *source)
+static value_t *
+value_new_lua_n(arena_t *arena, const char *source, size_t len)
 {
     value_t *val;
-    buf_t buf;
     const char *preamble = "local self = ...; ";
+    size_t n = strlen(preamble);
     assert(source);
-    val = malloc(sizeof *val);
+    val = value_make(arena, VALUE_LUA);
     if (!val) return val;
-    buf_init(&buf, strlen(preamble) + strlen(source));
-    buf_addstr(&buf, preamble);
-    buf_addstr(&buf, source);
-    val->type = VALUE_LUA;
-    val->source.lua = buf_detach(&buf, NULL);
-    val->result = NULL;
+    if ((val->source.lua = value_alloc(arena, n + len + 1))) {
+        memcpy(val->source.lua, preamble, n);
+        memcpy(val->source.lua + n, source, len);
+        val->source.lua[n + len] = '\0';
+    }
+    return val;
+}
+
+value_t *
+value_new_lua(const char *source)
+{
+    assert(source);
+    return value_new_lua_n(NULL, source, strlen(source));
+}
+
+/*
+ * Create a Lua value whose result is never reused, but recomputed on every
+ * evaluation. This is meant for Lua code with side effects, or code returning
+ * a different result every time it is called, like os.time().
+ */
+value_t *
+value_new_volatile_lua(const char *source)
+{
+    value_t *val;
+    val = value_new_lua(source);
+    if (!val) return val;
+    val->is_volatile = 1;
     return val;
 }
 
@@ -125,11 +199,94 @@ value_clone_lua(value_t *val)
     if (!clone) return clone;
     clone->type = VALUE_LUA;
     clone->source.lua = strdup(val->source.lua);
-    clone->result = val->result ? strdup(val->result) : NULL;
+    clone->text = NULL;
+    clone->code = NULL;
+    clone->code_len = 0;
+    if (val->code && (clone->code = malloc(val->code_len))) {
+        memcpy(clone->code, val->code, val->code_len);
+        clone->code_len = val->code_len;
+    }
+    clone->is_volatile = val->is_volatile;
+    clone->is_folded = 0;
+    clone->refs = 1;
+    clone->in_arena = 0;
+    value_cache_share(&clone->cache, &val->cache);
+    clone->cache.result = val->cache.result ? strdup(val->cache.result) : NULL;
+    clone->cache.valid = val->cache.valid;
     return clone;
 }
 
+static int
+value_write_code(lua_State *L, const void *p, size_t size, buf_t *code)
+{
+    (void) L;
+    buf_add(code, p, size);
+    return 0;
+}
+
+/*
+ * Compile the Lua code of \a val, and append the result to \a code, in the
+ * form of a binary chunk which may be given to value_new_compiled_in() later.
+ * On failure, the error message is pushed onto the Lua stack.
+ */
+int
+value_compile(value_t *val, lua_State *L, buf_t *code)
+{
+    int rc;
+    assert(val);
+    assert(val->type == VALUE_LUA);
+    assert(L);
+    assert(code);
+    if ((rc = luaL_loadstring(L, val->source.lua)) != LUA_OK) return rc;
+    lua_dump(L, (lua_Writer) value_write_code, code);
+    lua_pop(L, 1);
+    return LUA_OK;
+}
+
+/*
+ * Load the code of \a val, from its precompiled chunk if it has one. A chunk
+ * that cannot be loaded, e.g., because it was produced by another version of
+ * Lua, is ignored, and the source code is compiled instead.
+ */
+static int
+value_load_code(value_t *val, lua_State *L)
+{
+    if (val->code) {
+        if (luaL_loadbuffer(L, val->code, val->code_len, val->source.lua) == LUA_OK) return LUA_OK;
+        lua_pop(L, 1);
+    }
+    return luaL_loadstring(L, val->source.lua);
+}
+
+/*
+ * Push the compiled code of \a val onto the Lua stack, compiling it first if
+ * necessary. The compiled code is kept in the registry, and reused in
+ * subsequent calls. On failure, the error message is pushed instead.
+ */
+static int
+value_load_lua(value_t *val, value_cache_t *cache, interpreter_t *interp, lua_State *L)
+{
+    int rc;
+    unsigned long generation;
+    assert(val);
+    assert(cache);
+    assert(interp);
+    assert(L);
+    generation = interpreter_get_generation(interp);
+    if (cache->chunk != LUA_NOREF && cache->interp == interp && cache->generation == generation) {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, cache->chunk);
+        return LUA_OK;
+    }
+    if ((rc = value_load_code(val, L)) != LUA_OK) return rc;
+    lua_pushvalue(L, -1);
+    cache->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+    cache->interp = interp;
+    cache->generation = generation;
+    return LUA_OK;
+}
+
 /*
+ * \param interp Interpreter in which to run the Lua code
  * \param composer Pointer to composer object
  * \param metatable Name of the Lua metatable
  *
@@ -142,39 +299,283 @@ value_clone_lua(value_t *val)
  * always have access to 'self' in the Lua code.
  */
 static const char *
-value_eval_lua(value_t *val, void *composer, const char *metatable)
+value_eval_lua(value_t *val, value_cache_t *cache, interpreter_t *interp, void *composer,
+        const char *metatable)
 {
-    lua_State  *L = interpreter_get_state();
+    lua_State  *L = interpreter_get_state(interp);
     void      **p;
     int         nargs = 0;
     const char *s;
+    interpreter_pusher_t *push_self;
     assert(val);
-    if (luaL_loadstring(L, val->source.lua) != LUA_OK) {
+    assert(cache);
+    if (cache->valid && !val->is_volatile) return cache->result;
+    if (value_load_lua(val, cache, interp, L) != LUA_OK) {
         const char *error = lua_tostring(L, -1);
         pathcomp_log_error("cannot parse Lua code: %s", error);
         lua_pop(L, 1);
-        free(val->result);
-        return val->result = NULL;
+        free(cache->result);
+        return cache->result = NULL;
     }
     if (composer && metatable) {
-        p = lua_newuserdata(L, sizeof(*p));
-        *p = composer;
-        luaL_getmetatable(L, metatable);
-        lua_setmetatable(L, -2);
+        if ((push_self = interpreter_get_pusher(interp))) push_self(L, composer);
+        else {
+            p = lua_newuserdata(L, sizeof(*p));
+            *p = composer;
+            luaL_getmetatable(L, metatable);
+            lua_setmetatable(L, -2);
+        }
         nargs = 1;
     }
     if (lua_pcall(L, nargs, 1, 0) != LUA_OK) {
         const char *error = lua_tostring(L, -1);
         pathcomp_log_error("cannot execute Lua code: %s", error);
         lua_pop(L, 1);
-        free(val->result);
-        return val->result = NULL;
+        free(cache->result);
+        return cache->result = NULL;
     }
-    free(val->result);
+    free(cache->result);
     s = lua_tostring(L, -1);
-    val->result = s ? strdup(s) : NULL;
+    cache->result = s ? strdup(s) : NULL;
+    cache->valid = 1;
+    lua_pop(L, 1);
+    return cache->result;
+}
+
+/*
+ * \}
+ * \name Constant folding of Lua values
+ * \{
+ */
+
+/* maximum number of Lua instructions (in thousands) executed by a trial run */
+#define VALUE_FOLD_STEPS 1000
+
+/* globals that do not make Lua code impure; see value_fold_index() */
+static const char *value_fold_globals[] = {
+    "assert", "error", "ipairs", "next", "pairs", "pcall", "rawequal", "rawget", "select",
+    "tonumber", "tostring", "type", "unpack", "xpcall", "math", "pc", "string", "table", NULL
+};
+
+/* libraries, which the code under trial sees through read-only proxies */
+static const char *value_fold_libraries[] = { "math", "pc", "string", "table", NULL };
+
+/* members of the libraries that do make Lua code impure */
+static const char *value_fold_denied[][2] = {
+    { "math", "random" }, { "math", "randomseed" }, { NULL, NULL }
+};
+
+/* functions that would see through the proxies, and refuse them */
+static const char *value_fold_raw[] = { "ipairs", "next", "pairs", "rawget", NULL };
+
+typedef struct {
+    int impure; /* code has done something that prevents folding */
+    int steps;  /* thousands of instructions executed */
+} value_fold_state_t;
+
+static const char *value_fold_key = "libpathcomp::fold";
+
+static int
+value_fold_find(const char **names, const char *name)
+{
+    for (; *names; names++) if (strcmp(*names, name) == 0) return 1;
+    return 0;
+}
+
+/*
+ * Mark the trial run as impure, and abort it; the first upvalue is the state
+ * of the trial run. The flag is needed because the error may be caught by
+ * pcall() in the code under trial.
+ */
+static int
+value_fold_deny(lua_State *L)
+{
+    value_fold_state_t *state = lua_touserdata(L, lua_upvalueindex(1));
+    state->impure = 1;
+    return luaL_error(L, "not a constant");
+}
+
+/*
+ * __index of the proxy of a library; the upvalues are the state of the trial
+ * run, the library, and its name
+ */
+static int
+value_fold_lib_index(lua_State *L)
+{
+    const char *lib = lua_tostring(L, lua_upvalueindex(3)), *name = lua_tostring(L, 2);
+    int i;
+    if (!name) return value_fold_deny(L);
+    for (i = 0; value_fold_denied[i][0]; i++) {
+        if (!strcmp(value_fold_denied[i][0], lib) && !strcmp(value_fold_denied[i][1], name))
+            return value_fold_deny(L);
+    }
+    lua_pushvalue(L, 2);
+    lua_rawget(L, lua_upvalueindex(2));
+    return 1;
+}
+
+static int
+value_fold_is_proxy(lua_State *L, int index)
+{
+    int is_proxy;
+    if (!lua_getmetatable(L, index)) return 0;
+    lua_getfield(L, -1, "__index");
+    is_proxy = lua_tocfunction(L, -1) == value_fold_lib_index;
+    lua_pop(L, 2);
+    return is_proxy;
+}
+
+/*
+ * Call the function in the second upvalue, unless its first argument is the
+ * proxy of a library, which it would find empty
+ */
+static int
+value_fold_raw_call(lua_State *L)
+{
+    if (value_fold_is_proxy(L, 1)) return value_fold_deny(L);
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_insert(L, 1);
+    lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+/*
+ * __index of the environment of the code under trial: only the standard
+ * globals that have no side effects, and do not depend on the outside world,
+ * may be looked up. Libraries are replaced by proxies, so that they cannot be
+ * modified.
+ */
+static int
+value_fold_index(lua_State *L)
+{
+    const char *name = lua_tostring(L, 2);
+    if (!name || !value_fold_find(value_fold_globals, name)) return value_fold_deny(L);
+    lua_getglobal(L, name);
+    if (value_fold_find(value_fold_libraries, name) && lua_istable(L, -1)) {
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_pushvalue(L, -4);
+        lua_pushvalue(L, 2);
+        lua_pushcclosure(L, value_fold_lib_index, 3);
+        lua_setfield(L, -2, "__index");
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_pushcclosure(L, value_fold_deny, 1);
+        lua_setfield(L, -2, "__newindex");
+        lua_setmetatable(L, -2);
+    }
+    else if (value_fold_find(value_fold_raw, name)) {
+        lua_pushvalue(L, lua_upvalueindex(1));
+        lua_pushvalue(L, -2);
+        lua_pushcclosure(L, value_fold_raw_call, 2);
+    }
+    else return 1;
+    /* cache the replacement in the environment */
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, 1);
+    return 1;
+}
+
+/* count hook that stops trial runs that take too long */
+static void
+value_fold_hook(lua_State *L, lua_Debug *ar)
+{
+    value_fold_state_t *state;
+    (void) ar;
+    lua_pushlightuserdata(L, (void *) value_fold_key);
+    lua_rawget(L, LUA_REGISTRYINDEX);
+    state = lua_touserdata(L, -1);
     lua_pop(L, 1);
-    return val->result;
+    if (state && ++state->steps > VALUE_FOLD_STEPS) {
+        state->impure = 1;
+        luaL_error(L, "too many instructions");
+    }
+}
+
+/* push a table whose metamethods all call value_fold_deny() */
+static void
+value_fold_push_guard(lua_State *L, value_fold_state_t *state)
+{
+    static const char *events[] = {
+        "__index", "__newindex", "__call", "__tostring", "__concat", "__len", "__eq", "__lt",
+        "__le", "__unm", "__add", "__sub", "__mul", "__div", "__mod", "__pow", NULL
+    };
+    const char **event;
+    lua_newtable(L);
+    for (event = events; *event; event++) {
+        lua_pushlightuserdata(L, state);
+        lua_pushcclosure(L, value_fold_deny, 1);
+        lua_setfield(L, -2, *event);
+    }
+}
+
+/*
+ * Evaluate the Lua code of \a val once, if it is a constant, and turn \a val
+ * into a string value holding the result. Returns 1 if \a val has been
+ * folded. Memory for the result is taken from \a arena, if not null.
+ *
+ * Lua code is a constant if it does not refer to 'self', does not assign
+ * global variables, and uses no globals other than the standard functions and
+ * libraries without side effects; os, io, math.random, and any globals set by
+ * Lua code are excluded. Rather than analyse the code, it is run once with
+ * 'self' and its globals guarded; any attempt to do something that is not
+ * allowed, or any error, means the code is left alone, to be evaluated in the
+ * ordinary way. Volatile code is never folded.
+ *
+ * \a val must not be shared yet, as it is modified in place.
+ */
+int
+value_fold(value_t *val, arena_t *arena, interpreter_t *interp)
+{
+    lua_State *L;
+    value_fold_state_t state = { 0, 0 };
+    const char *s;
+    size_t len;
+    char *text;
+    int top, rc;
+    assert(val);
+    assert(interp);
+    if (val->type != VALUE_LUA || val->is_volatile || !val->source.lua) return 0;
+    /* most Lua code refers to 'self'; don't bother compiling it */
+    if (strstr(strchr(val->source.lua, ';'), "self")) return 0;
+    if (!(L = interpreter_get_state(interp))) return 0;
+    top = lua_gettop(L);
+    if (value_load_code(val, L) != LUA_OK) goto out;
+    /* environment */
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushlightuserdata(L, &state);
+    lua_pushcclosure(L, value_fold_index, 1);
+    lua_setfield(L, -2, "__index");
+    lua_pushlightuserdata(L, &state);
+    lua_pushcclosure(L, value_fold_deny, 1);
+    lua_setfield(L, -2, "__newindex");
+    lua_setmetatable(L, -2);
+    lua_setfenv(L, -2);
+    /* self */
+    lua_newuserdata(L, 1);
+    value_fold_push_guard(L, &state);
+    lua_setmetatable(L, -2);
+    lua_pushlightuserdata(L, (void *) value_fold_key);
+    lua_pushlightuserdata(L, &state);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+    lua_sethook(L, value_fold_hook, LUA_MASKCOUNT, 1000);
+    rc = lua_pcall(L, 1, 1, 0);
+    lua_sethook(L, NULL, 0, 0);
+    lua_pushlightuserdata(L, (void *) value_fold_key);
+    lua_pushnil(L);
+    lua_rawset(L, LUA_REGISTRYINDEX);
+    if (rc != LUA_OK || state.impure || !lua_isstring(L, -1)) goto out;
+    s = lua_tolstring(L, -1, &len);
+    if (!(text = value_alloc(arena, len + 1))) goto out;
+    memcpy(text, s, len + 1);
+    val->type = VALUE_STRING;
+    val->text = text;
+    val->is_folded = 1;
+out:
+    lua_settop(L, top);
+    return val->is_folded;
 }
 
 /*
@@ -187,39 +588,410 @@ value_t *
 value_new_int(int ival)
 {
     value_t *val;
-    val = malloc(sizeof *val);
+    val = value_make(NULL, VALUE_INT);
     if (!val) return val;
-    val->type = VALUE_INT;
     val->source.integer = ival;
-    val->result = NULL;
     return val;
 }
 
 static value_t *
 value_clone_int(value_t *val)
 {
-    value_t *clone;
     assert(val);
-    clone = malloc(sizeof *clone);
-    if (!clone) return clone;
-    clone->type = VALUE_INT;
-    clone->source.integer = val->source.integer;
-    clone->result = val->result ? strdup(val->result) : NULL;
-    return clone;
+    return value_new_int(val->source.integer);
 }
 
 static const char *
-value_eval_int(value_t *val)
+value_eval_int(value_t *val, value_cache_t *cache)
 {
     assert(val);
+    assert(cache);
     buf_t buf;
+    if (cache->valid) return cache->result;
     /* 24 digits should conceivably fit any 64-bit integer, including sign and
      * terminating null, and it's the smallest size buf_grow() would have
      * allocated anyway */
     buf_init(&buf, 24);
     buf_addf(&buf, "%d", val->source.integer);
-    free(val->result);
-    return val->result = buf_detach(&buf, NULL);
+    free(cache->result);
+    cache->valid = 1;
+    return cache->result = buf_detach(&buf, NULL);
+}
+
+/*
+ * \}
+ * \name Routines specific to template values
+ * \{
+ *
+ * A template is text in which ${name} is replaced by the value of attribute
+ * 'name', without going through Lua. ${env:NAME} is replaced by environment
+ * variable NAME, and ${date:name:format} by the time stamp in attribute 'name',
+ * formatted by strftime(). A reference other than a date may select a
+ * substring, as in ${name[first,last]}, with the same meaning of first and last
+ * as in Lua's string.sub(), and may be padded to a minimum width, as in
+ * ${name%5} (padded with spaces on the left), ${name%-5} (on the right), or
+ * ${name%05} (with zeros on the left). A dollar sign is written $$. Whitespace
+ * around the template is ignored. A template is parsed once, into a list of
+ * literal text and references.
+ */
+
+typedef struct {
+    enum { TPL_LITERAL, TPL_ATT, TPL_ENV, TPL_DATE } kind;
+    const char *text;   /* literal text, or atom of the attribute or variable */
+    size_t      len;    /* length of literal text */
+    const char *format; /* atom of the format of a date */
+    long        first;  /* substring of the referenced value */
+    long        last;
+    int         width;  /* minimum width of the referenced value */
+    int         left;   /* pad on the right, not on the left */
+    char        fill;
+} value_tpl_part_t;
+
+struct value_tpl_t {
+    char             *source;
+    const char       *error; /* why the template cannot be parsed, or NULL */
+    size_t            count;
+    value_tpl_part_t *parts;
+};
+
+static void
+value_tpl_add_literal(value_tpl_t *tpl, const char *text, size_t len)
+{
+    value_tpl_part_t *part;
+    if (!len) return;
+    part = &tpl->parts[tpl->count++];
+    part->kind = TPL_LITERAL;
+    part->text = text;
+    part->len = len;
+}
+
+static const char *
+value_tpl_skip_space(const char *p)
+{
+    while (*p && isspace((unsigned char) *p)) ++p;
+    return p;
+}
+
+/* intern the text from \a begin to \a end */
+static const char *
+value_tpl_atom(const char *begin, const char *end, const char **error)
+{
+    const char *atom;
+    char *s;
+    if (!(s = malloc(end - begin + 1))) {
+        *error = "out of memory";
+        return NULL;
+    }
+    memcpy(s, begin, end - begin);
+    s[end - begin] = '\0';
+    if (!(atom = atom_string(s))) *error = "out of memory";
+    free(s);
+    return atom;
+}
+
+/* scan a name at \a p, and return a pointer past it */
+static const char *
+value_tpl_scan_name(const char *p)
+{
+    while (*p && !isspace((unsigned char) *p) && !strchr("[%}:", *p)) ++p;
+    return p;
+}
+
+/*
+ * Parse the reference starting after "${" at \a p into \a part; return a
+ * pointer past the closing brace, or NULL on error
+ */
+static const char *
+value_tpl_parse_ref(const char *p, value_tpl_part_t *part, const char **error)
+{
+    const char *name, *end;
+    char *stop;
+    part->kind = TPL_ATT;
+    part->len = 0;
+    part->format = NULL;
+    part->first = 1;
+    part->last = -1;
+    part->width = 0;
+    part->left = 0;
+    part->fill = ' ';
+    p = value_tpl_skip_space(p);
+    name = p;
+    end = p = value_tpl_scan_name(p);
+    if (*p == ':') {
+        if (end - name == 3 && !strncmp(name, "env", 3)) part->kind = TPL_ENV;
+        else if (end - name == 4 && !strncmp(name, "date", 4)) part->kind = TPL_DATE;
+        else {
+            *error = "unknown function";
+            return NULL;
+        }
+        name = ++p;
+        end = p = value_tpl_scan_name(p);
+    }
+    if (end == name) {
+        *error = "missing name";
+        return NULL;
+    }
+    if (!(part->text = value_tpl_atom(name, end, error))) return NULL;
+    if (part->kind == TPL_DATE) {
+        if (*p != ':') {
+            *error = "missing date format";
+            return NULL;
+        }
+        name = ++p;
+        if (!(p = strchr(p, '}'))) {
+            *error = "unterminated reference";
+            return NULL;
+        }
+        if (!(part->format = value_tpl_atom(name, p, error))) return NULL;
+        return p + 1;
+    }
+    p = value_tpl_skip_space(p);
+    if (*p == '[') {
+        part->first = strtol(p + 1, &stop, 10);
+        if (stop == p + 1) goto bad_substring;
+        p = value_tpl_skip_space(stop);
+        if (*p == ',') {
+            part->last = strtol(p + 1, &stop, 10);
+            if (stop == p + 1) goto bad_substring;
+            p = value_tpl_skip_space(stop);
+        }
+        if (*p++ != ']') goto bad_substring;
+        p = value_tpl_skip_space(p);
+    }
+    if (*p == '%') {
+        for (++p; *p == '-' || *p == '0'; ++p) {
+            if (*p == '-') part->left = 1;
+            else part->fill = '0';
+        }
+        if (!isdigit((unsigned char) *p)) {
+            *error = "missing width";
+            return NULL;
+        }
+        part->width = strtol(p, &stop, 10);
+        p = value_tpl_skip_space(stop);
+    }
+    if (*p != '}') {
+        *error = "unterminated reference";
+        return NULL;
+    }
+    return p + 1;
+
+bad_substring:
+    *error = "malformed substring";
+    return NULL;
+}
+
+static void
+value_tpl_parse(value_tpl_t *tpl)
+{
+    const char *p, *literal;
+    size_t refs = 0;
+    for (p = tpl->source; (p = strchr(p, '$')); ++p) ++refs;
+    /* every reference may be preceded by literal text */
+    if (!(tpl->parts = malloc((2 * refs + 1) * sizeof *tpl->parts))) {
+        tpl->error = "out of memory";
+        return;
+    }
+    for (p = literal = tpl->source; *p; ) {
+        if (p[0] != '$' || (p[1] != '$' && p[1] != '{')) {
+            ++p;
+            continue;
+        }
+        if (p[1] == '$') {
+            /* keep one dollar sign */
+            value_tpl_add_literal(tpl, literal, p + 1 - literal);
+            literal = p += 2;
+            continue;
+        }
+        value_tpl_add_literal(tpl, literal, p - literal);
+        if (!(p = value_tpl_parse_ref(p + 2, &tpl->parts[tpl->count], &tpl->error))) return;
+        ++tpl->count;
+        literal = p;
+    }
+    value_tpl_add_literal(tpl, literal, p - literal);
+}
+
+static void
+value_tpl_free(value_tpl_t *tpl)
+{
+    if (!tpl) return;
+    free(tpl->source);
+    free(tpl->parts);
+    free(tpl);
+}
+
+static value_t *
+value_new_tpl_n(arena_t *arena, const char *source, size_t len)
+{
+    value_t *val;
+    value_tpl_t *tpl;
+    assert(source);
+    /* whitespace around the template is not part of it */
+    while (len && isspace((unsigned char) *source)) ++source, --len;
+    while (len && isspace((unsigned char) source[len - 1])) --len;
+    if (!(tpl = malloc(sizeof *tpl))) return NULL;
+    if (!(tpl->source = malloc(len + 1))) {
+        free(tpl);
+        return NULL;
+    }
+    memcpy(tpl->source, source, len);
+    tpl->source[len] = '\0';
+    tpl->error = NULL;
+    tpl->count = 0;
+    tpl->parts = NULL;
+    value_tpl_parse(tpl);
+    if (!(val = value_make(arena, VALUE_TPL))) {
+        value_tpl_free(tpl);
+        return val;
+    }
+    val->source.tpl = tpl;
+    return val;
+}
+
+value_t *
+value_new_tpl(const char *source)
+{
+    assert(source);
+    return value_new_tpl_n(NULL, source, strlen(source));
+}
+
+static value_t *
+value_clone_tpl(value_t *val)
+{
+    assert(val);
+    return value_new_tpl(val->source.tpl->source);
+}
+
+/*
+ * Append the value of the reference \a part to \a buf; return 0 if it has no
+ * value
+ */
+static int
+value_tpl_add_ref(buf_t *buf, value_tpl_part_t *part, interpreter_resolver_t *resolve,
+        void *composer)
+{
+    const char *s;
+    size_t len;
+    switch (part->kind) {
+        case TPL_ENV:
+            if (!(s = builtin_env(part->text))) {
+                pathcomp_log_error("cannot evaluate template: environment variable '%s' is not set", part->text);
+                return 0;
+            }
+            break;
+        case TPL_ATT:
+        case TPL_DATE:
+            if (!(s = resolve ? resolve(composer, part->text) : NULL)) {
+                pathcomp_log_error("cannot evaluate template: attribute '%s' has no value", part->text);
+                return 0;
+            }
+            break;
+        default:
+            assert(0);
+            return 0;
+    }
+    if (part->kind == TPL_DATE) {
+        if (builtin_date(buf, s, part->format)) return 1;
+        pathcomp_log_error("cannot evaluate template: attribute '%s' is not a time stamp: %s", part->text, s);
+        return 0;
+    }
+    s = builtin_sub(s, part->first, part->last, &len);
+    builtin_pad(buf, s, len, part->left ? -part->width : part->width, part->fill);
+    return 1;
+}
+
+/*
+ * Evaluate a template; \a composer may be null if the template does not refer
+ * to any attribute
+ */
+static const char *
+value_eval_tpl(value_t *val, value_cache_t *cache, interpreter_t *interp, void *composer)
+{
+    value_tpl_t *tpl;
+    interpreter_resolver_t *resolve;
+    buf_t buf;
+    size_t i;
+    assert(val);
+    assert(cache);
+    if (cache->valid && !val->is_volatile) return cache->result;
+    tpl = val->source.tpl;
+    if (tpl->error) {
+        pathcomp_log_error("cannot parse template: %s: %s", tpl->error, tpl->source);
+        free(cache->result);
+        return cache->result = NULL;
+    }
+    /* a template that refers to itself, directly or not, would otherwise
+     * recurse without end */
+    if (cache->busy) {
+        pathcomp_log_error("cannot evaluate template: circular reference: %s", tpl->source);
+        return NULL;
+    }
+    resolve = interp && composer ? interpreter_get_resolver(interp) : NULL;
+    buf_init(&buf, 0);
+    cache->busy = 1;
+    for (i = 0; i < tpl->count; i++) {
+        value_tpl_part_t *part = &tpl->parts[i];
+        if (part->kind == TPL_LITERAL) buf_add(&buf, part->text, part->len);
+        else if (!value_tpl_add_ref(&buf, part, resolve, composer)) {
+            cache->busy = 0;
+            buf_release(&buf);
+            free(cache->result);
+            return cache->result = NULL;
+        }
+    }
+    cache->busy = 0;
+    free(cache->result);
+    cache->valid = 1;
+    return cache->result = buf_detach(&buf, NULL);
+}
+
+/*
+ * \}
+ * \name Routines for the cache of results
+ * \{
+ */
+
+void
+value_cache_init(value_cache_t *cache)
+{
+    assert(cache);
+    cache->result = NULL;
+    cache->valid = 0;
+    cache->busy = 0;
+    cache->chunk = LUA_NOREF;
+    cache->interp = NULL;
+    cache->generation = 0;
+}
+
+/*
+ * Initialize \a dst, sharing the compiled code of \a src rather than compiling
+ * it again, if it is usable in the calling thread
+ */
+void
+value_cache_share(value_cache_t *dst, value_cache_t *src)
+{
+    assert(dst);
+    assert(src);
+    value_cache_init(dst);
+    if (src->chunk != LUA_NOREF && src->generation == interpreter_get_generation(src->interp)) {
+        lua_State *L = interpreter_get_state(src->interp);
+        lua_rawgeti(L, LUA_REGISTRYINDEX, src->chunk);
+        dst->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
+        dst->interp = src->interp;
+        dst->generation = src->generation;
+    }
+}
+
+void
+value_cache_release(value_cache_t *cache)
+{
+    assert(cache);
+    free(cache->result);
+    /* the reference is gone already if the interpreter has been cleaned up */
+    if (cache->chunk != LUA_NOREF && cache->generation == interpreter_get_generation(cache->interp)) {
+        luaL_unref(interpreter_get_state(cache->interp), LUA_REGISTRYINDEX, cache->chunk);
+    }
+    value_cache_init(cache);
 }
 
 /*
@@ -231,16 +1003,52 @@ value_eval_int(value_t *val)
 value_t *
 value_new_auto(const char *text)
 {
-    char *source;
+    return value_new_auto_in(NULL, text);
+}
+
+/*
+ * Like value_new_auto(), but allocate the value from \a arena. Such a value
+ * holds no memory of its own (except for its cache), and is freed with the
+ * arena, whatever value_free() is called on it.
+ */
+value_t *
+value_new_auto_in(arena_t *arena, const char *text)
+{
+    const char *source;
+    size_t len;
+    value_t *val;
     assert(text);
-    if ((source = value_match_and_extract_block(text, "lua"))) {
-        value_t *val = value_new_lua(source);
-        free(source);
+    if ((source = value_match_block(text, "lua", &len))) {
+        return value_new_lua_n(arena, source, len);
+    }
+    else if ((source = value_match_volatile_block(text, "lua", &len))) {
+        if ((val = value_new_lua_n(arena, source, len))) val->is_volatile = 1;
         return val;
     }
+    else if ((source = value_match_block(text, "tpl", &len))) {
+        return value_new_tpl_n(arena, source, len);
+    }
     else {
-        return value_new_string(text);
+        return value_new_string_n(arena, text, strlen(text));
+    }
+}
+
+/*
+ * Like value_new_auto_in(), but with the precompiled \a code of the Lua code in
+ * \a text, as produced by value_compile(). The code is copied. If \a text is not
+ * Lua code, \a code is ignored.
+ */
+value_t *
+value_new_compiled_in(arena_t *arena, const char *text, const char *code, size_t len)
+{
+    value_t *val;
+    val = value_new_auto_in(arena, text);
+    if (!val || val->type != VALUE_LUA || !code) return val;
+    if ((val->code = value_alloc(arena, len))) {
+        memcpy(val->code, code, len);
+        val->code_len = len;
     }
+    return val;
 }
 
 value_t *
@@ -254,30 +1062,63 @@ value_clone(value_t *val)
             return value_clone_lua(val);
         case VALUE_INT:
             return value_clone_int(val);
+        case VALUE_TPL:
+            return value_clone_tpl(val);
         default:
             assert(0);
     }
 }
 
+/*
+ * Add an owner to \a val, which is freed only when all of its owners have
+ * called value_free(). Values may be shared between threads.
+ */
+value_t *
+value_ref(value_t *val)
+{
+    assert(val);
+    __atomic_add_fetch(&val->refs, 1, __ATOMIC_RELAXED);
+    return val;
+}
+
 void
 value_free(value_t *val)
 {
     if (!val) return;
-    switch (val->type) {
-        case VALUE_STRING:
-            break;
-        case VALUE_LUA:
-            free(val->source.lua);
-            break;
-        case VALUE_INT:
-            break;
-        default:
-            assert(0);
-    }
-    free(val->result);
+    if (__atomic_sub_fetch(&val->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    value_cache_release(&val->cache);
+    /* the parsed template is never allocated from the arena */
+    if (val->type == VALUE_TPL) value_tpl_free(val->source.tpl);
+    if (val->in_arena) return;
+    if (val->type == VALUE_LUA || val->is_folded) free(val->source.lua);
+    free(val->text);
+    free(val->code);
     free(val);
 }
 
+/*
+ * Mark the result of \a val as out of date, forcing reevaluation the next time
+ * value_eval() is called. Values that do not depend on other attributes are
+ * not affected.
+ */
+void
+value_invalidate(value_t *val)
+{
+    assert(val);
+    value_invalidate_cached(val, &val->cache);
+}
+
+/*
+ * Like value_invalidate(), but for a result kept in \a cache
+ */
+void
+value_invalidate_cached(value_t *val, value_cache_t *cache)
+{
+    assert(val);
+    assert(cache);
+    if (val->type == VALUE_LUA || val->type == VALUE_TPL) cache->valid = 0;
+}
+
 /*
  * \a composer and \a metatable may be null if the Lua code to be evaluated
  * does not need access to other attributes in the composer object via 'self'.
@@ -287,16 +1128,30 @@ value_free(value_t *val)
  * function.
  */
 const char *
-value_eval(value_t *val, void *composer, const char *metatable)
+value_eval(value_t *val, interpreter_t *interp, void *composer, const char *metatable)
+{
+    assert(val);
+    return value_eval_cached(val, &val->cache, interp, composer, metatable);
+}
+
+/*
+ * Like value_eval(), but keep the result in \a cache instead of in \a val
+ * itself
+ */
+const char *
+value_eval_cached(value_t *val, value_cache_t *cache, interpreter_t *interp, void *composer,
+        const char *metatable)
 {
     assert(val);
     switch (val->type) {
         case VALUE_STRING:
-            return val->result;
+            return val->text;
         case VALUE_LUA:
-            return value_eval_lua(val, composer, metatable);
+            return value_eval_lua(val, cache, interp, composer, metatable);
         case VALUE_INT:
-            return value_eval_int(val);
+            return value_eval_int(val, cache);
+        case VALUE_TPL:
+            return value_eval_tpl(val, cache, interp, composer);
         default:
             assert(0);
     }
@@ -305,21 +1160,33 @@ value_eval(value_t *val, void *composer, const char *metatable)
 }
 
 int
-value_push(value_t *val, void *composer, const char *metatable)
+value_push(value_t *val, interpreter_t *interp, void *composer, const char *metatable)
+{
+    assert(val);
+    return value_push_cached(val, &val->cache, interp, composer, metatable);
+}
+
+int
+value_push_cached(value_t *val, value_cache_t *cache, interpreter_t *interp, void *composer,
+        const char *metatable)
 {
     assert(val);
-    lua_State *L = interpreter_get_state();
+    lua_State *L = interpreter_get_state(interp);
     switch (val->type) {
         case VALUE_STRING:
-            lua_pushstring(L, val->result);
+            lua_pushstring(L, val->text);
             return 1;
         case VALUE_LUA:
-            value_eval_lua(val, composer, metatable);
-            lua_pushstring(L, val->result); /* lua_pushstring() will create a copy */
+            value_eval_lua(val, cache, interp, composer, metatable);
+            lua_pushstring(L, cache->result); /* lua_pushstring() will create a copy */
             return 1;
         case VALUE_INT:
             lua_pushinteger(L, (lua_Integer) val->source.integer);
             return 1;
+        case VALUE_TPL:
+            /* not cache->result, which is out of date during a circular reference */
+            lua_pushstring(L, value_eval_tpl(val, cache, interp, composer));
+            return 1;
         default:
             assert(0);
     }
@@ -332,19 +1199,27 @@ value_dump(value_t *val, value_dump_info_t *info)
 {
     buf_t *buf;
     char marker = ' ';
+    const char *result;
     assert(val);
     assert(info);
     buf = info->buf;
     if (val == info->current) marker = '*';
     switch (val->type) {
         case VALUE_STRING:
-            buf_addf(buf, "       %cstring(0x%x) | %s\n", marker, val, val->result);
+            if (val->is_folded) buf_addf(buf, "       %cstring(0x%x) | %s | (folded:) %s\n", marker, val, val->text, val->source.lua);
+            else buf_addf(buf, "       %cstring(0x%x) | %s\n", marker, val, val->text);
             break;
         case VALUE_LUA:
-            buf_addf(buf, "       %clua(0x%x)    | %s | (source:) %s\n", marker, val, val->result ? val->result : "(null)", val->source.lua);
+            result = info->cache ? info->cache->result : NULL;
+            buf_addf(buf, "       %clua(0x%x)    | %s | (source:) %s%s\n", marker, val, result ? result : "(null)", val->source.lua, val->is_volatile ? " | volatile" : "");
             break;
         case VALUE_INT:
-            buf_addf(buf, "       %cint(0x%x)    | %s | (source:) %d\n", marker, val, val->result ? val->result : "(null)", val->source.integer);
+            result = info->cache ? info->cache->result : NULL;
+            buf_addf(buf, "       %cint(0x%x)    | %s | (source:) %d\n", marker, val, result ? result : "(null)", val->source.integer);
+            break;
+        case VALUE_TPL:
+            result = info->cache ? info->cache->result : NULL;
+            buf_addf(buf, "       %ctpl(0x%x)    | %s | (source:) %s\n", marker, val, result ? result : "(null)", val->source.tpl->source);
             break;
         default:
             assert(0);
@@ -20,29 +20,72 @@
 #define VALUE_INCLUDED
 
 #include "buf.h"
+#include "interpreter.h"
+#include "arena.h"
+
+/*
+ * Per-owner state of a Lua or template value: its last result, and the
+ * compiled Lua code. The result may be reused while valid is set;
+ * value_invalidate_cached() clears it when an attribute it depends on
+ * changes. The compiled code is reused as long as the interpreter has not
+ * been cleaned up since, i.e., while generation matches.
+ */
+typedef struct {
+    char          *result;
+    int            valid;      /* result is up to date */
+    int            busy;       /* template being evaluated */
+    int            chunk;      /* registry reference to compiled Lua code */
+    interpreter_t *interp;     /* interpreter holding chunk */
+    unsigned long  generation; /* interpreter generation of chunk */
+} value_cache_t;
+
+typedef struct value_tpl_t value_tpl_t;
 
 typedef struct {
-    enum { VALUE_STRING, VALUE_LUA, VALUE_INT } type;
+    enum { VALUE_STRING, VALUE_LUA, VALUE_INT, VALUE_TPL } type;
     union {
-        char *lua;
-        int   integer;
+        char        *lua;
+        int          integer;
+        value_tpl_t *tpl;
     } source;
-    char *result;
+    char          *text;        /* result of string values */
+    char          *code;        /* precompiled Lua code, or null */
+    size_t         code_len;
+    int            is_volatile; /* result must never be reused */
+    int            is_folded;   /* string value computed from Lua code in source.lua */
+    int            refs;        /* number of owners */
+    int            in_arena;    /* allocated from an arena */
+    value_cache_t  cache;       /* cache used by value_eval() */
 } value_t;
 
 typedef struct {
-    buf_t   *buf;
-    value_t *current;
+    buf_t         *buf;
+    value_t       *current;
+    value_cache_t *cache;       /* cache of the value dumped, or null */
 } value_dump_info_t;
 
 extern value_t    *value_new_string(const char *);
 extern value_t    *value_new_lua(const char *);
+extern value_t    *value_new_volatile_lua(const char *);
 extern value_t    *value_new_int(int);
+extern value_t    *value_new_tpl(const char *);
 extern value_t    *value_new_auto(const char *);
+extern value_t    *value_new_auto_in(arena_t *, const char *);
+extern value_t    *value_new_compiled_in(arena_t *, const char *, const char *, size_t);
 extern value_t    *value_clone(value_t *);
+extern value_t    *value_ref(value_t *);
 extern void        value_free(value_t *);
-extern const char *value_eval(value_t *, void *, const char *);
-extern int         value_push(value_t *, void *, const char *);
+extern void        value_invalidate(value_t *);
+extern void        value_invalidate_cached(value_t *, value_cache_t *);
+extern const char *value_eval(value_t *, interpreter_t *, void *, const char *);
+extern int         value_push(value_t *, interpreter_t *, void *, const char *);
 extern void        value_dump(value_t *, value_dump_info_t *);
+extern int         value_compile(value_t *, lua_State *, buf_t *);
+extern int         value_fold(value_t *, arena_t *, interpreter_t *);
+extern void        value_cache_init(value_cache_t *);
+extern void        value_cache_share(value_cache_t *, value_cache_t *);
+extern void        value_cache_release(value_cache_t *);
+extern const char *value_eval_cached(value_t *, value_cache_t *, interpreter_t *, void *, const char *);
+extern int         value_push_cached(value_t *, value_cache_t *, interpreter_t *, void *, const char *);
 
 #endif /* VALUE_INCLUDED */
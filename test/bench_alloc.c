@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * benchmark the number of memory allocations and the time taken by
+ * pathcomp_new() and pathcomp_free(), as a function of the number of
+ * attributes in the configuration
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef __GLIBC__
+/* count calls to the allocator by interposing the functions of the C library */
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void  __libc_free(void *);
+
+static long allocations, frees;
+
+void *malloc(size_t size) { ++allocations; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { ++allocations; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { if (!p) ++allocations; return __libc_realloc(p, size); }
+void  free(void *p) { if (p) ++frees; __libc_free(p); }
+#define COUNTING 1
+#else
+static long allocations, frees;
+#define COUNTING 0
+#endif
+
+/* a section with three alternatives per attribute, one of them Lua code,
+ * which copies another section */
+static char *
+make_config(int natts)
+{
+    buf_t buf;
+    int j;
+    buf_init(&buf, 0);
+    buf_addf(&buf, "[bench.base]\n    root = /data\n    compose = lua { return self.attribute_0 }\n");
+    buf_addf(&buf, "[bench.alloc]\n    copy = bench.base\n");
+    for (j = 0; j < natts; j++) {
+        buf_addf(&buf, "    attribute_%d = lua { return self.root .. '/attribute_%d' }\n", j, j);
+        buf_addf(&buf, "    attribute_%d = second alternative\n", j);
+        buf_addf(&buf, "    attribute_%d = third alternative\n", j);
+    }
+    return buf_detach(&buf, NULL);
+}
+
+int
+main(void)
+{
+    int natts;
+    if (!COUNTING) printf("(allocations cannot be counted with this C library)\n");
+    printf("%10s %16s %16s %16s\n", "attributes", "allocations", "frees", "ns per composer");
+    for (natts = 10; natts <= 320; natts *= 2) {
+        pathcomp_ctx_t *ctx;
+        char *config;
+        long made = 0, a0, f0, a1, f1;
+        double t0, t1;
+        config = make_config(natts);
+        ctx = pathcomp_ctx_new();
+        pathcomp_ctx_add_config_from_string(ctx, config);
+        /* let the interpreter state and the metatable be created first */
+        pathcomp_free(pathcomp_ctx_new_composer(ctx, "bench.alloc"));
+        a0 = allocations;
+        f0 = frees;
+        pathcomp_free(pathcomp_ctx_new_composer(ctx, "bench.alloc"));
+        a1 = allocations;
+        f1 = frees;
+        t0 = now();
+        do {
+            pathcomp_free(pathcomp_ctx_new_composer(ctx, "bench.alloc"));
+            ++made;
+        } while ((t1 = now()) - t0 < 0.5);
+        printf("%10d %16ld %16ld %16.1f\n", natts, a1 - a0, f1 - f0, (t1 - t0) / made * 1e9);
+        pathcomp_ctx_free(ctx);
+        free(config);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark the file names of class test.archive (see test/.pathcomprc), with
+ * the Lua string library, with the built-in helpers, and with templates
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static const char *config = "\
+[bench.common]\n\
+    instrument = G2\n\
+    imager     = SEV1\n\
+    level      = 20\n\
+    resolution = BARG\n\
+    product    = SOL_M15_R50\n\
+    version    = V003\n\
+    extension  = .hdf.gz\n\
+\n\
+[bench.string]\n\
+    copy-from  = bench.common\n\
+    yyyy       = lua { return string.sub(self.slot,  1,  4) }\n\
+    mmdd       = lua { return string.sub(self.slot,  5,  8) }\n\
+    hhmm       = lua { return string.sub(self.slot,  9, 12) }\n\
+    ss         = lua { local ss = string.sub(self.slot, 13, 14); return #ss > 0 and ss or '00' }\n\
+    hhmmss     = lua { return self.hhmm .. self.ss }\n\
+    prefix     = lua { return string.format('%s_%s_L%s_%s_%s', self.instrument, self.imager, self.level, self.resolution, self.product) }\n\
+    filename   = lua { return self.prefix .. '_' .. self.yyyy .. self.mmdd .. '_' .. self.hhmmss .. '_' .. self.version .. self.extension }\n\
+\n\
+[bench.pc]\n\
+    copy-from  = bench.common\n\
+    prefix     = lua { return string.format('%s_%s_L%s_%s_%s', self.instrument, self.imager, self.level, self.resolution, self.product) }\n\
+    filename   = lua { return self.prefix .. '_' .. pc.date(self.slot, '%Y%m%d_%H%M%S') .. '_' .. self.version .. self.extension }\n\
+\n\
+[bench.tpl]\n\
+    copy-from  = bench.common\n\
+    prefix     = tpl { ${instrument}_${imager}_L${level}_${resolution}_${product} }\n\
+    filename   = tpl { ${prefix}_${date:slot:%Y%m%d_%H%M%S}_${version}${extension} }\n\
+";
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+bench(const char *class, long evals)
+{
+    pathcomp_t *c;
+    double t0, t1;
+    long i;
+    if (!(c = pathcomp_new(class))) abort();
+    t0 = now();
+    for (i = 0; i < evals; i++) {
+        pathcomp_set(c, "slot", i % 2 ? "200403011130" : "201512312359");
+        if (!pathcomp_eval_nocopy(c, "filename")) abort();
+    }
+    t1 = now();
+    pathcomp_free(c);
+    return (t1 - t0) / evals * 1e9;
+}
+
+int
+main(void)
+{
+    const long evals = 200000;
+    pathcomp_add_config_from_string(config);
+    printf("%16s %16s %16s\n", "ns with string", "ns with pc", "ns with tpl");
+    printf("%16.1f %16.1f %16.1f\n", bench("bench.string", evals), bench("bench.pc", evals),
+            bench("bench.tpl", evals));
+    pathcomp_cleanup();
+    return EXIT_SUCCESS;
+}
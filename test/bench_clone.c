@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * benchmark cloning a template composer object and overriding one attribute,
+ * as a function of the number of attributes; also reports the memory held by
+ * every clone, if the C library can tell
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#ifdef HAVE_MALLINFO2
+#include <malloc.h>
+#endif
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t
+heap_in_use(void)
+{
+#ifdef HAVE_MALLINFO2
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+/* a template with three alternatives per attribute, one of them Lua code */
+static pathcomp_t *
+make_template(int natts)
+{
+    pathcomp_t *c;
+    int j;
+    c = pathcomp_new("bench.clone");
+    for (j = 0; j < natts; j++) {
+        buf_t name, lua;
+        buf_init(&name, 0);
+        buf_init(&lua, 0);
+        buf_addf(&name, "attribute_%d", j);
+        buf_addf(&lua, "lua { return string.format('%%s/%%s', self.root or '/data', '%s') }", name.buf);
+        pathcomp_set(c, name.buf, lua.buf);
+        pathcomp_add(c, name.buf, "second alternative");
+        pathcomp_add(c, name.buf, "third alternative");
+        /* as the template would be after having been used */
+        if (!pathcomp_eval_nocopy(c, name.buf)) abort();
+        buf_release(&name);
+        buf_release(&lua);
+    }
+    return c;
+}
+
+int
+main(void)
+{
+    const int live = 1000;
+    int natts;
+    printf("%10s %16s %16s\n", "attributes", "ns per clone", "bytes per clone");
+    for (natts = 10; natts <= 320; natts *= 2) {
+        pathcomp_t *template, **clones;
+        long clones_made = 0;
+        size_t before, after;
+        double t0, t1;
+        int i;
+        template = make_template(natts);
+        clones = malloc(live * sizeof *clones);
+        t0 = now();
+        do {
+            for (i = 0; i < 100; i++) {
+                pathcomp_t *c = pathcomp_clone(template);
+                pathcomp_set(c, "root", "/scratch");
+                pathcomp_free(c);
+            }
+            clones_made += 100;
+        } while ((t1 = now()) - t0 < 0.5);
+        before = heap_in_use();
+        for (i = 0; i < live; i++) clones[i] = pathcomp_clone(template);
+        after = heap_in_use();
+        for (i = 0; i < live; i++) pathcomp_free(clones[i]);
+        printf("%10d %16.1f %16zu\n", natts, (t1 - t0) / clones_made * 1e9, (after - before) / live);
+        free(clones);
+        pathcomp_free(template);
+    }
+    pathcomp_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark reading a large configuration file and evaluating one Lua value in
+ * it, from the file itself and from its compiled image
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+read_and_eval(const char *filename)
+{
+    pathcomp_t *c;
+    pathcomp_add_config_from_file(filename);
+    if (!(c = pathcomp_new("bench.product.1000"))) abort();
+    pathcomp_set(c, "version", "1");
+    if (!pathcomp_eval_nocopy(c, "compose")) abort();
+    pathcomp_free(c);
+    pathcomp_cleanup();
+}
+
+int
+main(void)
+{
+    const char *filename = "bench_config.tmp";
+    const int repeat = 20;
+    buf_t text, image;
+    FILE *fp;
+    double t0, t1, t2;
+    int i;
+    buf_init(&text, 0);
+    for (i = 0; text.len < 5 * 1024 * 1024; i++) {
+        buf_addf(&text, "[bench.product.%d]\n", i);
+        buf_addf(&text, "    copy-from   = bench.common\n");
+        buf_addf(&text, "    product     = P%d\n", i);
+        buf_addf(&text, "    description = product %d, generated for the benchmark of\\\n"
+                        "                  reading configuration files\n", i);
+        buf_addf(&text, "    compose     = lua { return self.product .. '/' .. self.version .. '/' .. self.description }\n");
+        buf_addf(&text, "    ; version is set by the caller\n\n");
+    }
+    if (!(fp = fopen(filename, "w")) || fwrite(text.buf, 1, text.len, fp) != text.len
+            || fclose(fp)) {
+        perror(filename);
+        return EXIT_FAILURE;
+    }
+    t0 = now();
+    for (i = 0; i < repeat; i++) read_and_eval(filename);
+    t1 = now();
+    if (!pathcomp_compile_config(filename, NULL)) return EXIT_FAILURE;
+    for (i = 0; i < repeat; i++) read_and_eval(filename);
+    t2 = now();
+    printf("%10s %16s %16s\n", "MB", "ms from file", "ms from image");
+    printf("%10.1f %16.2f %16.2f\n", text.len / 1048576.0, (t1 - t0) / repeat * 1e3,
+            (t2 - t1) / repeat * 1e3);
+    unlink(filename);
+    buf_init(&image, 0);
+    buf_addf(&image, "%s.pcc", filename);
+    unlink(image.buf);
+    buf_release(&image);
+    buf_release(&text);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * benchmark pathcomp_find() with and without the directory cache, on a
+ * directory tree where only few of the combinations exist
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define NDIRS  50
+#define NFILES 200
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+sweep(pathcomp_t *c, int repeat, int *found)
+{
+    double t0 = now();
+    int i;
+    *found = 0;
+    for (i = 0; i < repeat; i++) {
+        char *path;
+        pathcomp_rewind(c);
+        while ((path = pathcomp_find(c))) {
+            ++*found;
+            free(path);
+        }
+    }
+    return now() - t0;
+}
+
+int
+main(void)
+{
+    const int repeat = 5;
+    char root[] = "/tmp/bench_dircache.XXXXXX";
+    pathcomp_t *c;
+    buf_t buf;
+    double t_stat, t_cache;
+    int i, j, found_stat, found_cache;
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    /* every directory contains the files with an even number */
+    buf_init(&buf, 0);
+    for (i = 0; i < NDIRS; i++) {
+        buf_setlen(&buf, 0);
+        buf_addf(&buf, "%s/d%03d", root, i);
+        if (mkdir(buf.buf, S_IRWXU) == -1) perror("mkdir");
+        for (j = 0; j < NFILES; j += 2) {
+            FILE *fp;
+            buf_setlen(&buf, 0);
+            buf_addf(&buf, "%s/d%03d/f%04d", root, i, j);
+            if ((fp = fopen(buf.buf, "w"))) fclose(fp);
+        }
+    }
+    c = pathcomp_new("bench.dircache");
+    pathcomp_set(c, "root", root);
+    pathcomp_set(c, "compose", "lua { return string.format('d%03d/f%04d', self.dir, self.file) }");
+    for (i = 0; i < NDIRS; i++) pathcomp_add_int(c, "dir", i);
+    for (j = 0; j < NFILES; j++) pathcomp_add_int(c, "file", j);
+    t_stat = sweep(c, repeat, &found_stat);
+    pathcomp_set_dircache_ttl(-1);
+    t_cache = sweep(c, repeat, &found_cache);
+    pathcomp_set_dircache_ttl(0);
+    if (found_stat != found_cache) {
+        fprintf(stderr, "mismatch: %d found with stat, %d with cache\n", found_stat, found_cache);
+        return EXIT_FAILURE;
+    }
+    printf("%12s %16s %16s\n", "pathnames", "ns with stat", "ns with cache");
+    printf("%12d %16.1f %16.1f\n", NDIRS * NFILES,
+            t_stat / (repeat * NDIRS * NFILES) * 1e9,
+            t_cache / (repeat * NDIRS * NFILES) * 1e9);
+    pathcomp_free(c);
+    pathcomp_cleanup();
+    for (i = 0; i < NDIRS; i++) {
+        for (j = 0; j < NFILES; j += 2) {
+            buf_setlen(&buf, 0);
+            buf_addf(&buf, "%s/d%03d/f%04d", root, i, j);
+            unlink(buf.buf);
+        }
+        buf_setlen(&buf, 0);
+        buf_addf(&buf, "%s/d%03d", root, i);
+        rmdir(buf.buf);
+    }
+    rmdir(root);
+    buf_release(&buf);
+    return EXIT_SUCCESS;
+}
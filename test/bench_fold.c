@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark evaluating a file name that depends on Lua values that are
+ * constants, in fresh composer objects
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(void)
+{
+    const long composers = 200000;
+    pathcomp_t *c;
+    double t0, t1;
+    long i;
+    pathcomp_add_config_from_string("\
+[bench.fold]\n\
+    root      = lua { return '/data/' .. 'archive' }\n\
+    version   = lua { return string.format('V%03d', 3) }\n\
+    level     = lua { return 10 * 2 }\n\
+    extension = lua { return table.concat({ '', 'hdf', 'gz' }, '.') }\n\
+    filename  = lua { return self.root .. '/L' .. self.level .. '/' .. self.slot .. '_' .. self.version .. self.extension }\n\
+");
+    t0 = now();
+    for (i = 0; i < composers; i++) {
+        if (!(c = pathcomp_new("bench.fold"))) abort();
+        pathcomp_set(c, "slot", "200403011130");
+        if (!pathcomp_eval_nocopy(c, "filename")) abort();
+        pathcomp_free(c);
+    }
+    t1 = now();
+    printf("%16s\n", "ns per composer");
+    printf("%16.1f\n", (t1 - t0) / composers * 1e9);
+    pathcomp_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark attribute lookup by name and by handle, as a function of the number
+ * of attributes
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(void)
+{
+    const long lookups = 2000000;
+    int natts;
+    printf("%10s %16s %16s\n", "attributes", "ns by name", "ns by handle");
+    for (natts = 10; natts <= 1280; natts *= 2) {
+        pathcomp_t *c;
+        char **names;
+        pathcomp_handle_t *handles;
+        double t0, t1, t2;
+        long i;
+        int j;
+        c = pathcomp_new("bench.lookup");
+        names = malloc(natts * sizeof *names);
+        handles = malloc(natts * sizeof *handles);
+        for (j = 0; j < natts; j++) {
+            buf_t buf;
+            buf_init(&buf, 0);
+            buf_addf(&buf, "attribute_%d", j);
+            names[j] = buf_detach(&buf, NULL);
+            pathcomp_set(c, names[j], "value");
+            handles[j] = pathcomp_lookup(c, names[j]);
+        }
+        t0 = now();
+        for (i = 0; i < lookups; i++) {
+            if (!pathcomp_eval_nocopy(c, names[i % natts])) abort();
+        }
+        t1 = now();
+        for (i = 0; i < lookups; i++) {
+            if (!pathcomp_eval_nocopy_h(c, handles[i % natts])) abort();
+        }
+        t2 = now();
+        printf("%10d %16.1f %16.1f\n", natts, (t1 - t0) / lookups * 1e9,
+                (t2 - t1) / lookups * 1e9);
+        for (j = 0; j < natts; j++) free(names[j]);
+        free(names);
+        free(handles);
+        pathcomp_free(c);
+    }
+    pathcomp_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark reading the configuration and instantiating every class, as a
+ * function of the number of sections
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int
+main(void)
+{
+    int nsec;
+    printf("%10s %16s %16s\n", "sections", "ns to read", "ns to create");
+    for (nsec = 100; nsec <= 12800; nsec *= 2) {
+        buf_t text;
+        double t0, t1, t2;
+        int j;
+        buf_init(&text, 0);
+        buf_addstr(&text, "[bench.common]\nroot = /data\ncompose = lua { product .. '/' .. version }\n");
+        for (j = 0; j < nsec; j++) {
+            buf_addf(&text, "[bench.product.%d]\ncopy-from = bench.common\nproduct = P%d\nversion = 1\n", j, j);
+        }
+        t0 = now();
+        pathcomp_add_config_from_string(text.buf);
+        t1 = now();
+        for (j = 0; j < nsec; j++) {
+            pathcomp_t *c;
+            char name[32];
+            snprintf(name, sizeof name, "bench.product.%d", j);
+            if (!(c = pathcomp_new(name))) abort();
+            pathcomp_free(c);
+        }
+        t2 = now();
+        printf("%10d %16.1f %16.1f\n", nsec, (t1 - t0) / nsec * 1e9,
+                (t2 - t1) / nsec * 1e9);
+        buf_release(&text);
+        pathcomp_cleanup();
+    }
+    return EXIT_SUCCESS;
+}
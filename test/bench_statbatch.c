@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/*
+ * benchmark existence checks of pathnames spread over many directories: one
+ * stat() at a time, or in batches through io_uring or a thread pool; and
+ * pathcomp_find() without and with batching
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include "statbatch.h"
+#include "buf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define NDIRS  2000
+#define NFILES 4     /* candidates per directory, of which one exists */
+#define WINDOW 64
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+time_stat(const char **paths, size_t n, int *found)
+{
+    struct stat statbuf;
+    double t0 = now();
+    size_t i;
+    *found = 0;
+    for (i = 0; i < n; i++) *found += stat(paths[i], &statbuf) == 0;
+    return now() - t0;
+}
+
+static double
+time_batch(statbatch_t *batch, const char **paths, size_t n, int *found)
+{
+    int exists[WINDOW];
+    double t0 = now();
+    size_t i, j, k;
+    *found = 0;
+    for (i = 0; i < n; i += k) {
+        k = n - i < WINDOW ? n - i : WINDOW;
+        statbatch_exists(batch, paths + i, k, exists);
+        for (j = 0; j < k; j++) *found += exists[j];
+    }
+    return now() - t0;
+}
+
+static double
+time_find(pathcomp_t *c, size_t window, int *found)
+{
+    double t0 = now();
+    char *path;
+    pathcomp_set_find_batch(window);
+    pathcomp_rewind(c);
+    *found = 0;
+    while ((path = pathcomp_find(c))) {
+        ++*found;
+        free(path);
+    }
+    return now() - t0;
+}
+
+static void
+report(const char *what, double t, int found, size_t n)
+{
+    printf("%-24s %10d %12.1f\n", what, found, t / n * 1e9);
+}
+
+int
+main(void)
+{
+    const size_t n = NDIRS * NFILES;
+    char root[] = "/tmp/bench_statbatch.XXXXXX";
+    char **paths;
+    statbatch_t *batch;
+    pathcomp_t *c;
+    buf_t buf;
+    double t;
+    int i, j, found;
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    paths = malloc(n * sizeof *paths);
+    c = pathcomp_new("bench.statbatch");
+    pathcomp_set(c, "root", root);
+    buf_init(&buf, 0);
+    for (i = 0; i < NDIRS; i++) {
+        FILE *fp;
+        buf_setlen(&buf, 0);
+        buf_addf(&buf, "%s/d%04d", root, i);
+        if (mkdir(buf.buf, S_IRWXU) == -1) perror("mkdir");
+        buf_addstr(&buf, "/f0");
+        if ((fp = fopen(buf.buf, "w"))) fclose(fp);
+        for (j = 0; j < NFILES; j++) {
+            buf_setlen(&buf, 0);
+            buf_addf(&buf, "%s/d%04d/f%d", root, i, j);
+            paths[i * NFILES + j] = strdup(buf.buf);
+            pathcomp_add(c, "compose", paths[i * NFILES + j] + strlen(root) + 1);
+        }
+    }
+    printf("%-24s %10s %12s\n", "", "found", "ns per path");
+    /* warm up the dentry cache */
+    time_stat((const char **) paths, n, &found);
+    t = time_stat((const char **) paths, n, &found);
+    report("stat", t, found, n);
+    batch = statbatch_new(WINDOW, STATBATCH_USE_URING);
+    t = time_batch(batch, (const char **) paths, n, &found);
+    report(statbatch_backend(batch), t, found, n);
+    statbatch_free(batch);
+    batch = statbatch_new(WINDOW, 0);
+    t = time_batch(batch, (const char **) paths, n, &found);
+    report(statbatch_backend(batch), t, found, n);
+    statbatch_free(batch);
+    t = time_find(c, 0, &found);
+    report("pathcomp_find", t, found, n);
+    t = time_find(c, WINDOW, &found);
+    report("pathcomp_find, batched", t, found, n);
+    pathcomp_free(c);
+    pathcomp_cleanup();
+    for (i = 0; i < NDIRS; i++) {
+        buf_setlen(&buf, 0);
+        buf_addf(&buf, "%s/d%04d/f0", root, i);
+        unlink(buf.buf);
+        buf_setlen(&buf, 0);
+        buf_addf(&buf, "%s/d%04d", root, i);
+        rmdir(buf.buf);
+    }
+    rmdir(root);
+    for (i = 0; i < (int) n; i++) free(paths[i]);
+    free(paths);
+    buf_release(&buf);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * benchmark evaluating string interpolation written as Lua code and as a
+ * template
+ */
+
+#include <config.h>
+#include "pathcomp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double
+bench(pathcomp_t *c, const char *att, long evals)
+{
+    double t0, t1;
+    long i;
+    t0 = now();
+    for (i = 0; i < evals; i++) {
+        /* changing the slot forces the interpolation to be evaluated again */
+        pathcomp_set(c, "slot", i % 2 ? "200403011130" : "201512312359");
+        if (!pathcomp_eval_nocopy(c, att)) abort();
+    }
+    t1 = now();
+    return (t1 - t0) / evals * 1e9;
+}
+
+int
+main(void)
+{
+    const long evals = 500000;
+    pathcomp_t *c;
+    pathcomp_add_config_from_string("\
+[bench.tpl]\n\
+    instrument = G2\n\
+    imager     = SEV1\n\
+    lua        = lua { return string.format('%s_%s_%s_%s', self.instrument, self.imager, string.sub(self.slot, 1, 8), string.sub(self.slot, 9, 12)) }\n\
+    tpl        = tpl { ${instrument}_${imager}_${slot[1,8]}_${slot[9,12]} }\n\
+");
+    if (!(c = pathcomp_new("bench.tpl"))) abort();
+    printf("%16s %16s\n", "ns with Lua", "ns with tpl");
+    printf("%16.1f %16.1f\n", bench(c, "lua", evals), bench(c, "tpl", evals));
+    pathcomp_free(c);
+    pathcomp_cleanup();
+    return EXIT_SUCCESS;
+}
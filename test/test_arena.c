@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/* test arena.c */
+
+#include <config.h>
+#include "tap.h"
+#include "arena.h"
+#include <stdint.h>
+#include <string.h>
+
+static void
+test_basic(void)
+{
+    arena_t *arena;
+    char *s, *t;
+    double *d;
+    ok(arena = arena_new(0, NULL), "arena_new()");
+    ok(s = arena_strdup(arena, "abc"), "arena_strdup()");
+    is(s, "abc");
+    ok(t = arena_strndup(arena, "defgh", 2), "arena_strndup()");
+    is(t, "de");
+    is(s, "abc", "earlier allocations are left alone");
+    ok(d = arena_alloc(arena, sizeof *d));
+    cmp_ok((uintptr_t) d % sizeof *d, "==", 0, "allocations are aligned");
+    *d = 1.5;
+    ok(arena_alloc(arena, 0) != NULL, "zero-size allocation");
+    arena_release(arena);
+}
+
+static void
+test_many(void)
+{
+    arena_t *arena;
+    char *p[1000];
+    int i, allocated = 1, intact = 1, distinct = 1;
+    ok(arena = arena_new(0, NULL));
+    for (i = 0; i < 1000; i++) {
+        if (!(p[i] = arena_alloc(arena, 100 + i))) allocated = 0;
+        else memset(p[i], i % 256, 100 + i);
+    }
+    ok(allocated);
+    for (i = 0; i < 1000 && allocated; i++) {
+        if ((unsigned char) p[i][0] != i % 256 || (unsigned char) p[i][99 + i] != i % 256) intact = 0;
+        if (i && p[i] == p[i - 1]) distinct = 0;
+    }
+    ok(intact, "arena grows as needed, without moving allocations");
+    ok(distinct);
+    ok(p[0] = arena_alloc(arena, 1 << 20), "allocation larger than any chunk");
+    memset(p[0], 0, 1 << 20);
+    arena_release(arena);
+}
+
+static void
+test_refs(void)
+{
+    arena_t *parent, *child;
+    char *s;
+    ok(parent = arena_new(100, NULL));
+    ok(s = arena_strdup(parent, "kept alive"));
+    ok(arena_ref(parent) == parent, "arena_ref()");
+    arena_release(parent);
+    is(s, "kept alive", "arena survives while referenced");
+    ok(child = arena_new(100, parent), "arena with parent");
+    arena_release(parent);
+    is(s, "kept alive", "parent kept alive by child");
+    arena_release(child);
+    arena_release(NULL);
+    pass("arena_release(NULL)");
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    test_basic();
+    test_many();
+    test_refs();
+    done_testing();
+}
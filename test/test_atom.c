@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test atom.c */
+
+#include <config.h>
+#include "tap.h"
+#include "atom.h"
+#include <string.h>
+
+int
+main(void)
+{
+    const char *a, *b;
+    char s[] = "name";
+    plan(NO_PLAN);
+    ok(!atom_lookup("name"), "no atom yet");
+    ok(a = atom_string(s), "atom_string()");
+    is(a, "name");
+    ok(a != s, "atom is a copy");
+    ok(atom_string("name") == a, "same contents, same atom");
+    ok(atom_lookup("name") == a, "atom_lookup()");
+    strcpy(s, "nope");
+    is(a, "name", "atom does not change with original");
+    ok(b = atom_string(""), "empty atom");
+    ok(b != a);
+    ok(atom_string("") == b);
+    ok(!atom_lookup("nam"));
+    done_testing();
+}
@@ -24,13 +24,16 @@
 #include "att.h"
 #include "interpreter.h"
 #include <string.h>
+#include <stdio.h>
+
+static interpreter_t *interp;
 
 static void
 test_1element(void)
 {
     att_t *att;
     ok(att = att_new("key", value_new_string("value"), "origin"), "att_new()");
-    is(att_eval(att, NULL, NULL), "value", "att_eval()");
+    is(att_eval(att, interp, NULL, NULL), "value", "att_eval()");
     ok(att_name_equal_to(att, "key"), "att_name_equal_to()");
     ok(!att_name_equal_to(att, "clef"));
     is(att_get_origin(att), "origin", "att_get_origin()");
@@ -38,7 +41,7 @@ test_1element(void)
     att_rewind(att);
     ok(!att_next(att), "rewind single element");
     att_replace_value(att, value_new_string("some_other"), "somewhere_else");
-    is(att_eval(att, NULL, NULL), "some_other", "replace value");
+    is(att_eval(att, interp, NULL, NULL), "some_other", "replace value");
     is(att_get_origin(att), "somewhere_else");
     att_free(att);
 }
@@ -48,17 +51,17 @@ test_2elements(void)
 {
     att_t *att;
     ok(att = att_new("key1", value_new_string("value1"), NULL));
-    is(att_eval(att, NULL, NULL), "value1");
+    is(att_eval(att, interp, NULL, NULL), "value1");
     att_add_value(att, value_new_string("value2"));
-    is(att_eval(att, NULL, NULL), "value1", "add_value() doesn't advance current alternative");
+    is(att_eval(att, interp, NULL, NULL), "value1", "add_value() doesn't advance current alternative");
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "value2", "att_next()");
+    is(att_eval(att, interp, NULL, NULL), "value2", "att_next()");
     ok(!att_next(att), "end of alternatives");
     ok(!att_next(att), "att_next() doesn't recycle");
     att_rewind(att);
-    is(att_eval(att, NULL, NULL), "value1", "rewind");
+    is(att_eval(att, interp, NULL, NULL), "value1", "rewind");
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "value2");
+    is(att_eval(att, interp, NULL, NULL), "value2");
     ok(!att_next(att));
     att_free(att);
 }
@@ -71,39 +74,104 @@ test_4elements(void)
     att_add_value(att, value_new_string("value2"));
     att_add_value(att, value_new_lua("return 'value' .. 3"));
     att_add_value(att, value_new_string("value4"));
-    is(att_eval(att, NULL, NULL), "value1");
+    is(att_eval(att, interp, NULL, NULL), "value1");
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "value2");
+    is(att_eval(att, interp, NULL, NULL), "value2");
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "value3");
+    is(att_eval(att, interp, NULL, NULL), "value3");
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "value4");
+    is(att_eval(att, interp, NULL, NULL), "value4");
     ok(!att_next(att));
     ok(!att_next(att));
     is(att_get_origin(att), "Orig");
     att_replace_value(att, value_new_string("value_99"), "Air");
-    is(att_eval(att, NULL, NULL), "value_99");
+    is(att_eval(att, interp, NULL, NULL), "value_99");
     ok(!att_next(att), "at end of list (all alternatives exhausted)");
     ok(!att_next(att));
     is(att_get_origin(att), "Air");
     att_add_value(att, value_new_string("XYZ"));
     ok(!att_next(att), "att_add_value() doesn't rewind");
-    is(att_eval(att, NULL, NULL), NULL);
+    is(att_eval(att, interp, NULL, NULL), NULL);
     att_rewind(att);
-    is(att_eval(att, NULL, NULL), "value_99");
+    is(att_eval(att, interp, NULL, NULL), "value_99");
+    ok(att_next(att));
+    is(att_eval(att, interp, NULL, NULL), "XYZ", "need to rewind to access newly added alternative");
+    ok(!att_next(att));
+    att_free(att);
+}
+
+static void
+test_clone(void)
+{
+    att_t *att, *clone;
+    value_t *val;
+    ok(att = att_new("key", val = value_new_string("value1"), "Orig"));
+    att_add_value(att, value_new_lua("return 'value' .. 2"));
     ok(att_next(att));
-    is(att_eval(att, NULL, NULL), "XYZ", "need to rewind to access newly added alternative");
+    is(att_eval(att, interp, NULL, NULL), "value2");
+    ok(clone = att_clone(att));
+    cmp_ok(val->refs, "==", 1, "values are not copied by att_clone()");
+    is(att_eval(clone, interp, NULL, NULL), "value2", "clone at same alternative");
+    is(att_get_origin(clone), "Orig");
+    att_add_value(clone, value_new_string("value3"));
+    cmp_ok(val->refs, "==", 2, "but shared when the clone adds a value");
+    cmp_ok(att_count(clone), "==", 3);
+    cmp_ok(att_count(att), "==", 2, "original unaffected");
+    ok(att_next(clone));
+    is(att_eval(clone, interp, NULL, NULL), "value3");
     ok(!att_next(att));
+    att_replace_value(att, value_new_string("value_99"), "Air");
+    cmp_ok(val->refs, "==", 1, "and no longer shared when the original replaces its values");
+    is(att_eval(att, interp, NULL, NULL), "value_99");
+    att_rewind(clone);
+    is(att_eval(clone, interp, NULL, NULL), "value1", "clone unaffected");
+    is(att_get_origin(clone), "Orig");
+    att_free(att);
+    ok(att_next(clone));
+    is(att_eval(clone, interp, NULL, NULL), "value2", "clone outlives original");
+    att_free(clone);
+}
+
+static void
+test_arena(void)
+{
+    arena_t *arena, *clone_arena;
+    att_t *att, *clone;
+    int i;
+    ok(arena = arena_new(0, NULL));
+    ok(att = att_new_in(arena, "key", value_new_auto_in(arena, "value0"), "Orig"));
+    for (i = 1; i < 10; i++) {
+        char text[32];
+        sprintf(text, "lua { return 'value' .. %d }", i);
+        att_add_value(att, value_new_auto_in(arena, text));
+    }
+    cmp_ok(att_count(att), "==", 10, "alternatives grow in the arena");
+    ok(clone_arena = arena_new(0, arena));
+    ok(clone = att_clone_in(clone_arena, att));
     att_free(att);
+    arena_release(arena);
+    note("original and its arena released");
+    att_add_value(clone, value_new_string("value10"));
+    cmp_ok(att_count(clone), "==", 11, "clone adds to alternatives of another arena");
+    for (i = 0; i < 9; i++) att_next(clone);
+    is(att_eval(clone, interp, NULL, NULL), "value9");
+    ok(att_next(clone));
+    is(att_eval(clone, interp, NULL, NULL), "value10");
+    is(att_get_origin(clone), "Orig");
+    att_free(clone);
+    arena_release(clone_arena);
 }
 
 int
 main(void)
 {
     plan(NO_PLAN);
+    interp = interpreter_new();
     test_1element();
     test_2elements();
     test_4elements();
-    interpreter_cleanup();
+    test_clone();
+    test_arena();
+    interpreter_free(interp);
     done_testing();
 }
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2015, 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test built-in helpers, from Lua and from templates */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include "builtin.h"
+#include "buf.h"
+#include <stdlib.h>
+
+const char *config = "\
+[test.builtin]\n\
+    slot       = 200403011130\n\
+    number     = 7\n\
+    sub        = lua { return pc.sub(self.slot, 5, 8) }\n\
+    tail       = lua { return pc.sub(self.slot, -4) }\n\
+    zeros      = lua { return pc.pad(self.number, 3, '0') }\n\
+    right      = lua { return pc.pad('ab', -4) .. '|' }\n\
+    date       = lua { return pc.date(self.slot, '%Y/%j/%H%M') }\n\
+    weekday    = lua { return pc.date(string.sub(self.slot, 1, 8), '%a') }\n\
+    bad_date   = lua { return pc.date('2004133', '%Y') }\n\
+    home       = lua { return pc.env('TEST_BUILTIN_HOME') }\n\
+    unset      = lua { return tostring(pc.env('TEST_BUILTIN_UNSET')) }\n\
+    tpl_date   = tpl { ${date:slot:%Y/%j} }\n\
+    tpl_env    = tpl { ${env:TEST_BUILTIN_HOME}/data }\n\
+    tpl_sub    = tpl { ${env:TEST_BUILTIN_HOME[2,4]%-5}| }\n\
+    tpl_unset  = tpl { ${env:TEST_BUILTIN_UNSET} }\n\
+    tpl_bad    = tpl { ${date:number:%Y} }\n\
+    tpl_func   = tpl { ${nope:slot} }\n\
+";
+
+static void
+test_date(void)
+{
+    buf_t buf;
+    note("time stamps");
+    buf_init(&buf, 0);
+    ok(builtin_date(&buf, "20040301", "%Y-%m-%d %H:%M:%S %j %a"));
+    is(buf.buf, "2004-03-01 00:00:00 061 Mon", "date only");
+    buf_setlen(&buf, 0);
+    ok(builtin_date(&buf, "20151231235960", "%j %H%M%S %A"));
+    is(buf.buf, "365 235960 Thursday", "date and time");
+    buf_setlen(&buf, 0);
+    ok(builtin_date(&buf, "2000022912", "%j %H %a"));
+    is(buf.buf, "060 12 Tue", "leap year");
+    buf_setlen(&buf, 0);
+    ok(builtin_date(&buf, "20040301", ""));
+    is(buf.buf, "", "empty format");
+    ok(!builtin_date(&buf, "2004030", "%Y"), "too short");
+    ok(!builtin_date(&buf, "200403011", "%Y"), "odd number of digits");
+    ok(!builtin_date(&buf, "20041301", "%Y"), "bad month");
+    ok(!builtin_date(&buf, "19000229", "%Y"), "not a leap year");
+    ok(!builtin_date(&buf, "20040301x", "%Y"), "trailing garbage");
+    buf_release(&buf);
+}
+
+static void
+test_lua(void)
+{
+    pathcomp_t *c = NULL;
+    note("from Lua");
+    ok(c = pathcomp_new("test.builtin"));
+    is(pathcomp_eval_nocopy(c, "sub"), "0301");
+    is(pathcomp_eval_nocopy(c, "tail"), "1130");
+    is(pathcomp_eval_nocopy(c, "zeros"), "007");
+    is(pathcomp_eval_nocopy(c, "right"), "ab  |");
+    is(pathcomp_eval_nocopy(c, "date"), "2004/061/1130");
+    is(pathcomp_eval_nocopy(c, "weekday"), "Mon");
+    is(pathcomp_eval_nocopy(c, "bad_date"), NULL, "malformed time stamp is an error");
+    is(pathcomp_eval_nocopy(c, "home"), "/home/test");
+    is(pathcomp_eval_nocopy(c, "unset"), "nil");
+    pathcomp_free(c);
+}
+
+static void
+test_tpl(void)
+{
+    pathcomp_t *c = NULL;
+    note("from templates");
+    ok(c = pathcomp_new("test.builtin"));
+    is(pathcomp_eval_nocopy(c, "tpl_date"), "2004/061");
+    is(pathcomp_eval_nocopy(c, "tpl_env"), "/home/test/data");
+    is(pathcomp_eval_nocopy(c, "tpl_sub"), "hom  |");
+    is(pathcomp_eval_nocopy(c, "tpl_unset"), NULL, "unset variable is an error");
+    is(pathcomp_eval_nocopy(c, "tpl_bad"), NULL, "malformed time stamp is an error");
+    is(pathcomp_eval_nocopy(c, "tpl_func"), NULL, "unknown function");
+    pathcomp_set(c, "slot", "20151231");
+    is(pathcomp_eval_nocopy(c, "tpl_date"), "2015/365", "date follows attribute");
+    pathcomp_free(c);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    setenv("TEST_BUILTIN_HOME", "/home/test", 1);
+    unsetenv("TEST_BUILTIN_UNSET");
+    pathcomp_add_config_from_string(config);
+    test_date();
+    test_lua();
+    test_tpl();
+    pathcomp_cleanup();
+    done_testing();
+}
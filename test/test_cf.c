@@ -21,7 +21,10 @@
 #include <config.h>
 #include "tap.h"
 #include "cf.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 static void
 test1(void)
@@ -207,6 +210,186 @@ do we allow non-identifier characters?           =  definitely!\n\
     cf_free(cf);
 }
 
+static void
+test_find_sections(void)
+{
+    cf_t         *cf;
+    list_t       *psec;
+    cf_section_t *sec;
+    cf_kv_t      *kv;
+
+    note("finding sections by name");
+    ok(cf = cf_new());
+    ok(!cf_find_sections(cf, "test.dup"), "no sections in empty config");
+    ok(cf_add_from_string(cf, "[test.dup]\n key = 1\n[test.other]\n key = 2\n[test.dup]\n key = 3\n"), "parses ok");
+    ok(cf_add_from_string(cf, "[test.dup]\n key = 4\n"), "parses ok");
+    ok(psec = cf_find_sections(cf, "test.dup"));
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->value, "1", "first section in order of appearance");
+    ok(psec = psec->next);
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->value, "3", "duplicate section in same string");
+    ok(psec = psec->next);
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->value, "4", "duplicate section added later");
+    ok(!psec->next, "no more sections");
+    ok(psec = cf_find_sections(cf, "test.other"));
+    ok(!psec->next);
+    ok(!cf_find_sections(cf, "test.missing"), "missing section");
+    ok(!cf_find_sections(cf, "test"), "no prefix match");
+    ok(list_length(cf->sections) == 4, "all sections in list");
+    ok(cf->last && !cf->last->next && cf->last->el == sec, "last points to last section");
+    cf_free(cf);
+}
+
+static void
+write_file(const char *filename, const char *text, size_t len)
+{
+    FILE *fp;
+    fp = fopen(filename, "w");
+    if (!fp || fwrite(text, 1, len, fp) != len || fclose(fp)) {
+        perror(filename);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void
+test_file(void)
+{
+    cf_t         *cf;
+    list_t       *psec, *pkv;
+    cf_section_t *sec;
+    cf_kv_t      *kv;
+    const char   *filename = "test_cf.tmp";
+    const char   *text = "\
+[test.file]\n\
+    joined   = first \\\n\
+               second\n\
+    literal  = ends in \\\\\n\
+    next     = value   \n\
+[test.file]\n\
+    last     = no newline";
+    char         *big;
+    size_t        len;
+
+    note("reading from file");
+    write_file(filename, text, strlen(text));
+    ok(cf = cf_new());
+    ok(cf_add_from_file(cf, filename), "parses ok");
+    ok(psec = cf_find_sections(cf, "test.file"));
+    ok(sec = psec->el);
+    ok(pkv = sec->entries);
+    ok(kv = pkv->el);
+    is(kv->key, "joined");
+    is(kv->value, "first                second", "backslash continuation");
+    ok(pkv = pkv->next);
+    ok(kv = pkv->el);
+    is(kv->key, "literal");
+    is(kv->value, "ends in \\\\", "even number of backslashes does not continue");
+    ok(pkv = pkv->next);
+    ok(kv = pkv->el);
+    is(kv->key, "next");
+    is(kv->value, "value", "trailing spaces trimmed");
+    ok(!pkv->next);
+    ok(psec = psec->next);
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->key, "last");
+    is(kv->value, "no newline", "value at end of file");
+    cf_free(cf);
+
+    note("file filling its last page exactly");
+    len = 2 * sysconf(_SC_PAGESIZE);
+    big = malloc(len);
+    memset(big, ' ', len);
+    memcpy(big, "[test.big]\n", 11);
+    memcpy(big + len - 9, "key = end", 9);
+    write_file(filename, big, len);
+    free(big);
+    ok(cf = cf_new());
+    ok(cf_add_from_file(cf, filename), "parses ok");
+    ok(psec = cf_find_sections(cf, "test.big"));
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->key, "key");
+    is(kv->value, "end");
+    cf_free(cf);
+    unlink(filename);
+
+    note("missing file");
+    ok(cf = cf_new());
+    ok(!cf_add_from_file(cf, "test_cf.does.not.exist"), "fails");
+    ok(!cf->sections);
+    cf_free(cf);
+}
+
+static void
+test_compile(void)
+{
+    cf_t         *cf;
+    list_t       *psec, *pkv;
+    cf_section_t *sec;
+    cf_kv_t      *kv;
+    const char   *filename = "test_cf_compile.tmp";
+    const char   *text = "\
+[test.compile]\n\
+    plain  = value\n\
+    code   = lua { return 'a' .. \\\n\
+                   'b' }\n\
+[test.other]\n\
+[test.compile]\n\
+    more   = 1\n";
+
+    note("compiled configuration");
+    write_file(filename, text, strlen(text));
+    ok(cf_compile(filename, NULL), "compiles");
+    ok(access("test_cf_compile.tmp.pcc", R_OK) == 0, "image written next to file");
+    ok(cf = cf_new());
+    ok(cf_add_from_file(cf, filename), "loads ok");
+    ok(list_length(cf->sections) == 3, "all sections present");
+    ok(psec = cf_find_sections(cf, "test.compile"));
+    ok(sec = psec->el);
+    is(sec->name, "test.compile");
+    ok(pkv = sec->entries);
+    ok(kv = pkv->el);
+    is(kv->key, "plain");
+    is(kv->value, "value");
+    ok(!kv->code, "no code for string value");
+    ok(pkv = pkv->next);
+    ok(kv = pkv->el);
+    is(kv->key, "code");
+    is(kv->value, "lua { return 'a' .. " "                   'b' }", "continued value");
+    ok(kv->code && kv->code_len > 0, "code for Lua value");
+    ok(!pkv->next);
+    ok(psec = psec->next);
+    ok(sec = psec->el);
+    ok(kv = sec->entries->el);
+    is(kv->key, "more");
+    ok(!psec->next);
+    ok(sec = cf_find_sections(cf, "test.other")->el);
+    ok(!sec->entries, "empty section");
+    cf_free(cf);
+
+    note("image of a modified file is not used");
+    write_file(filename, "[test.compile]\n", 15);
+    ok(cf = cf_new());
+    ok(cf_add_from_file(cf, filename), "loads ok");
+    ok(psec = cf_find_sections(cf, "test.compile"));
+    ok(!((cf_section_t *) psec->el)->entries, "file read instead of image");
+    ok(!psec->next);
+    cf_free(cf);
+
+    note("syntax errors in Lua values");
+    write_file(filename, "[test.compile]\nbad = lua { return ( }\n", 38);
+    ok(!cf_compile(filename, "test_cf_compile.tmp.bad"), "does not compile");
+    ok(access("test_cf_compile.tmp.bad", F_OK) == -1, "no image written");
+    unlink(filename);
+    unlink("test_cf_compile.tmp.pcc");
+}
+
 int
 main(void)
 {
@@ -215,5 +398,8 @@ main(void)
     test2();
     test3();
     test4();
+    test_find_sections();
+    test_file();
+    test_compile();
     done_testing();
 }
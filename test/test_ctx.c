@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test pathcomp_ctx_t */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include <stdlib.h>
+
+static void
+test_independent_config(void)
+{
+    pathcomp_ctx_t *ctx1, *ctx2;
+    pathcomp_t *c1, *c2, *c;
+    ok(ctx1 = pathcomp_ctx_new(), "pathcomp_ctx_new()");
+    ok(ctx2 = pathcomp_ctx_new());
+    pathcomp_ctx_add_config_from_string(ctx1, "[class]\nroot = /one\n");
+    pathcomp_ctx_add_config_from_string(ctx2, "[class]\nroot = /two\n");
+    pathcomp_add_config_from_string("[class]\nroot = /default\n");
+    ok(c1 = pathcomp_ctx_new_composer(ctx1, "class"), "pathcomp_ctx_new_composer()");
+    ok(c2 = pathcomp_ctx_new_composer(ctx2, "class"));
+    ok(c = pathcomp_new("class"));
+    is(pathcomp_eval_nocopy(c1, "root"), "/one");
+    is(pathcomp_eval_nocopy(c2, "root"), "/two");
+    is(pathcomp_eval_nocopy(c, "root"), "/default", "pathcomp_new() uses the default context");
+    pathcomp_free(c2);
+    pathcomp_ctx_free(ctx2);
+    is(pathcomp_eval_nocopy(c1, "root"), "/one", "freeing a context leaves others intact");
+    is(pathcomp_eval_nocopy(c, "root"), "/default");
+    pathcomp_free(c1);
+    pathcomp_ctx_free(ctx1);
+    pathcomp_free(c);
+    pathcomp_cleanup();
+}
+
+static void
+test_independent_interpreter(void)
+{
+    pathcomp_ctx_t *ctx1, *ctx2;
+    pathcomp_t *c1, *c2, *clone;
+    const char *counter = "volatile lua { n = (n or 0) + 1; return n }";
+    ok(ctx1 = pathcomp_ctx_new());
+    ok(ctx2 = pathcomp_ctx_new());
+    c1 = pathcomp_ctx_new_composer(ctx1, "counter");
+    c2 = pathcomp_ctx_new_composer(ctx2, "counter");
+    pathcomp_set(c1, "n", counter);
+    pathcomp_set(c2, "n", counter);
+    is(pathcomp_eval_nocopy(c1, "n"), "1");
+    is(pathcomp_eval_nocopy(c1, "n"), "2");
+    is(pathcomp_eval_nocopy(c2, "n"), "1", "Lua globals are not shared between contexts");
+    ok(clone = pathcomp_clone(c1));
+    is(pathcomp_eval_nocopy(clone, "n"), "3", "clones share the context of the original");
+    pathcomp_free(clone);
+    pathcomp_free(c1);
+    pathcomp_free(c2);
+    pathcomp_ctx_free(ctx1);
+    pathcomp_ctx_free(ctx2);
+}
+
+static void
+test_class_templates(void)
+{
+    pathcomp_ctx_t *ctx;
+    pathcomp_t *c1, *c2, *c3;
+    ok(ctx = pathcomp_ctx_new());
+    pathcomp_ctx_add_config_from_string(ctx, "[base]\nroot = /base\n[class]\ncopy-from = base\nfile = a\nfile = b\n");
+    ok(c1 = pathcomp_ctx_new_composer(ctx, "class"));
+    ok(c2 = pathcomp_ctx_new_composer(ctx, "class"), "second composer object of the class");
+    is(pathcomp_eval_nocopy(c2, "root"), "/base");
+    pathcomp_add(c1, "file", "c");
+    pathcomp_set(c1, "root", "/changed");
+    ok(pathcomp_next(c2));
+    is(pathcomp_eval_nocopy(c2, "file"), "b");
+    ok(!pathcomp_next(c2), "composer objects of the same class are independent");
+    is(pathcomp_eval_nocopy(c2, "root"), "/base");
+    pathcomp_ctx_add_config_from_string(ctx, "[class]\nroot = /extended\n");
+    ok(c3 = pathcomp_ctx_new_composer(ctx, "class"));
+    is(pathcomp_eval_nocopy(c3, "root"), "/extended", "change of configuration taken into account");
+    pathcomp_rewind(c2);
+    is(pathcomp_eval_nocopy(c2, "root"), "/base", "existing composer objects outlive their template");
+    is(pathcomp_eval_nocopy(c2, "file"), "a");
+    pathcomp_free(c1);
+    pathcomp_free(c2);
+    pathcomp_free(c3);
+    pathcomp_ctx_free(ctx);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    test_independent_config();
+    test_independent_interpreter();
+    test_class_templates();
+    pathcomp_ctx_free(NULL);
+    done_testing();
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/* test the cache of directory listings */
+
+#include <config.h>
+#include "tap.h"
+#include "taputil.h"
+#include "pathcomp.h"
+#include "dircache.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define SCRATCH "lib/dircache"
+
+static void
+touch(const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (!fp) diag("fopen '%s': %s", path, strerror(errno));
+    else fclose(fp);
+}
+
+static void
+setup(void)
+{
+    if (mkdir(SCRATCH, S_IRWXU) == -1) diag("mkdir: %s", strerror(errno));
+    touch(SCRATCH "/a");
+    touch(SCRATCH "/b");
+    if (symlink("c", SCRATCH "/link") == -1) diag("symlink: %s", strerror(errno));
+}
+
+static void
+teardown(void)
+{
+    const char *files[] = { "a", "b", "c", "link", NULL }, **f;
+    char path[64];
+    for (f = files; *f; f++) {
+        snprintf(path, sizeof path, "%s/%s", SCRATCH, *f);
+        unlink(path);
+    }
+    if (rmdir(SCRATCH) == -1) diag("rmdir: %s", strerror(errno));
+}
+
+static void
+test_disabled(void)
+{
+    dircache_t *cache;
+    ok(cache = dircache_new(0));
+    cmp_ok(dircache_get_ttl(cache), "==", 0);
+    ok(!dircache_enabled(cache));
+    ok(dircache_exists(cache, SCRATCH "/a"));
+    ok(!dircache_exists(cache, SCRATCH "/c"));
+    /* without caching, new files are seen immediately */
+    touch(SCRATCH "/c");
+    ok(dircache_exists(cache, SCRATCH "/c"));
+    unlink(SCRATCH "/c");
+    dircache_free(cache);
+}
+
+static void
+test_enabled(void)
+{
+    dircache_t *cache;
+    ok(cache = dircache_new(-1));
+    ok(dircache_enabled(cache));
+    ok(dircache_exists(cache, SCRATCH "/a"));
+    ok(dircache_exists(cache, SCRATCH "/b"));
+    ok(!dircache_exists(cache, SCRATCH "/c"));
+    ok(dircache_exists(cache, SCRATCH));
+    ok(dircache_exists(cache, SCRATCH "/"));
+    ok(dircache_exists(cache, SCRATCH "/."));
+    ok(!dircache_exists(cache, SCRATCH "/a/x"), "file is not a directory");
+    ok(!dircache_exists(cache, SCRATCH "/missing/x"), "missing directory");
+    ok(!dircache_exists(cache, SCRATCH "/link"), "dangling symlink");
+    /* the listing is stale until the cache is invalidated */
+    touch(SCRATCH "/c");
+    ok(!dircache_exists(cache, SCRATCH "/c"), "stale listing");
+    ok(dircache_exists(cache, SCRATCH "/link"), "symlinks are not cached");
+    dircache_invalidate(cache);
+    ok(dircache_exists(cache, SCRATCH "/c"), "after invalidation");
+    unlink(SCRATCH "/c");
+    dircache_free(cache);
+}
+
+static void
+test_ttl(void)
+{
+    dircache_t *cache;
+    struct timespec ts = { 0, 200000000 };
+    ok(cache = dircache_new(0.1));
+    ok(!dircache_exists(cache, SCRATCH "/c"));
+    touch(SCRATCH "/c");
+    ok(!dircache_exists(cache, SCRATCH "/c"), "stale listing");
+    nanosleep(&ts, NULL);
+    ok(dircache_exists(cache, SCRATCH "/c"), "listing has expired");
+    unlink(SCRATCH "/c");
+    /* disabling the cache takes effect immediately */
+    dircache_set_ttl(cache, 0);
+    ok(!dircache_enabled(cache));
+    ok(!dircache_exists(cache, SCRATCH "/c"));
+    dircache_free(cache);
+}
+
+static void
+test_find(void)
+{
+    pathcomp_ctx_t *ctx;
+    pathcomp_t *c;
+    char *s;
+    ok(ctx = pathcomp_ctx_new());
+    pathcomp_ctx_set_dircache_ttl(ctx, -1);
+    ok(c = pathcomp_ctx_new_composer(ctx, "test.dircache"));
+    pathcomp_set(c, "root", SCRATCH);
+    pathcomp_set(c, "compose", "c");
+    pathcomp_add(c, "compose", "b");
+    pathcomp_add(c, "compose", "a");
+    is(s = pathcomp_find(c), SCRATCH "/b");
+    free(s);
+    touch(SCRATCH "/c");
+    pathcomp_rewind(c);
+    is(s = pathcomp_find(c), SCRATCH "/b", "stale listing");
+    free(s);
+    pathcomp_ctx_invalidate_dircache(ctx);
+    pathcomp_rewind(c);
+    is(s = pathcomp_find(c), SCRATCH "/c", "after invalidation");
+    free(s);
+    ok(pathcomp_exists(c, SCRATCH "/a"));
+    unlink(SCRATCH "/c");
+    ok(pathcomp_exists(c, SCRATCH "/c"), "stale listing");
+    pathcomp_ctx_set_dircache_ttl(ctx, 0);
+    ok(!pathcomp_exists(c, SCRATCH "/c"), "cache disabled");
+    pathcomp_free(c);
+    pathcomp_ctx_free(ctx);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    setup();
+    test_disabled();
+    test_enabled();
+    test_ttl();
+    test_find();
+    teardown();
+    pathcomp_cleanup();
+    done_testing();
+}
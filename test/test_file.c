@@ -21,6 +21,9 @@
 #include <config.h>
 #include "tap.h"
 #include "pathcomp.h"
+#include "buf.h"
+#include <stdio.h>
+#include <unistd.h>
 
 static void
 test_file(void)
@@ -64,6 +67,39 @@ test_backslash(void)
     pathcomp_free(c);
 }
 
+static void
+test_compiled(void)
+{
+    pathcomp_ctx_t *ctx;
+    pathcomp_t *c = NULL;
+    const char *filename = "test_file.pathcomprc";
+    buf_t text;
+    FILE *fp;
+    char *s;
+
+    note("compiled config file");
+    buf_init(&text, 0);
+    ok(buf_read_file(&text, SRCDIR "/.pathcomprc", 0) > 0);
+    ok(fp = fopen(filename, "w"));
+    ok(fwrite(text.buf, 1, text.len, fp) == text.len);
+    ok(!fclose(fp));
+    buf_release(&text);
+    ok(pathcomp_compile_config(filename, NULL), "compiles");
+    ok(ctx = pathcomp_ctx_new());
+    pathcomp_ctx_add_config_from_file(ctx, filename);
+    ok(c = pathcomp_ctx_new_composer(ctx, "test.file"));
+    pathcomp_set(c, "slot", "200403011130");
+    is(s = pathcomp_yield(c), "G2_SEV1_L20_BARG_SOL_M15_R50_20040301_113000_V003.hdf.gz");
+    free(s);
+    pathcomp_free(c);
+    ok(c = pathcomp_ctx_new_composer(ctx, "test.backslash"));
+    is(pathcomp_eval_nocopy(c, "other"), "something from whatever", "backslash continuation in Lua function");
+    pathcomp_free(c);
+    pathcomp_ctx_free(ctx);
+    unlink("test_file.pathcomprc.pcc");
+    unlink(filename);
+}
+
 int
 main(void)
 {
@@ -73,6 +109,7 @@ main(void)
     pathcomp_add_config_from_string("[test.file]\nto_be_created = ABC");
     test_file_and_string();
     test_backslash();
+    test_compiled();
     pathcomp_cleanup();
     done_testing();
 }
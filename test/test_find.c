@@ -230,6 +230,59 @@ test_with_dirs(void)
     pathcomp_free(c);
 }
 
+/* combinations under a missing root directory are skipped without composing
+ * their pathnames, also when the batches go through io_uring */
+static void
+test_prune(void)
+{
+    size_t windows[] = { 0, 5, 5 }, i;
+    int urings[] = { 0, 0, 1 };
+    pathcomp_t *c;
+    list_t *got, *expected, *p, *q;
+    char *s;
+
+    pathcomp_add_config_from_string(
+        "[test.prune]\n"
+        "    file    = G1/abc\n"
+        "    file    = G2/def\n"
+        "    file    = G5/one.log\n"
+        "    file    = zzz\n"
+        "    dir     = cache\n"
+        "    dir     = nowhere\n"
+        "    dir     = storage\n"
+        "    area    = missing\n"
+        "    area    = find\n"
+        "    area    = gone\n"
+        "    root    = lua { return '" SRCDIR "/lib/' .. self.area .. '/' .. self.dir }\n"
+        "    compose = lua { calls = calls + 1; return self.file }\n");
+    expected = list_from(SRCDIR "/lib/find/cache/G1/abc",
+        SRCDIR "/lib/find/cache/G5/one.log",
+        SRCDIR "/lib/find/storage/G1/abc",
+        SRCDIR "/lib/find/storage/G2/def",
+        SRCDIR "/lib/find/storage/G5/one.log",
+        NULL);
+    for (i = 0; i < sizeof windows / sizeof windows[0]; i++) {
+        pathcomp_set_find_batch(windows[i]);
+        pathcomp_set_find_uring(urings[i]);
+        ok(c = pathcomp_new("test.prune"));
+        pathcomp_set(c, "reset", "lua { calls = 0; return 'reset' }");
+        is(pathcomp_eval_nocopy(c, "reset"), "reset");
+        got = NULL;
+        while ((s = pathcomp_find(c))) got = list_push(got, s);
+        for (p = got, q = expected; p && q; p = p->next, q = q->next) is(p->el, q->el);
+        ok(!p && !q, "window %zu, io_uring %d: same pathnames in the same order", windows[i], urings[i]);
+        list_foreach(got, (list_traversal_t *) free, NULL);
+        list_free(got);
+        pathcomp_set(c, "calls", "lua { return tostring(calls) }");
+        is(pathcomp_eval_nocopy(c, "calls"), "8", "window %zu, io_uring %d: only pathnames under existing roots composed",
+                windows[i], urings[i]);
+        pathcomp_free(c);
+    }
+    pathcomp_set_find_batch(0);
+    pathcomp_set_find_uring(0);
+    list_free(expected);
+}
+
 int
 main(void)
 {
@@ -238,6 +291,7 @@ main(void)
     test_find();
     test_find_empty();
     test_with_dirs();
+    test_prune();
     pathcomp_cleanup();
     done_testing();
 }
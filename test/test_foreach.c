@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/* test pathcomp_foreach() and pathcomp_yield_all() */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include "list.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *config = "\
+[test.foreach]\n\
+    root      = " SRCDIR "/lib/find/cache\n\
+    root      = " SRCDIR "/lib/find/storage\n\
+    root      = " SRCDIR "/lib/find/ftp\n\
+    root      = " SRCDIR "/lib/find/remote\n\
+    dir       = G1\n\
+    dir       = G2\n\
+    dir       = G5\n\
+    file      = abc\n\
+    file      = def\n\
+    file      = one\n\
+    file      = two\n\
+    extension =\n\
+    extension = .hdf\n\
+    extension = .hdf.gz\n\
+    extension = .log\n\
+    compose   = lua { return self.dir .. '/' .. self.file .. self.extension }\n\
+[test.foreach.sparse]\n\
+    dir       = G1\n\
+    dir       = G2\n\
+    file      = abc\n\
+    file      = def\n\
+    file      = one\n\
+    compose   = lua { if self.file ~= 'def' then return self.dir .. '/' .. self.file end }\n\
+";
+
+typedef struct {
+    pathcomp_t *composer;
+    list_t     *paths;
+    size_t      count;
+    int         in_order;   /* indices are consecutive, or at least increasing */
+    int         consistent; /* the composer object is at the combination visited */
+    size_t      last;
+    size_t      stop_after;
+} visit_t;
+
+static int
+visit(const char *path, size_t index, visit_t *v)
+{
+    char *current = pathcomp_yield(v->composer);
+    if (!current || strcmp(current, path) || pathcomp_tell(v->composer) != index) v->consistent = 0;
+    free(current);
+    if (v->count && index <= v->last) v->in_order = 0;
+    v->last = index;
+    v->paths = list_push(v->paths, strdup(path));
+    if (++v->count == v->stop_after) return 42;
+    return 0;
+}
+
+static void
+visit_init(visit_t *v, pathcomp_t *composer)
+{
+    memset(v, 0, sizeof *v);
+    v->composer = composer;
+    v->in_order = 1;
+    v->consistent = 1;
+}
+
+static void
+visit_free(visit_t *v)
+{
+    list_foreach(v->paths, (list_traversal_t *) free, NULL);
+    list_free(v->paths);
+}
+
+/* returns 1 if both lists contain the same strings in the same order */
+static int
+same_sequence(list_t *a, list_t *b)
+{
+    for (; a && b; a = a->next, b = b->next) if (strcmp(a->el, b->el)) return 0;
+    return !a && !b;
+}
+
+static void
+test_all(void)
+{
+    pathcomp_t *c;
+    visit_t v;
+    list_t *expected = NULL;
+    ok(c = pathcomp_new("test.foreach"));
+    for (; !pathcomp_done(c); pathcomp_next(c)) expected = list_push(expected, pathcomp_yield(c));
+    pathcomp_next(c);
+    visit_init(&v, c);
+    cmp_ok(pathcomp_foreach(c, 0, (pathcomp_callback_t *) visit, &v), "==", 0);
+    cmp_ok(v.count, "==", 192, "all combinations visited");
+    cmp_ok(v.last, "==", 191);
+    ok(v.in_order);
+    ok(v.consistent, "composer object at the combination visited");
+    ok(same_sequence(v.paths, expected), "same pathnames as pathcomp_yield()");
+    ok(pathcomp_done(c), "done afterwards");
+    visit_free(&v);
+    list_foreach(expected, (list_traversal_t *) free, NULL);
+    list_free(expected);
+    pathcomp_free(c);
+}
+
+static void
+test_existing(void)
+{
+    size_t windows[] = { 0, 4 }, i;
+    pathcomp_t *c;
+    visit_t v;
+    list_t *expected = NULL;
+    char *s;
+    ok(c = pathcomp_new("test.foreach"));
+    while ((s = pathcomp_find(c))) expected = list_push(expected, s);
+    cmp_ok(list_length(expected), "==", 15);
+    for (i = 0; i < sizeof windows / sizeof windows[0]; i++) {
+        pathcomp_set_find_batch(windows[i]);
+        visit_init(&v, c);
+        cmp_ok(pathcomp_foreach(c, PATHCOMP_EXISTING, (pathcomp_callback_t *) visit, &v), "==", 0);
+        ok(same_sequence(v.paths, expected), "window %zu: same pathnames as pathcomp_find()", windows[i]);
+        ok(v.in_order);
+        ok(v.consistent, "composer object at the combination found");
+        ok(pathcomp_done(c));
+        visit_free(&v);
+    }
+    pathcomp_set_find_batch(0);
+    list_foreach(expected, (list_traversal_t *) free, NULL);
+    list_free(expected);
+    pathcomp_free(c);
+}
+
+static void
+test_stop(void)
+{
+    pathcomp_t *c;
+    visit_t v;
+    char *s;
+    ok(c = pathcomp_new("test.foreach"));
+    visit_init(&v, c);
+    v.stop_after = 3;
+    cmp_ok(pathcomp_foreach(c, PATHCOMP_EXISTING, (pathcomp_callback_t *) visit, &v), "==", 42);
+    cmp_ok(v.count, "==", 3);
+    ok(!pathcomp_done(c));
+    is(s = pathcomp_yield(c), v.paths->next->next->el, "left at the last combination visited");
+    free(s);
+    is(s = pathcomp_find(c), SRCDIR "/lib/find/cache/G5/one.hdf", "pathcomp_find() resumes after it");
+    free(s);
+    visit_free(&v);
+    visit_init(&v, c);
+    v.stop_after = 10;
+    cmp_ok(pathcomp_foreach(c, 0, (pathcomp_callback_t *) visit, &v), "==", 42, "starts from the first combination");
+    cmp_ok(v.count, "==", 10);
+    cmp_ok(pathcomp_tell(c), "==", 9);
+    visit_free(&v);
+    pathcomp_free(c);
+}
+
+static void
+test_yield_all(void)
+{
+    pathcomp_t *c;
+    pathcomp_pathset_t *set;
+    list_t *expected = NULL, *l;
+    size_t i, index, consistent;
+    char *s;
+    ok(c = pathcomp_new("test.foreach"));
+    for (; !pathcomp_done(c); pathcomp_next(c)) expected = list_push(expected, pathcomp_yield(c));
+    cmp_ok(pathcomp_yield_all(c, &set), "==", 0);
+    ok(set);
+    cmp_ok(set->count, "==", 192);
+    consistent = 1;
+    for (i = 0, l = expected; i < set->count && l; i++, l = l->next) {
+        if (strcmp(set->pool + set->offsets[i], l->el) || set->indices[i] != i) consistent = 0;
+        if (i + 1 < set->count && set->offsets[i + 1] != set->offsets[i] + strlen(l->el) + 1) consistent = 0;
+    }
+    ok(consistent, "same pathnames as pathcomp_yield(), back to back");
+    cmp_ok(set->size, "==", set->offsets[191] + strlen(set->pool + set->offsets[191]) + 1);
+    cmp_ok(set->pool[set->size - 1], "==", '\0');
+    ok(pathcomp_done(c), "done afterwards");
+    pathcomp_pathset_free(set);
+    list_foreach(expected, (list_traversal_t *) free, NULL);
+    list_free(expected);
+    pathcomp_free(c);
+
+    /* combinations without a pathname are skipped */
+    ok(c = pathcomp_new("test.foreach.sparse"));
+    cmp_ok(pathcomp_yield_all(c, &set), "==", 0);
+    cmp_ok(set->count, "==", 4);
+    is(set->pool + set->offsets[0], "G1/abc");
+    is(set->pool + set->offsets[3], "G2/one");
+    index = set->indices[3];
+    cmp_ok(index, "==", 5);
+    pathcomp_seek(c, index);
+    is(s = pathcomp_yield(c), "G2/one", "index of the combination");
+    free(s);
+    pathcomp_pathset_free(set);
+    pathcomp_free(c);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    pathcomp_add_config_from_string(config);
+    test_all();
+    test_existing();
+    test_stop();
+    test_yield_all();
+    pathcomp_cleanup();
+    done_testing();
+}
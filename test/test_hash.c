@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test hash.c */
+
+#include <config.h>
+#include "tap.h"
+#include "hash.h"
+#include "buf.h"
+#include <string.h>
+#include <stdlib.h>
+
+static int
+count_entries(const char *key, void *value, int *n)
+{
+    ++*n;
+    return 0;
+}
+
+static void
+test_basic(void)
+{
+    hash_t *hash;
+    char key[] = "abc";
+    int one = 1, two = 2;
+    ok(hash = hash_new(0), "hash_new()");
+    cmp_ok(hash_count(hash), "==", 0);
+    ok(!hash_get(hash, "abc"), "empty table");
+    ok(!hash_put(hash, "abc", &one), "hash_put() of new key");
+    cmp_ok(hash_count(hash), "==", 1);
+    ok(hash_get(hash, "abc") == &one, "hash_get()");
+    ok(hash_get(hash, key) == &one, "keys are compared by contents");
+    ok(!hash_get(hash, "ab"));
+    ok(!hash_get(hash, "abcd"));
+    ok(!hash_get(hash, ""));
+    ok(hash_put(hash, key, &two) == &one, "hash_put() of existing key returns old value");
+    cmp_ok(hash_count(hash), "==", 1);
+    ok(hash_get(hash, "abc") == &two);
+    ok(!hash_put(hash, "", &one), "empty string is a valid key");
+    ok(hash_get(hash, "") == &one);
+    cmp_ok(hash_count(hash), "==", 2);
+    hash_free(hash);
+}
+
+static void
+test_many(void)
+{
+    hash_t *hash;
+    char **keys;
+    int i, n = 5000, found = 0, counted = 0;
+    keys = malloc(n * sizeof *keys);
+    ok(hash = hash_new(10));
+    for (i = 0; i < n; i++) {
+        buf_t buf;
+        buf_init(&buf, 0);
+        buf_addf(&buf, "key%d", i);
+        keys[i] = buf_detach(&buf, NULL);
+        hash_put(hash, keys[i], keys[i]);
+    }
+    cmp_ok(hash_count(hash), "==", n, "table grows as needed");
+    for (i = 0; i < n; i++) {
+        char s[16];
+        sprintf(s, "key%d", i);
+        if (hash_get(hash, s) == keys[i]) ++found;
+    }
+    cmp_ok(found, "==", n, "all keys retrieved");
+    ok(!hash_get(hash, "key5000"));
+    hash_foreach(hash, (hash_traversal_t *) count_entries, &counted);
+    cmp_ok(counted, "==", n, "hash_foreach() visits all entries");
+    hash_free(hash);
+    for (i = 0; i < n; i++) free(keys[i]);
+    free(keys);
+}
+
+static void
+test_identity(void)
+{
+    hash_t *hash;
+    char key[] = "abc";
+    char *keys[100];
+    int i, one = 1, found = 0;
+    ok(hash = hash_new_identity(0), "hash_new_identity()");
+    ok(!hash_put(hash, key, &one));
+    ok(hash_get(hash, key) == &one, "same pointer");
+    ok(!hash_get(hash, "abc"), "keys are compared by address");
+    for (i = 0; i < 100; i++) {
+        keys[i] = malloc(1);
+        hash_put(hash, keys[i], keys[i]);
+    }
+    cmp_ok(hash_count(hash), "==", 101);
+    for (i = 0; i < 100; i++) if (hash_get(hash, keys[i]) == keys[i]) ++found;
+    cmp_ok(found, "==", 100, "all keys retrieved after growing");
+    hash_free(hash);
+    for (i = 0; i < 100; i++) free(keys[i]);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    test_basic();
+    test_many();
+    test_identity();
+    done_testing();
+}
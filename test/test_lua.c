@@ -50,6 +50,33 @@ const char *config = "\
     plus4 = lua { return self.val + 4 }\n\
     concat = lua { return 'concat' .. self.val }\n\
 \n\
+[test.memo]\n\
+    counter = lua { calls = (calls or 0) + 1; return self.alt .. calls }\n\
+    twice   = lua { return self.counter .. self.counter }\n\
+    now     = volatile lua { calls = (calls or 0) + 1; return calls }\n\
+    stamped = lua { return 'at' .. self.now }\n\
+\n\
+[test.deps]\n\
+    ext    = .a\n\
+    ext    = .b\n\
+    prefix = lua { prefixes = (prefixes or 0) + 1; return self.base .. '_' .. prefixes }\n\
+    name   = lua { return self.prefix .. self.ext }\n\
+\n\
+[test.fold]\n\
+    answer  = lua { return 6 * 7 }\n\
+    joined  = lua { return table.concat({ 'a', 'b' }, '-') .. string.rep('x', 2) .. math.floor(2.5) }\n\
+    uses    = lua { return 'the ' .. self.answer }\n\
+    now     = lua { return os.time() > 0 and 'later' or 'earlier' }\n\
+    dice    = lua { return math.random(1, 1) }\n\
+    caught  = lua { local ok = pcall(function () return io.stdout end); return ok and 'open' or 'closed' }\n\
+    global  = lua { folds = (folds or 0) + 1; return folds }\n\
+    long    = lua { local n = 0; for i = 1, 2000000 do n = n + 1 end; return n }\n\
+    failing = lua { return nil .. 'x' }\n\
+\n\
+[test.self]\n\
+    same = volatile lua { local same = rawequal(self, seen); seen = self; return tostring(same) }\n\
+    name = volatile lua { return self.base .. tostring(rawequal(self, seen)) }\n\
+\n\
 [test.args]\n\
     sum    = lua { ? }\n\
     number = lua { return self.sum(1, -5, -3, 2) } \n\
@@ -114,6 +141,103 @@ test_int(void)
     pathcomp_free(c);
 }
 
+static void
+test_memo(void)
+{
+    pathcomp_t *c = NULL;
+    ok(c = pathcomp_new("test.memo"));
+    pathcomp_add(c, "alt", "a");
+    pathcomp_add(c, "alt", "b");
+    is(pathcomp_eval_nocopy(c, "counter"), "a1");
+    is(pathcomp_eval_nocopy(c, "counter"), "a1", "attribute is evaluated only once");
+    is(pathcomp_eval_nocopy(c, "twice"), "a1a1", "also when referenced from other attributes");
+    ok(pathcomp_next(c));
+    is(pathcomp_eval_nocopy(c, "twice"), "b2b2", "pathcomp_next() invalidates memoized results");
+    pathcomp_rewind(c);
+    is(pathcomp_eval_nocopy(c, "counter"), "a3", "pathcomp_rewind() invalidates memoized results");
+    pathcomp_set(c, "alt", "c");
+    is(pathcomp_eval_nocopy(c, "counter"), "c4", "pathcomp_set() invalidates memoized results");
+    pathcomp_add(c, "alt", "d");
+    is(pathcomp_eval_nocopy(c, "counter"), "c5", "pathcomp_add() invalidates memoized results");
+    is(pathcomp_eval_nocopy(c, "now"), "6");
+    is(pathcomp_eval_nocopy(c, "now"), "7", "volatile attributes are evaluated every time");
+    is(pathcomp_eval_nocopy(c, "stamped"), "at8");
+    is(pathcomp_eval_nocopy(c, "stamped"), "at9", "and so are the attributes depending on them");
+    is(pathcomp_eval_nocopy(c, "counter"), "c5");
+    pathcomp_free(c);
+}
+
+static void
+test_dependencies(void)
+{
+    pathcomp_t *c = NULL, *clone = NULL;
+    char *dump;
+    ok(c = pathcomp_new("test.deps"));
+    pathcomp_set(c, "base", "x");
+    is(pathcomp_eval_nocopy(c, "name"), "x_1.a");
+    ok(pathcomp_next(c));
+    is(pathcomp_eval_nocopy(c, "name"), "x_1.b", "only dependents of the attribute that changed are reevaluated");
+    is(pathcomp_eval_nocopy(c, "prefix"), "x_1");
+    dump = pathcomp_dump(c);
+    ok(strstr(dump, "name: ext\n      origin: test.deps\n      dependents: name\n"), "dependents of 'ext' shown in dump");
+    ok(strstr(dump, "name: base\n      origin: (null)\n      dependents: prefix\n"), "dependents of 'base' shown in dump");
+    free(dump);
+    pathcomp_set(c, "base", "y");
+    is(pathcomp_eval_nocopy(c, "name"), "y_2.b", "indirect dependents are reevaluated");
+    ok(clone = pathcomp_clone(c));
+    is(pathcomp_eval_nocopy(clone, "name"), "y_3.b", "clone discovers its own dependencies");
+    pathcomp_set(clone, "base", "z");
+    is(pathcomp_eval_nocopy(clone, "name"), "z_4.b");
+    is(pathcomp_eval_nocopy(c, "name"), "y_2.b", "original unaffected");
+    ok(!pathcomp_next(c));
+    is(pathcomp_eval_nocopy(c, "name"), "y_2.a");
+    pathcomp_free(clone);
+    pathcomp_free(c);
+}
+
+static void
+test_fold(void)
+{
+    pathcomp_t *c = NULL;
+    char *dump, *p;
+    int folded = 0;
+    ok(c = pathcomp_new("test.fold"));
+    dump = pathcomp_dump(c);
+    ok(strstr(dump, "| 42 | (folded:) "), "constant shown as folded in dump");
+    ok(strstr(dump, "| a-bxx2 | (folded:) "), "string, table and math libraries allowed");
+    for (p = dump; (p = strstr(p, "(folded:)")); p++) folded++;
+    cmp_ok(folded, "==", 2, "nothing else folded");
+    free(dump);
+    is(pathcomp_eval_nocopy(c, "answer"), "42");
+    is(pathcomp_eval_nocopy(c, "uses"), "the 42", "folded attributes may be referred to");
+    is(pathcomp_eval_nocopy(c, "now"), "later");
+    is(pathcomp_eval_nocopy(c, "dice"), "1");
+    is(pathcomp_eval_nocopy(c, "caught"), "open", "denied access not hidden by pcall()");
+    is(pathcomp_eval_nocopy(c, "global"), "1", "code setting globals not folded");
+    is(pathcomp_eval_nocopy(c, "long"), "2000000", "long-running code not folded, but evaluated");
+    is(pathcomp_eval_nocopy(c, "failing"), NULL, "errors reported when evaluated");
+    pathcomp_set(c, "answer", "43");
+    is(pathcomp_eval_nocopy(c, "uses"), "the 43");
+    pathcomp_free(c);
+}
+
+static void
+test_self(void)
+{
+    pathcomp_t *c = NULL, *clone = NULL;
+    ok(c = pathcomp_new("test.self"));
+    pathcomp_set(c, "base", "x");
+    is(pathcomp_eval_nocopy(c, "same"), "false");
+    is(pathcomp_eval_nocopy(c, "same"), "true", "self is the same userdata in every call");
+    is(pathcomp_eval_nocopy(c, "name"), "xtrue", "and in every attribute");
+    ok(clone = pathcomp_clone(c));
+    is(pathcomp_eval_nocopy(clone, "name"), "xfalse", "clone has its own");
+    is(pathcomp_eval_nocopy(clone, "same"), "false");
+    is(pathcomp_eval_nocopy(c, "same"), "false");
+    pathcomp_free(clone);
+    pathcomp_free(c);
+}
+
 static void
 test_args(void)
 {
@@ -174,6 +298,10 @@ main(void)
     test_basic();
     test_callbacks();
     test_int();
+    test_memo();
+    test_dependencies();
+    test_fold();
+    test_self();
     test_args();
     test_env();
     test_incomplete();
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test pathcomp_find_all_parallel() */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include "taputil.h"
+#include "list.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char *config = "\
+[test.parallel]\n\
+    root      = " SRCDIR "/lib/find/cache\n\
+    root      = " SRCDIR "/lib/find/storage\n\
+    root      = " SRCDIR "/lib/find/ftp\n\
+    root      = " SRCDIR "/lib/find/remote\n\
+    dir       = G1\n\
+    dir       = G2\n\
+    dir       = G5\n\
+    file      = abc\n\
+    file      = def\n\
+    file      = one\n\
+    file      = two\n\
+    extension =\n\
+    extension = .hdf\n\
+    extension = .hdf.gz\n\
+    extension = .log\n\
+    compose   = lua { return self.dir .. '/' .. self.file .. self.extension }\n\
+";
+
+typedef struct {
+    list_t *paths;
+    size_t  last;     /* index of last pathname delivered */
+    int     in_order; /* indices are increasing */
+    int     stop_after;
+} collect_t;
+
+static int
+collect(const char *path, size_t index, collect_t *col)
+{
+    if (col->paths && index <= col->last) col->in_order = 0;
+    col->last = index;
+    col->paths = list_push(col->paths, strdup(path));
+    if (col->stop_after && list_length(col->paths) == col->stop_after) return 42;
+    return 0;
+}
+
+static void
+collect_init(collect_t *col)
+{
+    col->paths = NULL;
+    col->last = 0;
+    col->in_order = 1;
+    col->stop_after = 0;
+}
+
+static void
+collect_free(collect_t *col)
+{
+    list_foreach(col->paths, (list_traversal_t *) free, NULL);
+    list_free(col->paths);
+}
+
+/* returns 1 if both lists contain the same strings in the same order */
+static int
+same_sequence(list_t *a, list_t *b)
+{
+    for (; a && b; a = a->next, b = b->next) if (strcmp(a->el, b->el)) return 0;
+    return !a && !b;
+}
+
+static void
+test_find_all(void)
+{
+    pathcomp_t *c;
+    list_t *serial = NULL;
+    char *s;
+    int nthreads[] = { 1, 2, 4, 7, 1000 }, i;
+    ok(c = pathcomp_new("test.parallel"));
+    while ((s = pathcomp_find(c))) serial = list_push(serial, s);
+    cmp_ok(list_length(serial), "==", 15, "serial reference");
+    pathcomp_rewind(c);
+    ok(pathcomp_next(c));
+    for (i = 0; i < sizeof nthreads / sizeof nthreads[0]; i++) {
+        collect_t col;
+        int n = nthreads[i];
+        collect_init(&col);
+        cmp_ok(pathcomp_find_all_parallel(c, n, 0, (pathcomp_callback_t *) collect, &col), "==", 0,
+                "pathcomp_find_all_parallel() with %d threads", n);
+        ok(same_sequence(col.paths, serial), "%d threads: same pathnames in same order", n);
+        ok(col.in_order);
+        collect_free(&col);
+        collect_init(&col);
+        cmp_ok(pathcomp_find_all_parallel(c, n, PATHCOMP_UNORDERED, (pathcomp_callback_t *) collect, &col), "==", 0);
+        cmp_bag(col.paths, serial, "%d threads, unordered: same pathnames", n);
+        collect_free(&col);
+    }
+    cmp_ok(pathcomp_tell(c), "==", 1, "current combination is left unchanged");
+    list_foreach(serial, (list_traversal_t *) free, NULL);
+    list_free(serial);
+    pathcomp_free(c);
+}
+
+static void
+test_stop(void)
+{
+    pathcomp_t *c;
+    collect_t col;
+    ok(c = pathcomp_new("test.parallel"));
+    collect_init(&col);
+    col.stop_after = 3;
+    cmp_ok(pathcomp_find_all_parallel(c, 4, 0, (pathcomp_callback_t *) collect, &col), "==", 42,
+            "callback can stop the enumeration");
+    cmp_ok(list_length(col.paths), "==", 3);
+    collect_free(&col);
+    pathcomp_free(c);
+}
+
+static void
+test_nothing(void)
+{
+    pathcomp_t *c;
+    collect_t col;
+    ok(c = pathcomp_new("test.parallel"));
+    pathcomp_set(c, "file", "nonexistent");
+    collect_init(&col);
+    cmp_ok(pathcomp_find_all_parallel(c, 3, 0, (pathcomp_callback_t *) collect, &col), "==", 0);
+    ok(!col.paths, "no pathnames found");
+    pathcomp_free(c);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    pathcomp_add_config_from_string(config);
+    test_find_all();
+    test_stop();
+    test_nothing();
+    pathcomp_cleanup();
+    done_testing();
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test pathcomp_count(), pathcomp_tell() and pathcomp_seek() */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+const char *config = "\
+[test.seek]\n\
+    root      = /a\n\
+    root      = /b\n\
+    single    = x\n\
+    dir       = d1\n\
+    dir       = d2\n\
+    dir       = d3\n\
+    extension = .e1\n\
+    extension = .e2\n\
+    compose   = lua { return self.dir .. '/file' .. self.extension }\n\
+";
+
+static void
+test_count(void)
+{
+    pathcomp_t *c;
+    ok(c = pathcomp_new("test.seek"));
+    cmp_ok(pathcomp_count(c), "==", 12, "pathcomp_count()");
+    pathcomp_lookup(c, "placeholder");
+    cmp_ok(pathcomp_count(c), "==", 12, "attributes without value do not count");
+    pathcomp_free(c);
+    ok(c = pathcomp_new("nonexistent"));
+    cmp_ok(pathcomp_count(c), "==", 1, "empty composer has one combination");
+    pathcomp_free(c);
+}
+
+static void
+test_overflow(void)
+{
+    pathcomp_t *c;
+    int i;
+    ok(c = pathcomp_new("nonexistent"));
+    for (i = 0; i < 100; i++) {
+        char name[16];
+        sprintf(name, "a%d", i);
+        pathcomp_add(c, name, "0");
+        pathcomp_add(c, name, "1");
+    }
+    ok(pathcomp_count(c) == SIZE_MAX, "overflow saturates");
+    pathcomp_free(c);
+}
+
+static void
+test_tell_seek(void)
+{
+    pathcomp_t *c, *other;
+    size_t i = 0;
+    int errors = 0;
+    ok(c = pathcomp_new("test.seek"));
+    ok(other = pathcomp_new("test.seek"));
+    cmp_ok(pathcomp_tell(c), "==", 0);
+    do {
+        char *expected, *got;
+        if (pathcomp_tell(c) != i) ++errors;
+        /* seek backwards and forwards on the other composer */
+        if (pathcomp_seek(other, i) != 0) ++errors;
+        if (pathcomp_tell(other) != i) ++errors;
+        expected = pathcomp_yield(c);
+        got = pathcomp_yield(other);
+        if (strcmp(expected, got)) ++errors;
+        free(expected);
+        free(got);
+        if (pathcomp_seek(other, 11 - i) != 0) ++errors;
+        ++i;
+    } while (pathcomp_next(c));
+    cmp_ok(errors, "==", 0, "pathcomp_tell() and pathcomp_seek() follow pathcomp_next()");
+    cmp_ok(i, "==", 12);
+    cmp_ok(pathcomp_tell(c), "==", 12, "pathcomp_tell() after last combination");
+    cmp_ok(pathcomp_seek(c, 12), "==", -1, "seeking past the end fails");
+    ok(pathcomp_done(c), "... and leaves the composer unchanged");
+    cmp_ok(pathcomp_seek(c, 5), "==", 0);
+    ok(!pathcomp_done(c), "seeking resets pathcomp_done()");
+    is(pathcomp_eval_nocopy(c, "root"), "/b");
+    is(pathcomp_eval_nocopy(c, "compose"), "d3/file.e1", "results depending on sought attributes are updated");
+    ok(pathcomp_next(c));
+    is(pathcomp_eval_nocopy(c, "compose"), "d1/file.e2", "pathcomp_next() continues from there");
+    cmp_ok(pathcomp_tell(c), "==", 6);
+    pathcomp_free(other);
+    pathcomp_free(c);
+}
+
+static void
+test_find(void)
+{
+    pathcomp_t *c;
+    char *path;
+    ok(c = pathcomp_new("test.seek"));
+    pathcomp_set(c, "root", SRCDIR "/lib/find/cache");
+    pathcomp_add(c, "root", SRCDIR "/lib/find/storage");
+    pathcomp_set(c, "compose", ".");
+    ok(path = pathcomp_find(c));
+    cmp_ok(pathcomp_tell(c), "==", 0);
+    free(path);
+    cmp_ok(pathcomp_seek(c, 1), "==", 0);
+    ok(path = pathcomp_find(c), "pathcomp_find() after pathcomp_seek()");
+    is(path, SRCDIR "/lib/find/storage/.", "... starts at the sought combination");
+    cmp_ok(pathcomp_tell(c), "==", 1);
+    free(path);
+    pathcomp_free(c);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    pathcomp_add_config_from_string(config);
+    test_count();
+    test_overflow();
+    test_tell_seek();
+    test_find();
+    pathcomp_cleanup();
+    done_testing();
+}
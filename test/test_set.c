@@ -148,13 +148,50 @@ test_int_internal(void)
     att_t *att = pathcomp_retrieve_att(c, "n");
     ok(att);
     is(att->name, "n", "we've got the right attribute");
-    ok(att->alternatives);
-    ok(!att->alternatives->next, "only one alternative");
-    value_t *p = att->alternatives->el;
+    ok(att->values);
+    cmp_ok(att->values->count, "==", 1, "only one alternative");
+    value_t *p = att->values->values[0];
     cmp_ok(p->type, "==", VALUE_INT, "value of type int");
-    is(p->result, NULL, "value_push() does not do unnecessary int-to-string conversion");
+    ok(!att->caches || !att->caches[0].result, "value_push() does not do unnecessary int-to-string conversion");
     is(pathcomp_eval_nocopy(c, "n"), "19");
-    is(p->result, "19", "does contain string after explicit eval()");
+    is(att->caches[0].result, "19", "does contain string after explicit eval()");
+    pathcomp_free(c);
+}
+
+static void
+test_handles(void)
+{
+    pathcomp_t *c, *clone;
+    pathcomp_handle_t h, n, val;
+    char *s;
+    ok(c = pathcomp_new("int"));
+    pathcomp_set(c, "val", "lua { return 'person' .. (self.n or '?') }");
+    ok((val = pathcomp_lookup(c, "val")) >= 0, "pathcomp_lookup() of existing attribute");
+    cmp_ok(pathcomp_lookup(c, "val"), "==", val, "handles are stable");
+    is(pathcomp_eval_nocopy_h(c, val), "person?");
+    ok((n = pathcomp_lookup(c, "n")) >= 0, "pathcomp_lookup() of missing attribute");
+    ok(n != val);
+    is(pathcomp_eval_nocopy_h(c, n), NULL, "new attribute has no value");
+    is(pathcomp_eval_nocopy(c, "val"), "person?");
+    pathcomp_set_int_h(c, n, 5);
+    is(pathcomp_eval_nocopy_h(c, n), "5", "pathcomp_set_int_h()");
+    is(pathcomp_eval_nocopy_h(c, val), "person5", "dependents see the new value");
+    pathcomp_set_h(c, n, "x");
+    is(pathcomp_eval_nocopy(c, "n"), "x", "pathcomp_set_h()");
+    is(s = pathcomp_eval_h(c, val), "personx", "pathcomp_eval_h()");
+    free(s);
+    pathcomp_add(c, "n", "y");
+    ok(pathcomp_next(c));
+    is(pathcomp_eval_nocopy_h(c, val), "persony");
+    ok(clone = pathcomp_clone(c));
+    is(pathcomp_eval_nocopy_h(clone, val), "persony", "handles are valid for clones");
+    pathcomp_set_h(clone, n, "z");
+    is(pathcomp_eval_nocopy_h(clone, val), "personz");
+    is(pathcomp_eval_nocopy_h(c, val), "persony");
+    ok((h = pathcomp_lookup(c, "other")) >= 0);
+    ok(pathcomp_retrieve_att(c, "other"), "attribute created by pathcomp_lookup()");
+    ok(!pathcomp_retrieve_att(clone, "other"));
+    pathcomp_free(clone);
     pathcomp_free(c);
 }
 
@@ -169,5 +206,6 @@ main(void)
     test_no_rewind_after_add();
     test_set_add_int();
     test_int_internal();
+    test_handles();
     done_testing();
 }
@@ -93,6 +93,40 @@ perform_test(
     test_exists => 1,
 );
 
+# test -0
+{
+    my @cmd = ( $prefix, '-a0', "root=$srcdir/lib/archive", qw(instrument=G1 instrument+=G2 imager=SEV1 imager+=SEV2 ),
+                qw(product=SOL_TH resolution=HR level=20 slot=20070502084500 version=V003 version+=V006) );
+    note "running @cmd";
+    my $out = `@cmd`;
+    like $out, qr/\0\z/, 'output ends in a null character';
+    my @got = split /\0/, $out;
+    is scalar @got, 8;
+    is $got[0], "$srcdir/lib/archive/G1/SEV1/G1_SEV1_L20_HR_SOL_TH/2007/0502/G1_SEV1_L20_HR_SOL_TH_20070502_084500_V003.hdf.gz";
+    unlike $out, qr/\n/, 'no newlines';
+
+    @cmd = ( $prefix, '-ae0', '-x', 'version', "root=$srcdir/lib/archive", qw(instrument=G1 instrument+=G2 imager=SEV1 imager+=SEV2 ),
+             qw(product=SOL_TH resolution=HR level=20 slot=20070502084500 version=V003 version+=V006) );
+    note "running @cmd";
+    $out = `@cmd`;
+    is $out, "V003\0V006\0";
+}
+
+# test -j
+perform_test(
+    command => [ $prefix, '-ae', '-j', 3, "root=$srcdir/lib/archive", qw(instrument=G1 instrument+=G2 imager=SEV1 imager+=SEV2 ),
+                 qw(product=SOL_TH resolution=HR level=20 slot=20070502084500 version=V003 version+=V006) ],
+    returns => [ "$srcdir/lib/archive/G1/SEV2/G1_SEV2_L20_HR_SOL_TH/2007/0502/G1_SEV2_L20_HR_SOL_TH_20070502_084500_V006.hdf.gz",
+                 "$srcdir/lib/archive/G2/SEV1/G2_SEV1_L20_HR_SOL_TH/2007/0502/G2_SEV1_L20_HR_SOL_TH_20070502_084500_V003.hdf.gz" ],
+);
+
+perform_test(
+    command => [ $prefix, '-ae', '-j', 3, qw(-x version), "root=$srcdir/lib/archive", qw(instrument=G1 instrument+=G2 imager=SEV1 imager+=SEV2 ),
+                 qw(product=SOL_TH resolution=HR level=20 slot=20070502084500 version=V003 version+=V006) ],
+    returns => [ 'V006',
+                 'V003' ],
+);
+
 @returns = perform_test(
     command => [ $prefix, '-e', "root=$srcdir/lib/archive", qw(instrument=G1 instrument+=G2 imager=SEV1 imager+=SEV2 ),
                  qw(product=SOL_TH resolution=HR level=20 slot=20070502084500 version=V003 version+=V006) ],
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2015 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+/* test batched existence checks, and their use by pathcomp_find() */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include "statbatch.h"
+#include "list.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define countof(a) (sizeof (a) / sizeof (a)[0])
+
+const char *config = "\
+[test.statbatch]\n\
+    root      = " SRCDIR "/lib/find/cache\n\
+    root      = " SRCDIR "/lib/find/storage\n\
+    root      = " SRCDIR "/lib/find/ftp\n\
+    root      = " SRCDIR "/lib/find/remote\n\
+    dir       = G1\n\
+    dir       = G2\n\
+    dir       = G5\n\
+    file      = abc\n\
+    file      = def\n\
+    file      = one\n\
+    file      = two\n\
+    extension =\n\
+    extension = .hdf\n\
+    extension = .hdf.gz\n\
+    extension = .log\n\
+    compose   = lua { return self.dir .. '/' .. self.file .. self.extension }\n\
+";
+
+static void
+test_statbatch(int flags)
+{
+    const char *paths[] = {
+        SRCDIR "/lib/find/cache/G1/abc",
+        SRCDIR "/lib/find/cache/G1/def",
+        NULL,
+        SRCDIR "/lib/find/cache/G2",
+        SRCDIR "/lib/find/cache/G2/dummy/x",
+        SRCDIR "/lib/find/storage/G5/two.log",
+        SRCDIR "/lib/find/storage/G5/two.hdf.gz",
+        SRCDIR "/lib/find/remote/G5/one.log",
+        "",
+        SRCDIR "/lib/find/remote/G5/one.hdf.gz",
+    };
+    int expected[] = { 1, 0, 0, 1, 0, 1, 0, 1, 0, 1 };
+    int exists[countof(paths)];
+    statbatch_t *batch;
+    size_t i;
+    /* fewer requests in flight than pathnames */
+    ok(batch = statbatch_new(4, flags));
+    note("backend: %s", statbatch_backend(batch));
+    if (!(flags & STATBATCH_USE_URING)) is(statbatch_backend(batch), "threads");
+    memset(exists, -1, sizeof exists);
+    statbatch_exists(batch, paths, countof(paths), exists);
+    for (i = 0; i < countof(paths); i++)
+        cmp_ok(exists[i], "==", expected[i], "%s", paths[i] ? paths[i] : "(null)");
+    /* reuse */
+    memset(exists, -1, sizeof exists);
+    statbatch_exists(batch, paths, 2, exists);
+    cmp_ok(exists[0], "==", 1);
+    cmp_ok(exists[1], "==", 0);
+    cmp_ok(exists[2], "==", -1, "beyond the batch is untouched");
+    statbatch_exists(batch, paths, 0, exists);
+    statbatch_free(batch);
+}
+
+/* find all pathnames, and check that every one is the current pathname */
+static list_t *
+find_all(pathcomp_t *c, int *consistent)
+{
+    list_t *found = NULL;
+    char *path;
+    *consistent = 1;
+    pathcomp_rewind(c);
+    while ((path = pathcomp_find(c))) {
+        char *current = pathcomp_yield(c);
+        if (strcmp(current, path)) *consistent = 0;
+        free(current);
+        found = list_push(found, path);
+    }
+    return found;
+}
+
+/* returns 1 if both lists contain the same strings in the same order */
+static int
+same_sequence(list_t *a, list_t *b)
+{
+    for (; a && b; a = a->next, b = b->next) if (strcmp(a->el, b->el)) return 0;
+    return !a && !b;
+}
+
+static void
+free_all(list_t *list)
+{
+    list_foreach(list, (list_traversal_t *) free, NULL);
+    list_free(list);
+}
+
+static void
+test_find(void)
+{
+    size_t windows[] = { 2, 3, 7, 64, 1000 }, i;
+    pathcomp_ctx_t *ctx;
+    pathcomp_t *c;
+    list_t *serial, *batched;
+    int consistent;
+    char *s;
+    ok(ctx = pathcomp_ctx_new());
+    pathcomp_ctx_add_config_from_string(ctx, config);
+    ok(c = pathcomp_ctx_new_composer(ctx, "test.statbatch"));
+    serial = find_all(c, &consistent);
+    cmp_ok(list_length(serial), "==", 15);
+    for (i = 0; i < countof(windows); i++) {
+        pathcomp_ctx_set_find_batch(ctx, windows[i]);
+        batched = find_all(c, &consistent);
+        ok(same_sequence(serial, batched), "window %zu finds the same pathnames in the same order", windows[i]);
+        ok(consistent, "window %zu leaves the composer at the pathname found", windows[i]);
+        is(s = pathcomp_find(c), NULL, "exhausted");
+        free_all(batched);
+    }
+    /* resume from a combination in the middle */
+    pathcomp_ctx_set_find_batch(ctx, 8);
+    pathcomp_seek(c, 20);
+    is(s = pathcomp_find(c), SRCDIR "/lib/find/cache/G5/one.hdf");
+    cmp_ok(pathcomp_tell(c), "==", 80);
+    free(s);
+    is(s = pathcomp_find(c), SRCDIR "/lib/find/storage/G5/two.hdf");
+    free(s);
+    /* the directory cache takes precedence */
+    pathcomp_ctx_set_dircache_ttl(ctx, -1);
+    batched = find_all(c, &consistent);
+    ok(same_sequence(serial, batched), "with directory cache");
+    free_all(batched);
+    free_all(serial);
+    pathcomp_free(c);
+    pathcomp_ctx_free(ctx);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    test_statbatch(0);
+    test_statbatch(STATBATCH_USE_URING);
+    test_find();
+    done_testing();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test use of composer objects from multiple threads */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NTHREADS 4
+#define ROUNDS   200
+
+const char *config = "\
+[test.threads]\n\
+    root    = /data/cache\n\
+    root    = /data/storage\n\
+    instrument = N6\n\
+    instrument = GL\n\
+    instrument = SE\n\
+    year    = 1989\n\
+    year    = 2004\n\
+    compose = lua { return self.instrument .. '/' .. self.year .. '/' .. self.instrument .. '_' .. self.slot .. '.txt' }\n\
+";
+
+typedef struct {
+    pathcomp_t *template; /* composer to clone, or null to create one */
+    int         slot;
+    int         rounds;
+    int         errors;   /* number of pathnames that were not as expected */
+    int         yielded;  /* number of pathnames yielded */
+} worker_t;
+
+static char *
+expected(int slot, int combination)
+{
+    static const char *roots[] = { "/data/cache", "/data/storage" };
+    static const char *instruments[] = { "N6", "GL", "SE" };
+    static const char *years[] = { "1989", "2004" };
+    char *s = malloc(64);
+    /* the first attribute cycles fastest */
+    sprintf(s, "%s/%s/%s/%s_%d.txt", roots[combination % 2],
+            instruments[combination / 2 % 3], years[combination / 6 % 2],
+            instruments[combination / 2 % 3], slot);
+    return s;
+}
+
+static void *
+work(void *arg)
+{
+    worker_t *w = arg;
+    pathcomp_t *c;
+    int round;
+    c = w->template ? pathcomp_clone(w->template) : pathcomp_new("test.threads");
+    pathcomp_set_int(c, "slot", w->slot);
+    for (round = 0; round < w->rounds; round++) {
+        int n = 0;
+        pathcomp_rewind(c);
+        do {
+            char *got = pathcomp_yield(c), *exp = expected(w->slot, n++);
+            if (!got || strcmp(got, exp)) ++w->errors;
+            ++w->yielded;
+            free(got);
+            free(exp);
+        } while (pathcomp_next(c));
+        if (n != 12) ++w->errors;
+    }
+    pathcomp_free(c);
+    return NULL;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* returns the time taken by \a nthreads threads to do the same amount of work
+ * each */
+static double
+run(pathcomp_t *template, int nthreads, const char *msg)
+{
+    pthread_t threads[NTHREADS];
+    worker_t workers[NTHREADS];
+    int i, errors = 0, yielded = 0;
+    double t0;
+    t0 = now();
+    for (i = 0; i < nthreads; i++) {
+        workers[i].template = template;
+        workers[i].slot = i;
+        workers[i].rounds = ROUNDS;
+        workers[i].errors = 0;
+        workers[i].yielded = 0;
+        pthread_create(&threads[i], NULL, work, &workers[i]);
+    }
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+        errors += workers[i].errors;
+        yielded += workers[i].yielded;
+    }
+    cmp_ok(yielded, "==", nthreads * ROUNDS * 12, "%s: all pathnames yielded", msg);
+    cmp_ok(errors, "==", 0, "%s: all pathnames correct", msg);
+    return now() - t0;
+}
+
+int
+main(void)
+{
+    pathcomp_t *template;
+    char *s, msg[64];
+    double t1, tn;
+    plan(NO_PLAN);
+    pathcomp_add_config_from_string(config);
+    ok(template = pathcomp_new("test.threads"));
+    pathcomp_set_int(template, "slot", 0);
+    is(s = pathcomp_yield(template), "/data/cache/N6/1989/N6_0.txt", "template usable from main thread");
+    free(s);
+    run(NULL, NTHREADS, "new composers in threads");
+    t1 = run(template, 1, "clones in 1 thread");
+    sprintf(msg, "clones in %d threads", NTHREADS);
+    tn = run(template, NTHREADS, msg);
+    note("%d threads did %d times the work of 1 thread in %.2f times the time",
+            NTHREADS, NTHREADS, tn / t1);
+    note("throughput scaling: %.2f (ideal: %d)", NTHREADS * t1 / tn, NTHREADS);
+    is(s = pathcomp_yield(template), "/data/cache/N6/1989/N6_0.txt", "template unaffected");
+    free(s);
+    pathcomp_free(template);
+    pathcomp_cleanup();
+    done_testing();
+}
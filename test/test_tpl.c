@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2015, 2016 Edward Baudrez <edward.baudrez@gmail.com>
+ * This file is part of Libpathcomp.
+ *
+ * Libpathcomp is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Libpathcomp is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with Libpathcomp; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* test template values in config */
+
+#include <config.h>
+#include "tap.h"
+#include "pathcomp.h"
+
+const char *config = "\
+[test.tpl]\n\
+    instrument = G2\n\
+    slot       = 200403011130\n\
+    yyyy       = tpl { ${slot[1,4]} }\n\
+    mmdd       = tpl { ${slot[5,8]} }\n\
+    hhmm       = tpl { ${ slot [9, 12] } }\n\
+    tail       = tpl {${slot[-4]}}\n\
+    name       = tpl {${instrument}_${yyyy}${mmdd}_${hhmm}}\n\
+    from_lua   = lua { return self.name .. '.gz' }\n\
+    from_tpl   = tpl {${from_lua}}\n\
+    compose    = tpl {${instrument}/${yyyy}/${name}}\n\
+\n\
+[test.pad]\n\
+    number     = 7\n\
+    word       = abc\n\
+    zeros      = tpl {${number%03}}\n\
+    right      = tpl {[${word%-5}]}\n\
+    left       = tpl {[${word%5}]}\n\
+    narrow     = tpl {[${word%2}]}\n\
+    both       = tpl {${word[2]%04}}\n\
+    empty      = tpl {[${word[5,9]%-2}]}\n\
+\n\
+[test.cycle]\n\
+    self       = tpl { ${self} }\n\
+    ping       = tpl { ${pong}! }\n\
+    pong       = tpl { ${ping}? }\n\
+    via_lua    = tpl { ${lua} }\n\
+    lua        = lua { return tostring(self.via_lua) }\n\
+";
+
+static void
+test_basic(void)
+{
+    pathcomp_t *c = NULL;
+    char *s;
+    ok(c = pathcomp_new("test.tpl"));
+    is(pathcomp_eval_nocopy(c, "yyyy"), "2004");
+    is(pathcomp_eval_nocopy(c, "mmdd"), "0301");
+    is(pathcomp_eval_nocopy(c, "hhmm"), "1130", "spaces inside references");
+    is(pathcomp_eval_nocopy(c, "tail"), "1130", "negative start of substring");
+    is(pathcomp_eval_nocopy(c, "name"), "G2_20040301_1130");
+    is(pathcomp_eval_nocopy(c, "from_tpl"), "G2_20040301_1130.gz", "Lua and templates refer to each other");
+    is(s = pathcomp_yield(c), "G2/2004/G2_20040301_1130");
+    free(s);
+    pathcomp_free(c);
+}
+
+static void
+test_padding(void)
+{
+    pathcomp_t *c = NULL;
+    ok(c = pathcomp_new("test.pad"));
+    is(pathcomp_eval_nocopy(c, "zeros"), "007");
+    is(pathcomp_eval_nocopy(c, "right"), "[abc  ]");
+    is(pathcomp_eval_nocopy(c, "left"), "[  abc]");
+    is(pathcomp_eval_nocopy(c, "narrow"), "[abc]", "values are never truncated");
+    is(pathcomp_eval_nocopy(c, "both"), "00bc", "substring, then padding");
+    is(pathcomp_eval_nocopy(c, "empty"), "[  ]", "substring beyond end");
+    pathcomp_free(c);
+}
+
+static void
+test_dependencies(void)
+{
+    pathcomp_t *c = NULL;
+    ok(c = pathcomp_new("test.tpl"));
+    is(pathcomp_eval_nocopy(c, "name"), "G2_20040301_1130");
+    pathcomp_set(c, "slot", "201512312359");
+    is(pathcomp_eval_nocopy(c, "name"), "G2_20151231_2359", "result follows referenced attributes");
+    pathcomp_add(c, "instrument", "G3");
+    is(pathcomp_eval_nocopy(c, "name"), "G2_20151231_2359");
+    ok(pathcomp_next(c));
+    is(pathcomp_eval_nocopy(c, "name"), "G3_20151231_2359", "result follows alternatives");
+    pathcomp_set(c, "missing", "tpl {${nothing}}");
+    is(pathcomp_eval_nocopy(c, "missing"), NULL, "reference to attribute without value");
+    pathcomp_free(c);
+}
+
+static void
+test_cycle(void)
+{
+    pathcomp_t *c = NULL;
+    ok(c = pathcomp_new("test.cycle"));
+    is(pathcomp_eval_nocopy(c, "self"), NULL, "template referring to itself");
+    is(pathcomp_eval_nocopy(c, "ping"), NULL, "templates referring to each other");
+    is(pathcomp_eval_nocopy(c, "pong"), NULL);
+    is(pathcomp_eval_nocopy(c, "via_lua"), "nil", "cycle through Lua");
+    pathcomp_set(c, "self", "fine");
+    is(pathcomp_eval_nocopy(c, "self"), "fine", "attribute usable after cycle");
+    pathcomp_free(c);
+}
+
+int
+main(void)
+{
+    plan(NO_PLAN);
+    pathcomp_add_config_from_string(config);
+    test_basic();
+    test_padding();
+    test_dependencies();
+    test_cycle();
+    pathcomp_cleanup();
+    done_testing();
+}
@@ -26,22 +26,34 @@
 #include <limits.h>
 #include <stdlib.h>
 
+static interpreter_t *interp;
+
+/* the text of the block, or null */
+static char *
+extract_block(const char *text, const char *keyword)
+{
+    const char *block;
+    size_t len;
+    if (!(block = value_match_block(text, keyword, &len))) return NULL;
+    return strndup(block, len);
+}
+
 static void
 test_block(void)
 {
     char *s;
-    s = value_match_and_extract_block("ident { contents }", "ident");
+    s = extract_block("ident { contents }", "ident");
     is(s, " contents ");
     free(s);
-    s = value_match_and_extract_block("ident{contents }", "ident");
+    s = extract_block("ident{contents }", "ident");
     is(s, "contents ");
     free(s);
-    s = value_match_and_extract_block("ident            {contents }  ", "ident");
+    s = extract_block("ident            {contents }  ", "ident");
     is(s, "contents ");
     free(s);
-    s = value_match_and_extract_block("ident contents }", "ident");
+    s = extract_block("ident contents }", "ident");
     is(s, NULL);
-    s = value_match_and_extract_block("ident { contents }", "keyword");
+    s = extract_block("ident { contents }", "keyword");
     is(s, NULL);
 }
 
@@ -52,7 +64,7 @@ test_string(void)
 
     ok(val = value_new_string("abc"));
     cmp_ok(val->type, "==", VALUE_STRING);
-    is(value_eval(val, NULL, NULL), "abc");
+    is(value_eval(val, interp, NULL, NULL), "abc");
     value_free(val);
 }
 
@@ -63,20 +75,51 @@ test_lua(void)
 
     ok(val = value_new_lua("return 1+2"));
     cmp_ok(val->type, "==", VALUE_LUA);
-    is(value_eval(val, NULL, NULL), "3");
+    is(value_eval(val, interp, NULL, NULL), "3");
     value_free(val);
     ok(val = value_new_lua("return some_weird_name + 2"));
     cmp_ok(val->type, "==", VALUE_LUA);
-    ok(!value_eval(val, NULL, NULL), "use of undefined variables raises an error");
+    ok(!value_eval(val, interp, NULL, NULL), "use of undefined variables raises an error");
     value_free(val);
     ok(val = value_new_lua("return self.slot"));
     cmp_ok(val->type, "==", VALUE_LUA);
-    ok(!value_eval(val, NULL, NULL), "inadvertent use of value_eval() with NULL composer raises an error");
+    ok(!value_eval(val, interp, NULL, NULL), "inadvertent use of value_eval() with NULL composer raises an error");
     value_free(val);
     /* can't test "Lua values" more thoroughly without a composer object and a
      * metatable, but this functionality is tested in test_lua.c */
 }
 
+static void
+test_chunk(void)
+{
+    value_t *val, *clone;
+    int chunk;
+
+    ok(val = value_new_lua("return 'compiled' .. 1"));
+    cmp_ok(val->cache.chunk, "==", LUA_NOREF, "code is not compiled before first evaluation");
+    is(value_eval(val, interp, NULL, NULL), "compiled1");
+    cmp_ok(val->cache.chunk, "!=", LUA_NOREF, "compiled code is kept after evaluation");
+    chunk = val->cache.chunk;
+    is(value_eval(val, interp, NULL, NULL), "compiled1");
+    cmp_ok(val->cache.chunk, "==", chunk, "compiled code is reused");
+    ok(clone = value_clone(val));
+    cmp_ok(clone->cache.chunk, "!=", LUA_NOREF, "clone shares compiled code");
+    cmp_ok(clone->cache.chunk, "!=", val->cache.chunk, "... through its own reference");
+    is(value_eval(clone, interp, NULL, NULL), "compiled1");
+    value_free(clone);
+    is(value_eval(val, interp, NULL, NULL), "compiled1", "freeing clone leaves original intact");
+    interpreter_cleanup(interp);
+    is(value_eval(val, interp, NULL, NULL), "compiled1", "code is recompiled after interpreter cleanup");
+    ok(clone = value_clone(val));
+    interpreter_cleanup(interp);
+    value_free(clone);
+    value_free(val);
+    ok(val = value_new_lua("return ("));
+    ok(!value_eval(val, interp, NULL, NULL), "code with syntax errors raises an error");
+    cmp_ok(val->cache.chunk, "==", LUA_NOREF, "... and is not kept");
+    value_free(val);
+}
+
 static void
 test_int(void)
 {
@@ -84,29 +127,29 @@ test_int(void)
     int converted;
     ok(val = value_new_int(123));
     cmp_ok(val->type, "==", VALUE_INT);
-    is(value_eval(val, NULL, NULL), "123");
+    is(value_eval(val, interp, NULL, NULL), "123");
     value_free(val);
     ok(val = value_new_int(-789));
     cmp_ok(val->type, "==", VALUE_INT);
-    is(value_eval(val, NULL, NULL), "-789");
+    is(value_eval(val, interp, NULL, NULL), "-789");
     value_free(val);
     ok(val = value_new_int(INT_MAX));
     cmp_ok(val->type, "==", VALUE_INT);
     cmp_ok(val->source.integer, "==", INT_MAX);
     /* do not stringify INT_MAX as it may be a hexadecimal constant */
-    converted = atoi(value_eval(val, NULL, NULL));
+    converted = atoi(value_eval(val, interp, NULL, NULL));
     cmp_ok(converted, "==", INT_MAX);
     value_free(val);
     ok(val = value_new_int(INT_MIN));
     cmp_ok(val->type, "==", VALUE_INT);
     cmp_ok(val->source.integer, "==", INT_MIN);
     /* cannot stringify INT_MIN as it is not a literal */
-    converted = atoi(value_eval(val, NULL, NULL));
+    converted = atoi(value_eval(val, interp, NULL, NULL));
     cmp_ok(converted, "==", INT_MIN);
     value_free(val);
     ok(val = value_new_int(5001));
-    is(value_eval(val, NULL, NULL), "5001");
-    is(value_eval(val, NULL, NULL), "5001", "force two consecutive evaluations; should not leak memory");
+    is(value_eval(val, interp, NULL, NULL), "5001");
+    is(value_eval(val, interp, NULL, NULL), "5001", "force two consecutive evaluations; should not leak memory");
     value_free(val);
 }
 
@@ -116,35 +159,138 @@ test_auto(void)
     value_t *val;
     ok(val = value_new_auto(" some string contents"));
     cmp_ok(val->type, "==", VALUE_STRING);
-    is(value_eval(val, NULL, NULL), " some string contents");
+    is(value_eval(val, interp, NULL, NULL), " some string contents");
     value_free(val);
     ok(val = value_new_auto("lua { return 1+2 }"));
     cmp_ok(val->type, "==", VALUE_LUA);
-    is(value_eval(val, NULL, NULL), "3");
+    is(value_eval(val, interp, NULL, NULL), "3");
     value_free(val);
     ok(val = value_new_auto("lua [ return 1+2+3 ]"));
     cmp_ok(val->type, "==", VALUE_STRING);
-    is(value_eval(val, NULL, NULL), "lua [ return 1+2+3 ]", "invalid Lua function syntax leads to interpretation as string");
+    is(value_eval(val, interp, NULL, NULL), "lua [ return 1+2+3 ]", "invalid Lua function syntax leads to interpretation as string");
     value_free(val);
     ok(val = value_new_auto("lua { return 1+2+3"));
     cmp_ok(val->type, "==", VALUE_STRING);
-    is(value_eval(val, NULL, NULL), "lua { return 1+2+3", "missing closing brace leads to interpretation as string");
+    is(value_eval(val, interp, NULL, NULL), "lua { return 1+2+3", "missing closing brace leads to interpretation as string");
+    value_free(val);
+    ok(val = value_new_auto("volatile lua { return 1+2+3+4 }"));
+    cmp_ok(val->type, "==", VALUE_LUA);
+    ok(val->is_volatile, "volatile Lua function");
+    is(value_eval(val, interp, NULL, NULL), "10");
+    value_free(val);
+    ok(val = value_new_auto("volatilelua { return 1 }"));
+    cmp_ok(val->type, "==", VALUE_STRING, "keyword 'volatile' must be followed by whitespace");
     value_free(val);
     ok(val = value_new_auto("123"));
     cmp_ok(val->type, "==", VALUE_STRING, "value_new_auto() doesn't recognize integers");
-    is(value_eval(val, NULL, NULL), "123");
+    is(value_eval(val, interp, NULL, NULL), "123");
     value_free(val);
     ok(val = value_new_auto("-987"));
     cmp_ok(val->type, "==", VALUE_STRING, "value_new_auto() doesn't recognize integers");
-    is(value_eval(val, NULL, NULL), "-987");
+    is(value_eval(val, interp, NULL, NULL), "-987");
     value_free(val);
     ok(val = value_new_auto("3.141592"));
     cmp_ok(val->type, "==", VALUE_STRING, "value_new_auto() doesn't recognize reals");
-    is(value_eval(val, NULL, NULL), "3.141592");
+    is(value_eval(val, interp, NULL, NULL), "3.141592");
     value_free(val);
     ok(val = value_new_auto("-1."));
     cmp_ok(val->type, "==", VALUE_STRING, "value_new_auto() doesn't recognize reals");
-    is(value_eval(val, NULL, NULL), "-1.");
+    is(value_eval(val, interp, NULL, NULL), "-1.");
+    value_free(val);
+}
+
+static void
+test_fold(void)
+{
+    value_t *val, *clone;
+    buf_t buf;
+    value_dump_info_t info = { &buf, NULL, NULL };
+    buf_init(&buf, 0);
+    ok(val = value_new_lua("return 'a' .. 1 + 2"));
+    ok(value_fold(val, NULL, interp), "constant");
+    cmp_ok(val->type, "==", VALUE_STRING);
+    is(value_eval(val, interp, NULL, NULL), "a3");
+    value_dump(val, &info);
+    ok(strstr(buf.buf, "| a3 | (folded:) local self = ...; return 'a' .. 1 + 2\n"), "source shown in dump");
+    ok(clone = value_clone(val));
+    ok(clone->is_folded, "clone remembers where it came from");
+    value_free(clone);
+    value_free(val);
+    ok(val = value_new_lua("return self.x"));
+    ok(!value_fold(val, NULL, interp), "refers to self");
+    cmp_ok(val->type, "==", VALUE_LUA);
+    value_free(val);
+    ok(val = value_new_lua("local s = ...; return s.x"));
+    ok(!value_fold(val, NULL, interp), "refers to self under another name");
+    value_free(val);
+    ok(val = value_new_lua("return os.date()"));
+    ok(!value_fold(val, NULL, interp), "impure library");
+    value_free(val);
+    ok(val = value_new_lua("return math.randomseed"));
+    ok(!value_fold(val, NULL, interp), "impure function");
+    value_free(val);
+    ok(val = value_new_lua("return some_weird_name"));
+    ok(!value_fold(val, NULL, interp), "unknown global");
+    value_free(val);
+    ok(val = value_new_lua("string.x = 1; return 1"));
+    ok(!value_fold(val, NULL, interp), "modifies a library");
+    value_free(val);
+    ok(val = value_new_lua("return tostring(string.x)"));
+    is(value_eval(val, interp, NULL, NULL), "nil", "library left unchanged");
+    value_free(val);
+    ok(val = value_new_lua("local n = 0; for k in pairs(string) do n = n + 1 end; return n"));
+    ok(!value_fold(val, NULL, interp), "iterates over a library");
+    value_free(val);
+    ok(val = value_new_lua("local n = 0; for k in pairs({ 1, 2 }) do n = n + 1 end; return string.rep('x', n)"));
+    ok(value_fold(val, NULL, interp), "iterates over its own table");
+    is(value_eval(val, interp, NULL, NULL), "xx");
+    value_free(val);
+    ok(val = value_new_lua("x = 1; return 1"));
+    ok(!value_fold(val, NULL, interp), "assigns global");
+    value_free(val);
+    ok(val = value_new_lua("while true do end"));
+    ok(!value_fold(val, NULL, interp), "does not finish");
+    value_free(val);
+    ok(val = value_new_lua("return {}"));
+    ok(!value_fold(val, NULL, interp), "result not a string");
+    value_free(val);
+    ok(val = value_new_volatile_lua("return 1"));
+    ok(!value_fold(val, NULL, interp), "volatile");
+    value_free(val);
+    ok(val = value_new_int(1));
+    ok(!value_fold(val, NULL, interp), "not Lua");
+    value_free(val);
+    buf_release(&buf);
+}
+
+static void
+test_tpl(void)
+{
+    value_t *val;
+    ok(val = value_new_auto("tpl { costs $$5 }"));
+    cmp_ok(val->type, "==", VALUE_TPL);
+    is(value_eval(val, interp, NULL, NULL), "costs $5", "template without references, surrounding whitespace ignored");
+    value_free(val);
+    ok(val = value_new_tpl("$a $$$"));
+    is(value_eval(val, interp, NULL, NULL), "$a $$", "lone dollar signs are literal");
+    value_free(val);
+    ok(val = value_new_tpl("a${x}b"));
+    is(value_eval(val, interp, NULL, NULL), NULL, "references need a composer object");
+    value_free(val);
+    ok(val = value_new_tpl("${x"));
+    is(value_eval(val, interp, NULL, NULL), NULL, "unterminated reference");
+    value_free(val);
+    ok(val = value_new_tpl("${}"));
+    is(value_eval(val, interp, NULL, NULL), NULL, "missing attribute name");
+    value_free(val);
+    ok(val = value_new_tpl("${x[a]}"));
+    is(value_eval(val, interp, NULL, NULL), NULL, "malformed substring");
+    value_free(val);
+    ok(val = value_new_tpl("${x%-}"));
+    is(value_eval(val, interp, NULL, NULL), NULL, "missing width");
+    value_free(val);
+    ok(val = value_new_auto("tpl ${x}"));
+    cmp_ok(val->type, "==", VALUE_STRING, "template needs braces");
     value_free(val);
 }
 
@@ -152,11 +298,15 @@ int
 main(void)
 {
     plan(NO_PLAN);
+    interp = interpreter_new();
     test_block();
     test_string();
     test_lua();
+    test_chunk();
+    test_fold();
+    test_tpl();
     test_int();
     test_auto();
-    interpreter_cleanup();
+    interpreter_free(interp);
     done_testing();
 }
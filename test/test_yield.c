@@ -23,6 +23,8 @@
 #include "taputil.h"
 #include "pathcomp.h"
 #include "list.h"
+#include <errno.h>
+#include <string.h>
 
 const char *config = "\
 [test.basic.1]\n\
@@ -149,12 +151,76 @@ test_basic(void)
     pathcomp_free(c);
 }
 
+/* test pathcomp_yield_into() and pathcomp_eval_into() */
+static void
+test_into(void)
+{
+    pathcomp_t *c = NULL;
+    pathcomp_handle_t h;
+    char buf[32];
+    size_t needed;
+
+    ok(c = pathcomp_new("test.basic.3"));
+    memset(buf, 'x', sizeof buf);
+    cmp_ok(pathcomp_yield_into(c, buf, sizeof buf, &needed), "==", 0);
+    is(buf, "/mnt/archive/G2/SEV1/");
+    cmp_ok(needed, "==", 22, "size includes null character");
+    cmp_ok(pathcomp_yield_into(c, buf, 22, NULL), "==", 0, "exact fit");
+    is(buf, "/mnt/archive/G2/SEV1/");
+    errno = 0;
+    cmp_ok(pathcomp_yield_into(c, buf, 21, &needed), "==", -1, "one too short");
+    cmp_ok(errno, "==", ERANGE);
+    cmp_ok(needed, "==", 22);
+    is(buf, "/mnt/archive/G2/SEV1", "truncated");
+    cmp_ok(pathcomp_yield_into(c, buf, 13, &needed), "==", -1);
+    is(buf, "/mnt/archive", "truncated before separator");
+    cmp_ok(pathcomp_yield_into(c, buf, 14, &needed), "==", -1);
+    is(buf, "/mnt/archive/", "truncated after separator");
+    cmp_ok(pathcomp_yield_into(c, NULL, 0, &needed), "==", -1, "size only");
+    cmp_ok(needed, "==", 22);
+
+    memset(buf, 'x', sizeof buf);
+    cmp_ok(pathcomp_eval_into(c, "root", buf, sizeof buf, &needed), "==", 0);
+    is(buf, "/mnt/archive");
+    cmp_ok(needed, "==", 13);
+    cmp_ok(pathcomp_eval_into(c, "root", buf, 5, &needed), "==", -1);
+    is(buf, "/mnt");
+    errno = 0;
+    cmp_ok(pathcomp_eval_into(c, "nonexistent", buf, sizeof buf, &needed), "==", -1);
+    cmp_ok(errno, "==", ENOENT);
+    cmp_ok(needed, "==", 0);
+    is(buf, "");
+    ok((h = pathcomp_lookup(c, "compose")) >= 0);
+    cmp_ok(pathcomp_eval_into_h(c, h, buf, sizeof buf, &needed), "==", 0);
+    is(buf, "G2/SEV1/");
+    cmp_ok(needed, "==", 9);
+    pathcomp_free(c);
+
+    ok(c = pathcomp_new("test.basic.5"));
+    errno = 0;
+    cmp_ok(pathcomp_yield_into(c, buf, sizeof buf, &needed), "==", -1, "no pathname");
+    cmp_ok(errno, "==", ENOENT);
+    cmp_ok(needed, "==", 0);
+    is(buf, "");
+    pathcomp_free(c);
+
+    ok(c = pathcomp_new("test.basic.7"));
+    for (; !pathcomp_done(c); pathcomp_next(c)) {
+        char *s = pathcomp_yield(c);
+        cmp_ok(pathcomp_yield_into(c, buf, sizeof buf, NULL), "==", 0);
+        is(buf, s, "same pathname as pathcomp_yield()");
+        free(s);
+    }
+    pathcomp_free(c);
+}
+
 int
 main(void)
 {
     plan(NO_PLAN);
     pathcomp_add_config_from_string(config);
     test_basic();
+    test_into();
     pathcomp_cleanup();
     done_testing();
 }